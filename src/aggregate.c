@@ -0,0 +1,486 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aggregate.h"
+#include "alloc-util.h"
+#include "bootchart.h"
+#include "report.h"
+#include "string-util.h"
+#include "utf8.h"
+
+/* height of a row of the chart */
+#define AGGREGATE_ROW 16.0
+/* where the rows start, below the title */
+#define AGGREGATE_TOP 130.0
+
+#define time_to_graph(t) ((t) * arg_scale_x)
+
+static const char* const aggregate_metric_table[_AGGREGATE_METRIC_MAX] = {
+        [AGGREGATE_START]    = "start",
+        [AGGREGATE_END]      = "end",
+        [AGGREGATE_DURATION] = "duration",
+        [AGGREGATE_CPU]      = "cpu",
+        [AGGREGATE_WAIT]     = "wait",
+};
+
+/* xorshift64*, enough to pick what a reservoir keeps */
+static uint64_t aggregate_random(struct aggregate *a) {
+        a->random ^= a->random >> 12;
+        a->random ^= a->random << 25;
+        a->random ^= a->random >> 27;
+
+        return a->random * UINT64_C(2685821657736338717);
+}
+
+static int aggregate_stat_add(struct aggregate *a, struct aggregate_stat *s, double v) {
+        double delta;
+        uint64_t i;
+
+        s->n++;
+        delta = v - s->mean;
+        s->mean += delta / s->n;
+        s->m2 += delta * (v - s->mean);
+
+        if (s->n_values < AGGREGATE_RESERVOIR) {
+                if (!GREEDY_REALLOC(s->values, s->allocated_values, s->n_values + 1))
+                        return -ENOMEM;
+
+                s->values[s->n_values++] = v;
+                return 0;
+        }
+
+        /* the n-th value is kept with a chance of RESERVOIR in n, in place of any other */
+        i = aggregate_random(a) % s->n;
+        if (i < AGGREGATE_RESERVOIR)
+                s->values[i] = v;
+
+        return 0;
+}
+
+static int compare_float(const void *a, const void *b) {
+        const float *x = a, *y = b;
+
+        return *x < *y ? -1 : *x > *y;
+}
+
+/* the percentiles are only right after this, and nothing was added since */
+static void aggregate_stat_sort(struct aggregate_stat *s) {
+        qsort(s->values, s->n_values, sizeof(float), compare_float);
+}
+
+static double aggregate_stat_percentile(const struct aggregate_stat *s, unsigned p) {
+        if (s->n_values == 0)
+                return 0.0;
+
+        return s->values[(s->n_values - 1) * p / 100];
+}
+
+static double aggregate_stat_stddev(const struct aggregate_stat *s) {
+        return s->n > 1 ? sqrt(s->m2 / (s->n - 1)) : 0.0;
+}
+
+static void aggregate_stat_done(struct aggregate_stat *s) {
+        s->values = mfree(s->values);
+        s->n_values = s->allocated_values = 0;
+}
+
+/* the entry of a key, added the first time the key is seen */
+static int aggregate_entry(struct aggregate *a, int key, const char *name, const char *cgroup, bool service) {
+        struct aggregate_entry *e;
+
+        if (!GREEDY_REALLOC(a->by_key, a->allocated_by_key, key + 1))
+                return -ENOMEM;
+        while (a->n_by_key <= (size_t) key)
+                a->by_key[a->n_by_key++] = -1;
+
+        if (a->by_key[key] >= 0)
+                return a->by_key[key];
+
+        if (!GREEDY_REALLOC(a->entries, a->allocated_entries, a->n_entries + 1))
+                return -ENOMEM;
+
+        e = &a->entries[a->n_entries];
+        *e = (struct aggregate_entry) {
+                .name = strdup(name),
+                .cgroup = cgroup ? strdup(cgroup) : NULL,
+                .service = service,
+        };
+        if (!e->name || (cgroup && !e->cgroup)) {
+                free(e->name);
+                free(e->cgroup);
+                return -ENOMEM;
+        }
+
+        a->by_key[key] = a->n_entries;
+
+        return a->n_entries++;
+}
+
+static int aggregate_entry_add(struct aggregate *a, struct aggregate_entry *e,
+                               double start, double end, double cpu, double wait) {
+        int r;
+
+        r = aggregate_stat_add(a, &e->stats[AGGREGATE_START], start);
+        if (r >= 0)
+                r = aggregate_stat_add(a, &e->stats[AGGREGATE_END], end);
+        if (r >= 0)
+                r = aggregate_stat_add(a, &e->stats[AGGREGATE_DURATION], end - start);
+        if (r >= 0)
+                r = aggregate_stat_add(a, &e->stats[AGGREGATE_CPU], cpu);
+        if (r >= 0)
+                r = aggregate_stat_add(a, &e->stats[AGGREGATE_WAIT], wait);
+
+        return r;
+}
+
+static int aggregate_service(struct aggregate *a, const struct diff_process *p) {
+        _cleanup_free_ char *key = NULL;
+        struct aggregate_entry *e;
+        const char *name;
+        int i;
+
+        /* a tab keeps these apart from the keys of processes */
+        if (asprintf(&key, "\t%s", p->cgroup) < 0)
+                return -ENOMEM;
+
+        i = strtab_intern(&a->keys.keys, key);
+        if (i < 0)
+                return i;
+
+        name = strrchr(p->cgroup, '/');
+        i = aggregate_entry(a, i, name && name[1] ? name + 1 : p->cgroup, p->cgroup, true);
+        if (i < 0)
+                return i;
+
+        /* a unit runs from when its first process started until its last one ended */
+        e = &a->entries[i];
+        if (e->boot != a->n_boots) {
+                e->boot = a->n_boots;
+                e->start = p->start;
+                e->end = p->end;
+                e->cpu = e->wait = 0.0;
+        } else {
+                e->start = MIN(e->start, p->start);
+                e->end = MAX(e->end, p->end);
+        }
+
+        e->cpu += p->cpu;
+        e->wait += p->wait;
+
+        return 0;
+}
+
+int aggregate_add(struct aggregate *a, struct diff_boot *b) {
+        size_t i;
+        int r;
+
+        assert(a);
+        assert(b);
+
+        r = diff_keys_assign(&a->keys, b);
+        if (r < 0)
+                return r;
+
+        a->n_boots++;
+
+        r = aggregate_stat_add(a, &a->duration, b->duration);
+        if (r < 0)
+                return r;
+
+        if (b->idle >= 0.0) {
+                r = aggregate_stat_add(a, &a->idle, b->idle);
+                if (r < 0)
+                        return r;
+        }
+
+        for (i = 0; i < b->n_processes; i++) {
+                const struct diff_process *p = &b->processes[i];
+                int e;
+
+                e = aggregate_entry(a, p->tree_key, p->name, p->cgroup, false);
+                if (e < 0)
+                        return e;
+
+                r = aggregate_entry_add(a, &a->entries[e], p->start, p->end, p->cpu, p->wait);
+                if (r < 0)
+                        return r;
+
+                if (p->cgroup) {
+                        r = aggregate_service(a, p);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        for (i = 0; i < a->n_entries; i++) {
+                struct aggregate_entry *e = &a->entries[i];
+
+                if (!e->service || e->boot != a->n_boots)
+                        continue;
+
+                r = aggregate_entry_add(a, e, e->start, e->end, e->cpu, e->wait);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int compare_entries(const void *x, const void *y) {
+        const struct aggregate_entry *a = *(const struct aggregate_entry **) x, *b = *(const struct aggregate_entry **) y;
+        double sa, sb;
+
+        /* services above the processes */
+        if (a->service != b->service)
+                return b->service - a->service;
+
+        sa = aggregate_stat_percentile(&a->stats[AGGREGATE_START], 50);
+        sb = aggregate_stat_percentile(&b->stats[AGGREGATE_START], 50);
+
+        return sa < sb ? -1 : sa > sb;
+}
+
+/* the entries in the order they are written, with all values sorted */
+static int aggregate_sort(struct aggregate *a, struct aggregate_entry ***ret) {
+        struct aggregate_entry **entries;
+        AggregateMetric m;
+        size_t i;
+
+        entries = new(struct aggregate_entry *, a->n_entries);
+        if (!entries)
+                return -ENOMEM;
+
+        for (i = 0; i < a->n_entries; i++) {
+                for (m = 0; m < _AGGREGATE_METRIC_MAX; m++)
+                        aggregate_stat_sort(&a->entries[i].stats[m]);
+
+                entries[i] = &a->entries[i];
+        }
+
+        aggregate_stat_sort(&a->duration);
+        aggregate_stat_sort(&a->idle);
+
+        qsort(entries, a->n_entries, sizeof(struct aggregate_entry *), compare_entries);
+
+        *ret = entries;
+
+        return 0;
+}
+
+/* as comments above the table, empty when there were no values */
+static void csv_write_stat(FILE *f, const char *name, const struct aggregate_stat *s) {
+        if (s->n == 0) {
+                fprintf(f, "# %1$s_median=\n# %1$s_p90=\n# %1$s_p99=\n# %1$s_mean=\n# %1$s_stddev=\n", name);
+                return;
+        }
+
+        fprintf(f, "# %1$s_median=%2$.6f\n# %1$s_p90=%3$.6f\n# %1$s_p99=%4$.6f\n# %1$s_mean=%5$.6f\n# %1$s_stddev=%6$.6f\n",
+                name, aggregate_stat_percentile(s, 50), aggregate_stat_percentile(s, 90),
+                aggregate_stat_percentile(s, 99), s->mean, aggregate_stat_stddev(s));
+}
+
+int aggregate_write_csv(FILE *f, struct aggregate *a) {
+        _cleanup_free_ struct aggregate_entry **entries = NULL;
+        AggregateMetric m;
+        size_t i;
+        int r;
+
+        assert(f);
+        assert(a);
+
+        r = aggregate_sort(a, &entries);
+        if (r < 0)
+                return r;
+
+        fprintf(f, "# boots=%u\n# idle_boots=%u\n", a->n_boots, a->idle.n);
+        csv_write_stat(f, "duration", &a->duration);
+        csv_write_stat(f, "idle", &a->idle);
+
+        fputs("kind,name,cgroup,boots", f);
+        for (m = 0; m < _AGGREGATE_METRIC_MAX; m++)
+                fprintf(f, ",%1$s_median,%1$s_p90,%1$s_p99,%1$s_mean,%1$s_stddev", aggregate_metric_table[m]);
+        fputc('\n', f);
+
+        for (i = 0; i < a->n_entries; i++) {
+                const struct aggregate_entry *e = entries[i];
+
+                fprintf(f, "%s,", e->service ? "service" : "process");
+                csv_write_string(f, e->name);
+                fputc(',', f);
+                csv_write_string(f, e->cgroup);
+                fprintf(f, ",%u", e->stats[AGGREGATE_START].n);
+
+                for (m = 0; m < _AGGREGATE_METRIC_MAX; m++) {
+                        const struct aggregate_stat *s = &e->stats[m];
+
+                        fprintf(f, ",%.6f,%.6f,%.6f,%.6f,%.6f",
+                                aggregate_stat_percentile(s, 50),
+                                aggregate_stat_percentile(s, 90),
+                                aggregate_stat_percentile(s, 99),
+                                s->mean,
+                                aggregate_stat_stddev(s));
+                }
+                fputc('\n', f);
+        }
+
+        return 0;
+}
+
+static void svg_write_stat(FILE *f, const char *name, const struct aggregate_stat *s) {
+        if (s->n == 0)
+                fprintf(f, "%s never", name);
+        else
+                fprintf(f, "%s %.03fs median, %.03fs p90, %.03fs p99, %.03fs stddev", name,
+                        aggregate_stat_percentile(s, 50), aggregate_stat_percentile(s, 90),
+                        aggregate_stat_percentile(s, 99), aggregate_stat_stddev(s));
+}
+
+int aggregate_write_svg(FILE *f, struct aggregate *a) {
+        _cleanup_free_ struct aggregate_entry **entries = NULL;
+        double end = 0.0;
+        size_t i;
+        int r, s;
+
+        assert(f);
+        assert(a);
+
+        r = aggregate_sort(a, &entries);
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < a->n_entries; i++)
+                end = MAX(end, aggregate_stat_percentile(&entries[i]->stats[AGGREGATE_END], 99));
+
+        fprintf(f, "<?xml version=\"1.0\" standalone=\"no\"?>\n");
+        fprintf(f, "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" ");
+        fprintf(f, "\"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n");
+        fprintf(f, "<svg width=\"%.0fpx\" height=\"%.0fpx\" version=\"1.1\" xmlns=\"http://www.w3.org/2000/svg\">\n\n",
+                MAX(150.0 + 10.0 + time_to_graph(end) + 600.0, 1600.0), AGGREGATE_TOP + AGGREGATE_ROW * (a->n_entries + 2));
+
+        fprintf(f, "<!-- This file is a bootchart aggregate, generated by bootchart version %s -->\n\n", VERSION);
+
+        fprintf(f, "<defs>\n  <style type=\"text/css\">\n    <![CDATA[\n");
+        fprintf(f, "      rect       { stroke-width: 1; }\n");
+        fprintf(f, "      rect.bg    { fill: rgb(255,255,255); }\n");
+        fprintf(f, "      rect.ps    { fill: rgb(192,192,192); stroke: rgb(128,128,128); fill-opacity: 0.7; }\n");
+        fprintf(f, "      rect.svc   { fill: rgb(64,64,240); stroke: rgb(128,128,128); fill-opacity: 0.5; }\n");
+        fprintf(f, "      line       { stroke: rgb(64,64,64); stroke-width: 1; }\n");
+        fprintf(f, "      line.sec01 { stroke: rgb(224,224,224); stroke-width: 1; }\n");
+        fprintf(f, "      line.idle  { stroke: rgb(64,64,64); stroke-dasharray: 10 6; stroke-opacity: 0.7; }\n");
+        fprintf(f, "      text       { font-family: Verdana, Helvetica; font-size: 10; }\n");
+        fprintf(f, "      text.sec   { font-size: 8; }\n");
+        fprintf(f, "      text.t1    { font-size: 24; }\n");
+        fprintf(f, "      text.t2    { font-size: 12; }\n");
+        fprintf(f, "    ]]>\n   </style>\n</defs>\n\n");
+
+        fprintf(f, "<rect class=\"bg\" width=\"100%%\" height=\"100%%\" />\n");
+        fprintf(f, "<text class=\"t1\" x=\"0\" y=\"30\">Bootchart of %u boots</text>\n", a->n_boots);
+        fprintf(f, "<text class=\"t2\" x=\"20\" y=\"50\">");
+        svg_write_stat(f, "Duration", &a->duration);
+        fprintf(f, "</text>\n<text class=\"t2\" x=\"20\" y=\"65\">");
+        svg_write_stat(f, "Idle after", &a->idle);
+        fprintf(f, " (%u boots went idle)</text>\n", a->idle.n);
+        fprintf(f, "<text class=\"sec\" x=\"20\" y=\"80\">Boxes run from the median start to the median end, "
+                "whiskers to the 90th and 99th percentile of the end; units are blue, processes grey</text>\n");
+
+        fprintf(f, "<g transform=\"translate(10,%.0f)\">\n", AGGREGATE_TOP);
+
+        for (s = 0; s <= (int) end + 1; s++) {
+                fprintf(f, "  <line class=\"sec01\" x1=\"%.03f\" y1=\"0\" x2=\"%.03f\" y2=\"%.03f\" />\n",
+                        time_to_graph(s), time_to_graph(s), AGGREGATE_ROW * a->n_entries);
+                fprintf(f, "  <text class=\"sec\" x=\"%.03f\" y=\"-3\">%ds</text>\n", time_to_graph(s), s);
+        }
+
+        for (i = 0; i < a->n_entries; i++) {
+                _cleanup_free_ char *escaped = NULL;
+                const struct aggregate_entry *e = entries[i];
+                const struct aggregate_stat *st = e->stats;
+                const char *name = e->name;
+                double y = AGGREGATE_ROW * i + 1.0, mid = y + AGGREGATE_ROW / 2.0 - 1.0;
+                double start, stop, p90, p99;
+
+                if (!utf8_is_printable(name, strlen(name))) {
+                        escaped = utf8_escape_non_printable(name);
+                        if (escaped)
+                                name = escaped;
+                }
+
+                start = aggregate_stat_percentile(&st[AGGREGATE_START], 50);
+                stop = MAX(aggregate_stat_percentile(&st[AGGREGATE_END], 50), start);
+                p90 = MAX(aggregate_stat_percentile(&st[AGGREGATE_END], 90), stop);
+                p99 = MAX(aggregate_stat_percentile(&st[AGGREGATE_END], 99), p90);
+
+                fprintf(f, "  <rect class=\"%s\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                        e->service ? "svc" : "ps", time_to_graph(start), y,
+                        time_to_graph(stop - start), AGGREGATE_ROW - 2.0);
+
+                if (p99 > stop) {
+                        fprintf(f, "  <line x1=\"%.03f\" y1=\"%.03f\" x2=\"%.03f\" y2=\"%.03f\" />\n",
+                                time_to_graph(stop), mid, time_to_graph(p99), mid);
+                        fprintf(f, "  <line x1=\"%.03f\" y1=\"%.03f\" x2=\"%.03f\" y2=\"%.03f\" />\n",
+                                time_to_graph(p90), mid - 3.0, time_to_graph(p90), mid + 3.0);
+                        fprintf(f, "  <line x1=\"%.03f\" y1=\"%.03f\" x2=\"%.03f\" y2=\"%.03f\" />\n",
+                                time_to_graph(p99), y, time_to_graph(p99), y + AGGREGATE_ROW - 2.0);
+                }
+
+                fprintf(f, "  <text x=\"%.03f\" y=\"%.03f\"><![CDATA[%s]]> in %u boots, duration %.03fs &#177;%.03fs, "
+                        "CPU %.03fs, wait %.03fs</text>\n",
+                        time_to_graph(p99) + 5.0, y + 11.0, name, st[AGGREGATE_START].n,
+                        aggregate_stat_percentile(&st[AGGREGATE_DURATION], 50),
+                        aggregate_stat_stddev(&st[AGGREGATE_DURATION]),
+                        aggregate_stat_percentile(&st[AGGREGATE_CPU], 50),
+                        aggregate_stat_percentile(&st[AGGREGATE_WAIT], 50));
+        }
+
+        if (a->idle.n > 0)
+                fprintf(f, "  <line class=\"idle\" x1=\"%.03f\" y1=\"0\" x2=\"%.03f\" y2=\"%.03f\" />\n",
+                        time_to_graph(aggregate_stat_percentile(&a->idle, 50)),
+                        time_to_graph(aggregate_stat_percentile(&a->idle, 50)),
+                        AGGREGATE_ROW * a->n_entries);
+
+        fprintf(f, "</g>\n</svg>\n");
+
+        return 0;
+}
+
+void aggregate_done(struct aggregate *a) {
+        AggregateMetric m;
+        size_t i;
+
+        assert(a);
+
+        for (i = 0; i < a->n_entries; i++) {
+                free(a->entries[i].name);
+                free(a->entries[i].cgroup);
+                for (m = 0; m < _AGGREGATE_METRIC_MAX; m++)
+                        aggregate_stat_done(&a->entries[i].stats[m]);
+        }
+
+        a->entries = mfree(a->entries);
+        a->n_entries = a->allocated_entries = 0;
+        a->by_key = mfree(a->by_key);
+        a->n_by_key = a->allocated_by_key = 0;
+        aggregate_stat_done(&a->duration);
+        aggregate_stat_done(&a->idle);
+        diff_keys_done(&a->keys);
+}
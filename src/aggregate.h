@@ -0,0 +1,94 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "diff.h"
+#include "macro.h"
+
+/*
+ * Values kept of each statistic for its percentiles. Up to this many
+ * boots they are exact, beyond it they come from a uniform sample of
+ * the boots, so memory doesn't grow with the number of boots. The
+ * entries aren't bounded though, there is one for every process key
+ * and service seen in any of the boots.
+ */
+#define AGGREGATE_RESERVOIR 1024
+
+typedef enum AggregateMetric {
+        AGGREGATE_START,
+        AGGREGATE_END,
+        AGGREGATE_DURATION,
+        AGGREGATE_CPU,
+        AGGREGATE_WAIT,
+        _AGGREGATE_METRIC_MAX,
+} AggregateMetric;
+
+struct aggregate_stat {
+        unsigned n;
+        /* running mean and sum of squared differences from it */
+        double mean;
+        double m2;
+        float *values;
+        size_t n_values;
+        size_t allocated_values;
+};
+
+/* a process, or the control group of a service */
+struct aggregate_entry {
+        char *name;
+        char *cgroup;
+        bool service;
+        struct aggregate_stat stats[_AGGREGATE_METRIC_MAX];
+
+        /* a service collects its processes of the current boot here */
+        unsigned boot;
+        double start, end, cpu, wait;
+};
+
+struct aggregate {
+        /* process keys as for diff, and services by their control group */
+        struct diff_keys keys;
+        /* index into entries by key, or -1 */
+        int *by_key;
+        size_t n_by_key;
+        size_t allocated_by_key;
+
+        struct aggregate_entry *entries;
+        size_t n_entries;
+        size_t allocated_entries;
+
+        unsigned n_boots;
+        struct aggregate_stat duration;
+        struct aggregate_stat idle;
+        /* picks the values the reservoir keeps, the same for the same reports */
+        uint64_t random;
+};
+
+#define AGGREGATE_INIT { .keys = DIFF_KEYS_INIT, .random = UINT64_C(0x2545f4914f6cdd1d) }
+
+/* adds one boot, which can be freed right after */
+int aggregate_add(struct aggregate *a, struct diff_boot *b);
+
+int aggregate_write_csv(FILE *f, struct aggregate *a);
+int aggregate_write_svg(FILE *f, struct aggregate *a);
+
+void aggregate_done(struct aggregate *a);
@@ -0,0 +1,61 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "autostop.h"
+#include "macro.h"
+
+bool autostop_check(struct autostop *a, const struct list_sample_data *head, int n_cpus, double log_start) {
+        double t;
+
+        assert(a);
+        assert(head);
+
+        t = head->sampletime;
+
+        if (a->max_duration > 0.0 && t - log_start >= a->max_duration) {
+                snprintf(a->reason, sizeof(a->reason), "recorded for %gs", a->max_duration);
+                return true;
+        }
+
+        if (a->stop_at > 0.0)
+                return t >= a->stop_at;
+
+        if (a->idle > 0.0) {
+                if (!idle_recent(head, n_cpus, a->idle_window, a->idle_threshold))
+                        a->idle_since = 0.0;
+                else if (a->idle_since <= 0.0)
+                        a->idle_since = t;
+                else if (t - a->idle_since >= a->idle)
+                        snprintf(a->reason, sizeof(a->reason), "idle for %gs", a->idle);
+        }
+
+        if (!a->reason[0] && a->path && access(a->path, F_OK) >= 0)
+                snprintf(a->reason, sizeof(a->reason), "%s appeared", a->path);
+
+        if (!a->reason[0] && a->unit_path && access(a->unit_path, F_OK) >= 0)
+                snprintf(a->reason, sizeof(a->reason), "%s was started", a->unit);
+
+        if (!a->reason[0])
+                return false;
+
+        a->stop_at = t + a->grace;
+
+        return t >= a->stop_at;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+
+#include "bootchart.h"
+#include "idle.h"
+
+/*
+ * Ends the recording before --samples runs out: when the system has
+ * been idle for a while, when a file shows up or a unit is started, or
+ * after some time. All but the last keep sampling for a grace period,
+ * so whatever the condition was waiting for is still in the chart.
+ */
+struct autostop {
+        /* seconds the system has to stay idle, 0 to not wait for idle */
+        double idle;
+        /* what idle means, as for idle_recent() */
+        double idle_window;
+        double idle_threshold;
+        /* stop once this exists, NULL to not check */
+        const char *path;
+        /* stop once this unit was started, and the file systemd marks that with */
+        const char *unit;
+        const char *unit_path;
+        /* seconds after the first sample, 0 for no limit */
+        double max_duration;
+        /* seconds to keep sampling after any other condition was met */
+        double grace;
+
+        /* when the current idle stretch began, 0 when busy */
+        double idle_since;
+        /* when to take the last sample, 0 until a condition was met */
+        double stop_at;
+        char reason[PATH_MAX + 64];
+};
+
+#define AUTOSTOP_INIT {}
+
+/*
+ * Called after each sample with the newest one at head, returns true
+ * when it was the last one; the reason is left in a->reason.
+ */
+bool autostop_check(struct autostop *a, const struct list_sample_data *head, int n_cpus, double log_start);
@@ -0,0 +1,523 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+/*
+ * Measures svg_do() on generated sample data of a few sizes, so changes
+ * to the renderer can be compared on the same input. Each data set is
+ * built and drawn in a child of its own, so that it is measured with a
+ * peak RSS of its own. Results are printed as one JSON object per
+ * line, with the CPU time and size of every section of the chart.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "bootchart.h"
+#include "json.h"
+#include "list.h"
+#include "log.h"
+#include "macro.h"
+#include "service.h"
+#include "strtab.h"
+#include "svg.h"
+#include "time-util.h"
+#include "util.h"
+
+/* what svg_do() needs from bootchart.c */
+bool arg_entropy = true;
+bool arg_initcall = false;
+bool arg_compress = false;
+bool arg_relative = false;
+bool arg_filter = true;
+bool arg_show_cmdline = false;
+bool arg_show_cgroup = false;
+bool arg_pss = false;
+bool arg_percpu = false;
+bool arg_cpu_heatmap = false;
+bool arg_io = true;
+bool arg_disks = false;
+bool arg_pressure = true;
+bool arg_overhead = true;
+double arg_max_overhead = 0.0;
+int arg_realtime = 0;
+int arg_cpu = -1;
+bool arg_lock_memory = false;
+double arg_idle_threshold = 4.0;
+double arg_idle_window = 0.5;
+CpuGroup arg_cpu_group = CPU_GROUP_CPU;
+ServiceView arg_service_view = SERVICE_VIEW_NO;
+int arg_samples_len = 0;
+int arg_io_interval = 4;
+double arg_hz = 25.0;
+double arg_scale_x = 100.0;
+double arg_scale_y = 20.0;
+
+char arg_init_path[PATH_MAX] = "";
+char arg_output_path[PATH_MAX] = "";
+char arg_root[PATH_MAX] = "";
+
+struct strtab ps_names = STRTAB_INIT;
+struct strtab cgroup_paths = STRTAB_INIT;
+
+/* processes that run from the first sample to the last, the others come and go */
+#define N_DAEMONS 20
+/* the share of the samples during which processes are started */
+#define BOOT_SHARE 0.6
+
+struct dataset {
+        const char *name;
+        int samples;
+        int processes;
+        int cpus;
+        bool pss;
+        bool percpu;
+        /* only drawn when asked for by name, or with --all */
+        bool large;
+};
+
+static const struct dataset datasets[] = {
+        { "small",      500,    200,   4                  },
+        { "small-pss",  500,    200,   4,   .pss = true   },
+        { "medium",     10000,  2000,  4                  },
+        { "medium-pss", 10000,  2000,  4,   .pss = true   },
+        { "percpu",     2000,   500,   256, .percpu = true },
+        { "large",      100000, 10000, 4,   .large = true },
+};
+
+static const char * const names[] = {
+        "systemd", "kworker/0:1", "kworker/u8:2", "systemd-udevd", "(sd-pam)",
+        "ksoftirqd/0", "rcu_gp", "dbus-daemon", "NetworkManager", "agetty",
+        "sshd", "bash", "systemd-journal", "polkitd", "kworker/1:0H",
+};
+
+static bool arg_all = false;
+static const char *arg_output = NULL;
+
+/* a pseudo random, but repeatable, number below n */
+static unsigned spread(unsigned a, unsigned b, unsigned n) {
+        return (a * 2654435761U ^ b * 40503U) % n;
+}
+
+/* processes, in the order the sampler finds them, and their life in samples */
+struct process {
+        struct ps_struct *ps;
+        int start;
+        int end;
+};
+
+static int process_sample(struct process *p, int i, struct list_sample_data *sampledata, int s) {
+        struct ps_struct *ps = p->ps;
+        struct ps_sched_struct *sample;
+        double busy;
+
+        sample = new0(struct ps_sched_struct, 1);
+        if (!sample)
+                return -ENOMEM;
+
+        /* like the sampler, the first record only marks when the process was found */
+        if (!ps->first) {
+                sample->sampledata = sampledata;
+                ps->first = ps->last = ps->sample = sample;
+
+                sample = new0(struct ps_sched_struct, 1);
+                if (!sample)
+                        return -ENOMEM;
+        }
+
+        busy = spread(i, s, 100) < 30 ? 0.5 : 0.02;
+        sample->runtime = ps->last->runtime + busy * 1000000000.0 / arg_hz;
+        sample->waittime = ps->last->waittime + busy / 4 * 1000000000.0 / arg_hz;
+        sample->sampledata = sampledata;
+        sample->ps_new = ps;
+
+        if (arg_pss) {
+                sample->pss = 1000 + spread(i, 0, 50) * 100 + (s - p->start) * 2;
+                if (sample->pss > ps->pss_max)
+                        ps->pss_max = sample->pss;
+        }
+
+        if (s % arg_io_interval == 0) {
+                sample->io = true;
+                sample->io_read = spread(i, s, 4) == 0 ? spread(s, i, 2048) : 0;
+                sample->io_write = spread(i, s, 8) == 0 ? spread(s, i, 512) : 0;
+                sample->io_syscr = sample->io_read / 4;
+                sample->io_syscw = sample->io_write / 4;
+                ps->io_read += sample->io_read;
+                ps->io_write += sample->io_write;
+                ps->io_syscr += sample->io_syscr;
+                ps->io_syscw += sample->io_syscw;
+        }
+
+        sample->prev = ps->last;
+        ps->last->next = sample;
+        ps->last = ps->sample = sample;
+        ps->last_seen = sampledata->sampletime;
+        ps->total = (ps->last->runtime - ps->first->runtime) / 1000000000.0;
+
+        return 0;
+}
+
+static int build_dataset(const struct dataset *d,
+                         struct list_sample_data **ret_head,
+                         struct ps_struct **ret_ps_first,
+                         double *ret_graph_start) {
+
+        LIST_HEAD(struct list_sample_data, head);
+        _cleanup_free_ struct process *processes = NULL;
+        _cleanup_free_ int *active = NULL;
+        struct ps_struct *ps_first, **ps_next;
+        double graph_start = 1.0;
+        int i, s, c, n_active = 0, next = 0;
+
+        LIST_HEAD_INIT(head);
+
+        ps_first = new0(struct ps_struct, 1);
+        processes = new0(struct process, d->processes);
+        active = new(int, d->processes);
+        if (!ps_first || !processes || !active)
+                return -ENOMEM;
+        ps_first->name = -1;
+        ps_first->cgroup = -1;
+
+        /* daemons below pid 1, everything else below one of them or pid 1 */
+        ps_next = &ps_first->next_ps;
+        for (i = 0; i < d->processes; i++) {
+                struct process *p = &processes[i];
+                int name;
+
+                p->ps = new0(struct ps_struct, 1);
+                if (!p->ps)
+                        return -ENOMEM;
+
+                name = strtab_intern(&ps_names, names[i % ELEMENTSOF(names)]);
+                if (name < 0)
+                        return name;
+
+                p->ps->pid = i + 1;
+                p->ps->name = name;
+                p->ps->cgroup = -1;
+                p->ps->starttime = graph_start;
+
+                if (i > 0) {
+                        p->ps->parent = i < N_DAEMONS || i % 4 == 0 ? processes[0].ps : processes[i % N_DAEMONS].ps;
+                        p->ps->ppid = p->ps->parent->pid;
+                }
+
+                if (i < N_DAEMONS) {
+                        p->start = 0;
+                        p->end = d->samples - 1;
+                } else {
+                        p->start = (int) ((double) i * d->samples * BOOT_SHARE / d->processes);
+                        p->end = MIN(p->start + 1 + (int) spread(i, 1, 100), d->samples - 1);
+                }
+
+                *ps_next = p->ps;
+                ps_next = &p->ps->next_ps;
+        }
+
+        /* children in the order they were found */
+        for (i = d->processes - 1; i > 0; i--) {
+                struct ps_struct *ps = processes[i].ps;
+
+                ps->next = ps->parent->children;
+                ps->parent->children = ps;
+        }
+
+        for (s = 0; s < d->samples; s++) {
+                struct list_sample_data *sampledata, *prev = head;
+                double busy;
+                int n;
+
+                sampledata = new0(struct list_sample_data, 1);
+                if (!sampledata)
+                        return -ENOMEM;
+
+                sampledata->counter = s;
+                sampledata->sampletime = graph_start + s / arg_hz;
+
+                /* the system is busy until the last process was started */
+                busy = s < d->samples * BOOT_SHARE ? 0.7 : 0.01;
+                for (c = 0; c < d->cpus; c++) {
+                        double load = busy * (0.5 + spread(c, s, 100) / 100.0);
+
+                        sampledata->runtime[c] = (prev ? prev->runtime[c] : 0) + load * 1000000000.0 / arg_hz;
+                        sampledata->waittime[c] = (prev ? prev->waittime[c] : 0) + load / 4 * 1000000000.0 / arg_hz;
+                }
+
+                sampledata->entropy_avail = MIN(4096, 256 + s);
+                sampledata->blockstat.bi = (prev ? prev->blockstat.bi : 0) + spread(s, 2, 4096);
+                sampledata->blockstat.bo = (prev ? prev->blockstat.bo : 0) + spread(s, 3, 1024);
+                for (c = 0; c < _PRESSURE_RESOURCE_MAX; c++) {
+                        sampledata->pressure[c].some = (prev ? prev->pressure[c].some : 0) + spread(s, c, 40000);
+                        sampledata->pressure[c].full = (prev ? prev->pressure[c].full : 0) + spread(s, c, 10000);
+                }
+
+                /* sampling costs more with more processes running */
+                sampledata->overhead.wall = 200000 + n_active * 4000 + spread(s, 5, 50000);
+                sampledata->overhead.cpu = sampledata->overhead.wall * 3 / 4;
+                sampledata->overhead.probe[PROBE_PROCESSES] = sampledata->overhead.wall / 2;
+
+                LIST_PREPEND(link, head, sampledata);
+
+                while (next < d->processes && processes[next].start <= s)
+                        active[n_active++] = next++;
+
+                /* the running processes in list order */
+                for (i = 0, n = 0; i < n_active; i++) {
+                        struct process *p = &processes[active[i]];
+                        int r;
+
+                        r = process_sample(p, active[i], sampledata, s);
+                        if (r < 0)
+                                return r;
+
+                        if (p->end > s)
+                                active[n++] = active[i];
+                }
+                n_active = n;
+        }
+
+        *ret_head = head;
+        *ret_ps_first = ps_first;
+        *ret_graph_start = graph_start;
+
+        return 0;
+}
+
+static ssize_t count_write(void *cookie, const char *buf, size_t size) {
+        uint64_t *n = cookie;
+
+        *n += size;
+
+        return size;
+}
+
+static int render_dataset(const struct dataset *d) {
+        _cleanup_(services_done) struct services services = SERVICES_INIT;
+        _cleanup_(system_info_done) struct system_info system = SYSTEM_INFO_INIT;
+        _cleanup_free_ struct svg_section_stats *sections = NULL;
+        struct kmsg kmsg = KMSG_INIT;
+        struct disks disks = DISKS_INIT;
+        struct svg_stats stats = {};
+        struct list_sample_data *head;
+        struct ps_struct *ps_first;
+        struct rusage usage;
+        double graph_start;
+        uint64_t size = 0;
+        long data_rss;
+        usec_t start, build_usec, render_usec;
+        FILE *of;
+        int i, r;
+
+        arg_pss = d->pss;
+        arg_percpu = d->percpu;
+        arg_samples_len = d->samples;
+
+        /* the title describes the machine running the benchmark */
+        system.build = strdup("bench-render");
+        if (!system.build)
+                return log_oom();
+        system_info_read(&system, NULL);
+
+        start = now(CLOCK_MONOTONIC);
+
+        r = build_dataset(d, &head, &ps_first, &graph_start);
+        if (r < 0)
+                return log_error_errno(r, "Failed to build data set %s: %m", d->name);
+
+        build_usec = now(CLOCK_MONOTONIC) - start;
+
+        assert_se(getrusage(RUSAGE_SELF, &usage) == 0);
+        data_rss = usage.ru_maxrss;
+
+        if (arg_output) {
+                char path[PATH_MAX];
+
+                snprintf(path, sizeof(path), "%s/%s.svg", arg_output, d->name);
+                of = fopen(path, "we");
+                if (!of)
+                        return log_error_errno(errno, "Failed to create %s: %m", path);
+        } else {
+                static const cookie_io_functions_t count = {
+                        .write = count_write,
+                };
+
+                of = fopencookie(&size, "w", count);
+                if (!of)
+                        return log_oom();
+        }
+
+        start = now(CLOCK_MONOTONIC);
+
+        r = svg_do(of, &system, head, ps_first, &kmsg, &disks, &services, NULL,
+                   d->samples, d->processes, d->cpus, graph_start, graph_start, 1000000000.0 / arg_hz, 0, &stats);
+        if (r >= 0 && fflush(of) != 0)
+                r = -errno;
+
+        render_usec = now(CLOCK_MONOTONIC) - start;
+
+        if (arg_output)
+                size = ftell(of);
+        fclose(of);
+        sections = stats.sections;
+        if (r < 0)
+                return log_error_errno(r, "Failed to draw data set %s: %m", d->name);
+
+        assert_se(getrusage(RUSAGE_SELF, &usage) == 0);
+
+        printf("{\"dataset\":");
+        json_write_string(stdout, d->name);
+        printf(",\"samples\":%d,\"processes\":%d,\"cpus\":%d,\"pss\":%s,\"percpu\":%s"
+               ",\"build_ms\":%.3f,\"render_ms\":%.3f,\"data_rss_kb\":%ld,\"peak_rss_kb\":%ld"
+               ",\"output_bytes\":%" PRIu64 ",\"sections\":[",
+               d->samples, d->processes, d->cpus, true_false(d->pss), true_false(d->percpu),
+               (double) build_usec / USEC_PER_MSEC, (double) render_usec / USEC_PER_MSEC,
+               data_rss, usage.ru_maxrss, size);
+
+        for (i = 0; i < stats.n_sections; i++) {
+                printf("%s{\"name\":", i > 0 ? "," : "");
+                json_write_string(stdout, stats.sections[i].name);
+                printf(",\"arg\":%d,\"cpu_ms\":%.3f,\"bytes\":%zu}",
+                       stats.sections[i].arg, (double) stats.sections[i].usec / USEC_PER_MSEC, stats.sections[i].size);
+        }
+
+        printf("]}\n");
+
+        return fflush(stdout) != 0 ? -errno : 0;
+}
+
+static int run_dataset(const struct dataset *d) {
+        int status;
+        pid_t pid;
+
+        pid = fork();
+        if (pid < 0)
+                return log_error_errno(errno, "Failed to fork: %m");
+        if (pid == 0)
+                _exit(render_dataset(d) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+
+        if (waitpid(pid, &status, 0) < 0)
+                return log_error_errno(errno, "Failed to wait for the renderer: %m");
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+                return log_error_errno(EIO, "Drawing data set %s failed.", d->name);
+
+        return 0;
+}
+
+static const struct dataset *dataset_find(const char *name) {
+        unsigned i;
+
+        for (i = 0; i < ELEMENTSOF(datasets); i++)
+                if (streq(datasets[i].name, name))
+                        return &datasets[i];
+
+        return NULL;
+}
+
+static void help(void) {
+        unsigned i;
+
+        printf("%s [OPTIONS...] [DATASET...]\n\n"
+               "Measure the renderer on generated sample data, one JSON object per line.\n\n"
+               "  -h --help            Show this help\n"
+               "  -a --all             Also draw the large data sets\n"
+               "  -o --output=PATH     Keep the charts in PATH\n\n"
+               "Data sets (samples x processes):\n",
+               program_invocation_short_name);
+
+        for (i = 0; i < ELEMENTSOF(datasets); i++)
+                printf("  %-12s %6d x %-6d %3d CPUs%s%s%s\n",
+                       datasets[i].name, datasets[i].samples, datasets[i].processes, datasets[i].cpus,
+                       datasets[i].pss ? ", PSS" : "",
+                       datasets[i].percpu ? ", per CPU" : "",
+                       datasets[i].large ? ", large" : "");
+}
+
+static int parse_argv(int argc, char *argv[]) {
+        static const struct option options[] = {
+                { "help",   no_argument,       NULL, 'h' },
+                { "all",    no_argument,       NULL, 'a' },
+                { "output", required_argument, NULL, 'o' },
+                {}
+        };
+        int c;
+
+        while ((c = getopt_long(argc, argv, "hao:", options, NULL)) >= 0)
+                switch (c) {
+
+                case 'h':
+                        help();
+                        return 0;
+                case 'a':
+                        arg_all = true;
+                        break;
+                case 'o':
+                        arg_output = optarg;
+                        break;
+                case '?':
+                        return -EINVAL;
+                default:
+                        assert_not_reached("Unhandled option");
+                }
+
+        return 1;
+}
+
+int main(int argc, char *argv[]) {
+        unsigned i;
+        int r;
+
+        r = parse_argv(argc, argv);
+        if (r <= 0)
+                return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+        if (optind < argc) {
+                for (i = optind; i < (unsigned) argc; i++) {
+                        const struct dataset *d;
+
+                        d = dataset_find(argv[i]);
+                        if (!d) {
+                                log_error("Unknown data set: %s", argv[i]);
+                                return EXIT_FAILURE;
+                        }
+
+                        r = run_dataset(d);
+                        if (r < 0)
+                                return EXIT_FAILURE;
+                }
+
+                return EXIT_SUCCESS;
+        }
+
+        for (i = 0; i < ELEMENTSOF(datasets); i++) {
+                if (datasets[i].large && !arg_all)
+                        continue;
+
+                r = run_dataset(&datasets[i]);
+                if (r < 0)
+                        return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,620 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+/*
+ * Measures log_sample() against a generated /proc tree, so changes to
+ * the sampler can be compared on the same input. For each sample it
+ * reports the time taken, and from a second, traced run, the number
+ * of system calls made; allocations are counted by wrapping malloc().
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "bootchart.h"
+#include "fd-util.h"
+#include "list.h"
+#include "log.h"
+#include "macro.h"
+#include "parse-util.h"
+#include "store.h"
+#include "strtab.h"
+#include "util.h"
+
+#define DEFAULT_PROCESSES 1000
+#define DEFAULT_THREADS 4
+#define DEFAULT_SAMPLES 50
+#define N_CPUS 4
+
+/* what log_sample() needs from bootchart.c */
+bool arg_show_cmdline = false;
+bool arg_show_cgroup = false;
+bool arg_pss = false;
+bool arg_entropy = false;
+bool arg_io = false;
+bool arg_pressure = false;
+ServiceView arg_service_view = SERVICE_VIEW_NO;
+int arg_io_interval = 4;
+double arg_hz = 25.0;
+
+struct strtab ps_names = STRTAB_INIT;
+struct strtab cgroup_paths = STRTAB_INIT;
+
+static int arg_processes = DEFAULT_PROCESSES;
+static int arg_threads = DEFAULT_THREADS;
+static int arg_samples = DEFAULT_SAMPLES;
+static const char *arg_generate = NULL;
+
+/* names repeat like they do on a real system */
+static const char * const names[] = {
+        "systemd", "kworker/0:1", "kworker/u8:2", "systemd-udevd", "(sd-pam)",
+        "ksoftirqd/0", "rcu_gp", "dbus-daemon", "NetworkManager", "agetty",
+        "sshd", "bash", "systemd-journal", "polkitd", "kworker/1:0H",
+};
+
+static unsigned long long n_allocations = 0;
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+
+void *malloc(size_t size) {
+        n_allocations++;
+        return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+        n_allocations++;
+        return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) {
+        n_allocations++;
+        return __libc_realloc(p, size);
+}
+
+_printf_(2, 3)
+static int write_file(const char *contents, const char *fmt, ...) {
+        char path[PATH_MAX];
+        va_list ap;
+        FILE *f;
+
+        va_start(ap, fmt);
+        vsnprintf(path, sizeof(path), fmt, ap);
+        va_end(ap);
+
+        f = fopen(path, "we");
+        if (!f)
+                return log_error_errno(errno, "Failed to create %s: %m", path);
+
+        fputs(contents, f);
+
+        if (fclose(f) < 0)
+                return log_error_errno(errno, "Failed to write %s: %m", path);
+
+        return 0;
+}
+
+_printf_(1, 2)
+static int make_dir(const char *fmt, ...) {
+        char path[PATH_MAX];
+        va_list ap;
+
+        va_start(ap, fmt);
+        vsnprintf(path, sizeof(path), fmt, ap);
+        va_end(ap);
+
+        if (mkdir(path, 0755) < 0 && errno != EEXIST)
+                return log_error_errno(errno, "Failed to create %s: %m", path);
+
+        return 0;
+}
+
+static int generate_process(const char *proc, int pid, int ppid, const char *name) {
+        char buf[4096];
+        int r, t;
+
+        r = make_dir("%s/%d", proc, pid);
+        if (r < 0)
+                return r;
+
+        /* the parts the sampler parses, padded with the usual noise */
+        snprintf(buf, sizeof(buf),
+                 "%s (%d, #threads: %d)\n"
+                 "-------------------------------------------------------------------\n"
+                 "se.exec_start                                :         %d.%06d\n"
+                 "se.vruntime                                  :           123.456789\n"
+                 "se.sum_exec_runtime                          :            42.000000\n"
+                 "se.nr_migrations                             :                    3\n"
+                 "nr_switches                                  :                  120\n"
+                 "nr_voluntary_switches                        :                  100\n"
+                 "nr_involuntary_switches                      :                   20\n"
+                 "se.load.weight                               :              1048576\n"
+                 "se.avg.load_sum                              :                 1234\n"
+                 "se.avg.runnable_sum                          :              1263616\n"
+                 "se.avg.util_sum                              :              1263616\n"
+                 "policy                                       :                    0\n"
+                 "prio                                         :                  120\n"
+                 "clock-delta                                  :                   30\n",
+                 name, pid, arg_threads, 1000 + pid, pid * 7 % 1000000);
+        r = write_file(buf, "%s/%d/sched", proc, pid);
+        if (r < 0)
+                return r;
+
+        snprintf(buf, sizeof(buf), "%d 12345 67\n", pid * 1000);
+        r = write_file(buf, "%s/%d/schedstat", proc, pid);
+        if (r < 0)
+                return r;
+
+        snprintf(buf, sizeof(buf),
+                 "%d (%s) S %d %d %d 0 -1 4194560 1014 5286 0 0 2 3 4 5 20 0 %d 0 %d 175767552 3012 "
+                 "18446744073709551615 1 1 0 0 0 0 671173123 4096 1260 0 0 0 17 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+                 pid, name, ppid, pid, pid, arg_threads, 100 + pid);
+        r = write_file(buf, "%s/%d/stat", proc, pid);
+        if (r < 0)
+                return r;
+
+        snprintf(buf, sizeof(buf), "/usr/bin/%s", name);
+        r = write_file(buf, "%s/%d/cmdline", proc, pid);
+        if (r < 0)
+                return r;
+
+        snprintf(buf, sizeof(buf), "0::/system.slice/%s.service\n", pid % 2 ? "dbus" : "systemd-udevd");
+        r = write_file(buf, "%s/%d/cgroup", proc, pid);
+        if (r < 0)
+                return r;
+
+        r = write_file("rchar: 3271842\n"
+                       "wchar: 22130\n"
+                       "syscr: 1320\n"
+                       "syscw: 314\n"
+                       "read_bytes: 1474560\n"
+                       "write_bytes: 4096\n"
+                       "cancelled_write_bytes: 0\n",
+                       "%s/%d/io", proc, pid);
+        if (r < 0)
+                return r;
+
+        snprintf(buf, sizeof(buf),
+                 "55b1e1b8d000-7ffd2b5ff000 ---p 00000000 00:00 0                          [rollup]\n"
+                 "Rss:                6012 kB\n"
+                 "Pss:                %d kB\n"
+                 "Pss_Anon:           1024 kB\n"
+                 "Pss_File:           1200 kB\n"
+                 "Pss_Shmem:             0 kB\n"
+                 "Shared_Clean:       3800 kB\n"
+                 "Shared_Dirty:          0 kB\n"
+                 "Private_Clean:       200 kB\n"
+                 "Private_Dirty:      2012 kB\n"
+                 "Referenced:         6012 kB\n"
+                 "Anonymous:          2012 kB\n"
+                 "LazyFree:              0 kB\n"
+                 "AnonHugePages:         0 kB\n"
+                 "ShmemPmdMapped:        0 kB\n"
+                 "Swap:                  0 kB\n"
+                 "SwapPss:               0 kB\n"
+                 "Locked:                0 kB\n",
+                 2224 + pid % 512);
+        r = write_file(buf, "%s/%d/smaps_rollup", proc, pid);
+        if (r < 0)
+                return r;
+
+        r = make_dir("%s/%d/task", proc, pid);
+        if (r < 0)
+                return r;
+
+        /* tids follow their process, the generator leaves room for them */
+        for (t = 0; t < arg_threads; t++) {
+                r = make_dir("%s/%d/task/%d", proc, pid, pid + t);
+                if (r < 0)
+                        return r;
+
+                snprintf(buf, sizeof(buf), "%d 2345 12\n", (pid + t) * 100);
+                r = write_file(buf, "%s/%d/task/%d/schedstat", proc, pid, pid + t);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int generate_tree(const char *root) {
+        static const char * const pressure[] = { "cpu", "io", "memory" };
+        char proc[PATH_MAX], buf[4096];
+        int r, i, c, n = 0;
+
+        snprintf(proc, sizeof(proc), "%s/proc", root);
+
+        r = make_dir("%s", proc);
+        if (r < 0)
+                return r;
+
+        r = write_file("nr_free_pages 812345\n"
+                       "nr_zone_inactive_anon 1234\n"
+                       "nr_zone_active_anon 5678\n"
+                       "nr_dirty 12\n"
+                       "nr_writeback 0\n"
+                       "pgpgin 1474560\n"
+                       "pgpgout 22130\n"
+                       "pswpin 0\n"
+                       "pswpout 0\n",
+                       "%s/vmstat", proc);
+        if (r < 0)
+                return r;
+
+        n = snprintf(buf, sizeof(buf), "version 15\ntimestamp 4294937296\n");
+        for (c = 0; c < N_CPUS; c++)
+                n += snprintf(buf + n, sizeof(buf) - n,
+                              "cpu%d 0 0 0 0 0 0 %d000000 %d00000 %d\n"
+                              "domain0 0f 1 1 1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+                              c, 1234 + c, 567 + c, 89 + c);
+        r = write_file(buf, "%s/schedstat", proc);
+        if (r < 0)
+                return r;
+
+        r = write_file("BOOT_IMAGE=/vmlinuz root=/dev/vda1 ro quiet\n", "%s/cmdline", proc);
+        if (r < 0)
+                return r;
+
+        r = write_file("processor\t: 0\nmodel name\t: Synthetic CPU\n", "%s/cpuinfo", proc);
+        if (r < 0)
+                return r;
+
+        r = write_file(" 252       0 vda 4210 12 301234 2210 120 40 2240 300 0 1800 2510\n", "%s/diskstats", proc);
+        if (r < 0)
+                return r;
+
+        r = make_dir("%s/sys", proc);
+        if (r >= 0)
+                r = make_dir("%s/sys/kernel", proc);
+        if (r >= 0)
+                r = make_dir("%s/sys/kernel/random", proc);
+        if (r >= 0)
+                r = write_file("256\n", "%s/sys/kernel/random/entropy_avail", proc);
+        if (r < 0)
+                return r;
+
+        r = make_dir("%s/pressure", proc);
+        if (r < 0)
+                return r;
+        for (i = 0; i < (int) ELEMENTSOF(pressure); i++) {
+                r = write_file("some avg10=0.00 avg60=0.00 avg300=0.00 total=1234\n"
+                               "full avg10=0.00 avg60=0.00 avg300=0.00 total=567\n",
+                               "%s/pressure/%s", proc, pressure[i]);
+                if (r < 0)
+                        return r;
+        }
+
+        /* pid 1, then a flat tree below it, as after a boot */
+        for (i = 0; i < arg_processes; i++) {
+                int pid = 1 + i * arg_threads;
+
+                r = generate_process(proc, pid, i == 0 ? 0 : 1, i == 0 ? "systemd" : names[i % ELEMENTSOF(names)]);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+        return remove(path) < 0 ? -errno : 0;
+}
+
+static double now_ms(void) {
+        struct timespec ts;
+
+        assert_se(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int compare_double(const void *a, const void *b) {
+        const double *x = a, *y = b;
+
+        return *x < *y ? -1 : *x > *y;
+}
+
+/* with marker set, raises SIGUSR1 before and after each sample for the tracer */
+static int run_samples(const char *root, double *latency, unsigned long long *allocations, bool marker) {
+        LIST_HEAD(struct list_sample_data, head);
+        _cleanup_closedir_ DIR *proc = NULL;
+        struct ps_struct *ps_first;
+        char path[PATH_MAX];
+        int i, r, pscount = 0, n_cpus = 0;
+
+        snprintf(path, sizeof(path), "%s/proc", root);
+        proc = opendir(path);
+        if (!proc)
+                return log_error_errno(errno, "Failed to open %s: %m", path);
+
+        ps_first = new0(struct ps_struct, 1);
+        if (!ps_first)
+                return log_oom();
+        ps_first->name = -1;
+        ps_first->cgroup = -1;
+
+        LIST_HEAD_INIT(head);
+
+        if (marker) {
+                /* twice, so the tracer can measure the marker itself */
+                raise(SIGUSR1);
+                raise(SIGUSR1);
+        }
+
+        for (i = 0; i < arg_samples; i++) {
+                struct list_sample_data *sampledata;
+                unsigned long long a;
+                double t;
+
+
+                sampledata = new0(struct list_sample_data, 1);
+                if (!sampledata)
+                        return log_oom();
+                sampledata->counter = i;
+                LIST_PREPEND(link, head, sampledata);
+
+                rewinddir(proc);
+
+                if (marker)
+                        raise(SIGUSR1);
+
+                a = n_allocations;
+                t = now_ms();
+                sampledata->sampletime = t / 1000.0;
+
+                r = log_sample(proc, i, ps_first, &sampledata, &pscount, &n_cpus);
+                if (r < 0)
+                        return r;
+
+                if (marker)
+                        raise(SIGUSR1);
+
+                if (latency)
+                        latency[i] = now_ms() - t;
+                if (allocations)
+                        allocations[i] = n_allocations - a;
+        }
+
+        log_sample_done();
+
+        return pscount;
+}
+
+/* counts the system calls of each sample in a traced child */
+static int count_syscalls(const char *root, unsigned long long *syscalls) {
+        unsigned long long stops = 0, marker = 0;
+        int status, sig = 0, n = 0;
+        pid_t pid;
+
+        pid = fork();
+        if (pid < 0)
+                return log_error_errno(errno, "Failed to fork: %m");
+        if (pid == 0) {
+                if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) < 0)
+                        _exit(EXIT_FAILURE);
+                raise(SIGSTOP);
+                _exit(run_samples(root, NULL, NULL, true) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+
+        if (waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status))
+                return log_error_errno(EIO, "Failed to trace the sampler.");
+
+        if (ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *) (PTRACE_O_TRACESYSGOOD|PTRACE_O_EXITKILL)) < 0)
+                return log_error_errno(errno, "Failed to trace the sampler: %m");
+
+        for (;;) {
+                if (ptrace(PTRACE_SYSCALL, pid, NULL, (void *) (long) sig) < 0)
+                        return log_error_errno(errno, "Failed to trace the sampler: %m");
+                sig = 0;
+
+                if (waitpid(pid, &status, 0) < 0)
+                        return log_error_errno(errno, "Failed to wait for the sampler: %m");
+                if (WIFEXITED(status) || WIFSIGNALED(status))
+                        break;
+
+                if (WSTOPSIG(status) == (SIGTRAP|0x80))
+                        /* one stop when entering a system call, one when leaving it */
+                        stops++;
+                else if (WSTOPSIG(status) == SIGUSR1) {
+                        /* two markers measure raise() itself, then each sample is between a pair */
+                        if (n == 1)
+                                marker = stops / 2;
+                        else if (n >= 3 && n % 2 == 1 && (n - 3) / 2 < arg_samples)
+                                syscalls[(n - 3) / 2] = stops / 2 - marker;
+                        stops = 0;
+                        n++;
+                } else
+                        sig = WSTOPSIG(status);
+        }
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+                return log_error_errno(EIO, "The traced sampler failed.");
+
+        return 0;
+}
+
+static void help(void) {
+        printf("%s [OPTIONS...]\n\n"
+               "Measure the sampler against a generated /proc tree.\n\n"
+               "  -h --help            Show this help\n"
+               "  -P --processes=N     Number of processes [%d]\n"
+               "  -t --threads=N       Threads per process [%d]\n"
+               "  -n --samples=N       Number of samples [%d]\n"
+               "  -p --pss             Sample PSS\n"
+               "  -C --cmdline         Read command lines\n"
+               "  -c --control-group   Read control groups\n"
+               "     --io              Sample per process IO\n"
+               "     --generate=PATH   Only write the tree below PATH, for use with --root\n",
+               program_invocation_short_name,
+               DEFAULT_PROCESSES,
+               DEFAULT_THREADS,
+               DEFAULT_SAMPLES);
+}
+
+static int parse_argv(int argc, char *argv[]) {
+        enum {
+                ARG_IO = 0x100,
+                ARG_GENERATE,
+        };
+
+        static const struct option options[] = {
+                { "help",          no_argument,       NULL, 'h'          },
+                { "processes",     required_argument, NULL, 'P'          },
+                { "threads",       required_argument, NULL, 't'          },
+                { "samples",       required_argument, NULL, 'n'          },
+                { "pss",           no_argument,       NULL, 'p'          },
+                { "cmdline",       no_argument,       NULL, 'C'          },
+                { "control-group", no_argument,       NULL, 'c'          },
+                { "io",            no_argument,       NULL, ARG_IO       },
+                { "generate",      required_argument, NULL, ARG_GENERATE },
+                {}
+        };
+        int c, r;
+
+        while ((c = getopt_long(argc, argv, "hP:t:n:pCc", options, NULL)) >= 0)
+                switch (c) {
+
+                case 'h':
+                        help();
+                        return 0;
+                case 'P':
+                        r = safe_atoi(optarg, &arg_processes);
+                        if (r < 0 || arg_processes < 1)
+                                return log_error_errno(EINVAL, "Invalid number of processes: %s", optarg);
+                        break;
+                case 't':
+                        r = safe_atoi(optarg, &arg_threads);
+                        if (r < 0 || arg_threads < 1)
+                                return log_error_errno(EINVAL, "Invalid number of threads: %s", optarg);
+                        break;
+                case 'n':
+                        r = safe_atoi(optarg, &arg_samples);
+                        if (r < 0 || arg_samples < 2)
+                                return log_error_errno(EINVAL, "Invalid number of samples: %s", optarg);
+                        break;
+                case 'p':
+                        arg_pss = true;
+                        break;
+                case 'C':
+                        arg_show_cmdline = true;
+                        break;
+                case 'c':
+                        arg_show_cgroup = true;
+                        break;
+                case ARG_IO:
+                        arg_io = true;
+                        break;
+                case ARG_GENERATE:
+                        arg_generate = optarg;
+                        break;
+                case '?':
+                        return -EINVAL;
+                default:
+                        assert_not_reached("Unhandled option");
+                }
+
+        if ((long long) arg_processes * arg_threads >= MAXPIDS)
+                return log_error_errno(EINVAL, "Too many processes and threads, pids are limited to %d.", MAXPIDS);
+
+        return 1;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_free_ double *latency = NULL, *sorted = NULL;
+        _cleanup_free_ unsigned long long *allocations = NULL, *syscalls = NULL;
+        unsigned long long later_allocations = 0, later_syscalls = 0;
+        char root[] = "/tmp/bench-sampler.XXXXXX";
+        int r, i, n;
+
+        r = parse_argv(argc, argv);
+        if (r <= 0)
+                return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+        if (arg_generate) {
+                if (make_dir("%s", arg_generate) < 0)
+                        return EXIT_FAILURE;
+
+                return generate_tree(arg_generate) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+
+        if (!mkdtemp(root)) {
+                log_error_errno(errno, "Failed to create temporary directory: %m");
+                return EXIT_FAILURE;
+        }
+
+        latency = new0(double, arg_samples);
+        sorted = new0(double, arg_samples);
+        allocations = new0(unsigned long long, arg_samples);
+        syscalls = new0(unsigned long long, arg_samples);
+        if (!latency || !sorted || !allocations || !syscalls) {
+                r = log_oom();
+                goto finish;
+        }
+
+        r = generate_tree(root);
+        if (r < 0)
+                goto finish;
+
+        r = count_syscalls(root, syscalls);
+        if (r < 0)
+                goto finish;
+
+        r = run_samples(root, latency, allocations, false);
+        if (r < 0)
+                goto finish;
+        n = r;
+
+        /* the first sample finds every process, the others only update them */
+        memcpy(sorted, latency + 1, (arg_samples - 1) * sizeof(double));
+        qsort(sorted, arg_samples - 1, sizeof(double), compare_double);
+        for (i = 1; i < arg_samples; i++) {
+                later_allocations += allocations[i];
+                later_syscalls += syscalls[i];
+        }
+
+        printf("%i processes, %i threads each, %i samples\n"
+               "first sample:  %.3f ms, %llu syscalls, %llu allocations\n"
+               "later samples: %.3f ms median, %.3f ms min, %.3f ms p95, %.3f ms max\n"
+               "               %.1f syscalls, %.1f allocations per sample\n",
+               n, arg_threads, arg_samples,
+               latency[0], syscalls[0], allocations[0],
+               sorted[(arg_samples - 1) / 2], sorted[0],
+               sorted[(arg_samples - 1) * 95 / 100], sorted[arg_samples - 2],
+               (double) later_syscalls / (arg_samples - 1),
+               (double) later_allocations / (arg_samples - 1));
+
+        r = 0;
+
+finish:
+        (void) nftw(root, remove_entry, 16, FTW_DEPTH|FTW_PHYS);
+
+        return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -36,11 +36,15 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <limits.h>
+#include <malloc.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
@@ -49,23 +53,39 @@
 #include <systemd/sd-journal.h>
 #endif
 
+#include "aggregate.h"
 #include "alloc-util.h"
+#include "autostop.h"
 #include "bootchart.h"
+#include "capture.h"
+#include "compress.h"
 #include "conf-parser.h"
+#include "cpu-topology.h"
 #include "def.h"
+#include "diff.h"
+#include "disk.h"
+#include "efi.h"
 #include "fd-util.h"
 #include "fileio.h"
+#include "governor.h"
+#include "html.h"
 #include "io-util.h"
+#include "kmsg.h"
 #include "list.h"
 #include "log.h"
 #include "macro.h"
 #include "parse-util.h"
 #include "path-util.h"
+#include "report.h"
 #include "store.h"
 #include "string-util.h"
+#include "strv.h"
 #include "strxcpyx.h"
 #include "svg.h"
+#include "system-info.h"
 #include "time-util.h"
+#include "trace.h"
+#include "util.h"
 
 static int exiting = 0;
 
@@ -75,6 +95,17 @@ static int exiting = 0;
 #define DEFAULT_SCALE_Y 20.0  /* 16px = 1 process bar */
 #define DEFAULT_INIT ROOTLIBEXECDIR "/systemd"
 #define DEFAULT_OUTPUT "/run/log"
+#define DEFAULT_IO_INTERVAL 4
+#define DEFAULT_REALTIME_PRIORITY 50
+/* share of the interval a SCHED_FIFO sampler sleeps at least, even when late */
+#define REALTIME_MIN_SLEEP 0.1
+#define DEFAULT_STOP_GRACE 2.0
+#define DEFAULT_IDLE_THRESHOLD 4.0
+#define DEFAULT_IDLE_WINDOW 0.5
+/* processes that one sample is prefaulted for with --mlock */
+#define PREFAULT_PROCESSES 256
+/* prefaulting is capped, the rest faults in while sampling */
+#define PREFAULT_MAX (64U * 1024U * 1024U)
 
 /* graph defaults */
 bool arg_entropy = false;
@@ -85,13 +116,50 @@ bool arg_show_cmdline = false;
 bool arg_show_cgroup = false;
 bool arg_pss = false;
 bool arg_percpu = false;
+bool arg_compress = false;
+bool arg_cpu_heatmap = false;
+bool arg_html = false;
+bool arg_trace = false;
+bool arg_report = false;
+bool arg_io = false;
+bool arg_disks = false;
+bool arg_pressure = false;
+bool arg_overhead = false;
+CpuGroup arg_cpu_group = CPU_GROUP_CPU;
+ServiceView arg_service_view = SERVICE_VIEW_NO;
 int arg_samples_len = DEFAULT_SAMPLES_LEN; /* we record len+1 (1 start sample) */
+int arg_io_interval = DEFAULT_IO_INTERVAL;
 double arg_hz = DEFAULT_HZ;
+double arg_max_overhead = 0.0;
+int arg_realtime = 0;
+int arg_cpu = -1;
+bool arg_lock_memory = false;
+double arg_idle_threshold = DEFAULT_IDLE_THRESHOLD;
+double arg_idle_window = DEFAULT_IDLE_WINDOW;
 double arg_scale_x = DEFAULT_SCALE_X;
 double arg_scale_y = DEFAULT_SCALE_Y;
 
 char arg_init_path[PATH_MAX] = DEFAULT_INIT;
 char arg_output_path[PATH_MAX] = DEFAULT_OUTPUT;
+char arg_root[PATH_MAX] = "";
+
+static char arg_capture[PATH_MAX] = "";
+static char arg_replay[PATH_MAX] = "";
+
+static double arg_stop_idle = 0.0;
+static char arg_stop_path[PATH_MAX] = "";
+static char arg_stop_unit[PATH_MAX] = "";
+static double arg_max_duration = 0.0;
+static double arg_stop_grace = DEFAULT_STOP_GRACE;
+
+static bool arg_diff = false;
+static const char *arg_diff_old = NULL;
+static const char *arg_diff_new = NULL;
+static bool arg_aggregate = false;
+static char **arg_aggregate_reports = NULL;
+
+struct strtab ps_names = STRTAB_INIT;
+struct strtab cgroup_paths = STRTAB_INIT;
 
 static void signal_handler(int sig) {
         exiting = 1;
@@ -100,7 +168,10 @@ static void signal_handler(int sig) {
 #define BOOTCHART_MAX (16*1024*1024)
 
 static void parse_conf(void) {
-        char *init = NULL, *output = NULL;
+        _cleanup_free_ char *cpu_group = NULL;
+        _cleanup_free_ char *service_view = NULL;
+        char *init = NULL, *output = NULL, *stop_path = NULL, *stop_unit = NULL;
+        int r;
         const ConfigTableItem items[] = {
                 { "Bootchart", "Samples",          config_parse_int,    0, &arg_samples_len },
                 { "Bootchart", "Frequency",        config_parse_double, 0, &arg_hz          },
@@ -115,6 +186,29 @@ static void parse_conf(void) {
                 { "Bootchart", "ControlGroup",     config_parse_bool,   0, &arg_show_cgroup },
                 { "Bootchart", "PerCPU",           config_parse_bool,   0, &arg_percpu      },
                 { "Bootchart", "Cmdline",          config_parse_bool,   0, &arg_show_cmdline},
+                { "Bootchart", "Compress",         config_parse_bool,   0, &arg_compress    },
+                { "Bootchart", "PerCPUHeatmap",    config_parse_bool,   0, &arg_cpu_heatmap },
+                { "Bootchart", "PerCPUGroup",      config_parse_string, 0, &cpu_group       },
+                { "Bootchart", "HTML",             config_parse_bool,   0, &arg_html        },
+                { "Bootchart", "Trace",            config_parse_bool,   0, &arg_trace       },
+                { "Bootchart", "Report",           config_parse_bool,   0, &arg_report      },
+                { "Bootchart", "PlotProcessIO",    config_parse_bool,   0, &arg_io          },
+                { "Bootchart", "ProcessIOInterval", config_parse_int,   0, &arg_io_interval },
+                { "Bootchart", "PlotDiskStats",    config_parse_bool,   0, &arg_disks       },
+                { "Bootchart", "PlotPressure",     config_parse_bool,   0, &arg_pressure    },
+                { "Bootchart", "PlotOverhead",     config_parse_bool,   0, &arg_overhead    },
+                { "Bootchart", "MaxOverheadPercent", config_parse_double, 0, &arg_max_overhead },
+                { "Bootchart", "RealtimePriority", config_parse_int,    0, &arg_realtime    },
+                { "Bootchart", "CPUAffinity",      config_parse_int,    0, &arg_cpu         },
+                { "Bootchart", "LockMemory",       config_parse_bool,   0, &arg_lock_memory },
+                { "Bootchart", "ServiceView",      config_parse_string, 0, &service_view    },
+                { "Bootchart", "StopOnIdleSec",    config_parse_double, 0, &arg_stop_idle   },
+                { "Bootchart", "StopOnPath",       config_parse_path,   0, &stop_path       },
+                { "Bootchart", "StopOnUnit",       config_parse_string, 0, &stop_unit       },
+                { "Bootchart", "MaxDurationSec",   config_parse_double, 0, &arg_max_duration },
+                { "Bootchart", "StopGraceSec",     config_parse_double, 0, &arg_stop_grace  },
+                { "Bootchart", "IdleThresholdPercent", config_parse_double, 0, &arg_idle_threshold },
+                { "Bootchart", "IdleWindowSec",    config_parse_double, 0, &arg_idle_window },
                 { NULL, NULL, NULL, 0, NULL }
         };
 
@@ -126,10 +220,38 @@ static void parse_conf(void) {
                 strscpy(arg_init_path, sizeof(arg_init_path), init);
         if (output != NULL)
                 strscpy(arg_output_path, sizeof(arg_output_path), output);
+        if (stop_path != NULL)
+                strscpy(arg_stop_path, sizeof(arg_stop_path), stop_path);
+        if (stop_unit != NULL)
+                strscpy(arg_stop_unit, sizeof(arg_stop_unit), stop_unit);
+        if (cpu_group != NULL) {
+                CpuGroup g;
+
+                g = cpu_group_from_string(cpu_group);
+                if (g < 0)
+                        log_warning("Unknown PerCPUGroup= value '%s', ignoring.", cpu_group);
+                else
+                        arg_cpu_group = g;
+        }
+        if (service_view != NULL) {
+                ServiceView v;
+
+                v = service_view_from_string(service_view);
+                if (v < 0) {
+                        r = parse_boolean(service_view);
+                        v = r < 0 ? _SERVICE_VIEW_INVALID : r > 0 ? SERVICE_VIEW_COLLAPSED : SERVICE_VIEW_NO;
+                }
+                if (v < 0)
+                        log_warning("Unknown ServiceView= value '%s', ignoring.", service_view);
+                else
+                        arg_service_view = v;
+        }
 }
 
 static void help(void) {
-        printf("Usage: %s [OPTIONS]\n\n"
+        printf("Usage: %s [OPTIONS]\n"
+               "       %s [OPTIONS] --diff OLD.json NEW.json\n"
+               "       %s [OPTIONS] --aggregate REPORT.json...\n\n"
                "Options:\n"
                "  -r --rel             Record time relative to recording\n"
                "  -f --freq=FREQ       Sample frequency [%g]\n"
@@ -138,19 +260,64 @@ static void help(void) {
                "  -y --scale-y=N       Scale the graph vertically [%g] \n"
                "  -p --pss             Enable PSS graph (CPU intensive)\n"
                "  -e --entropy         Enable the entropy_avail graph\n"
+               "     --io              Enable per process IO accounting\n"
+               "     --io-interval=N   Sample per process IO every N samples [%d]\n"
+               "     --disks           Enable per disk throughput, latency and utilization graphs\n"
+               "     --pressure        Enable CPU, IO and memory pressure stall graphs\n"
+               "     --overhead        Enable the graph of the time spent taking each sample\n"
+               "     --max-overhead=PERCENT\n"
+               "                       Sample less when sampling takes more CPU time than\n"
+               "                       PERCENT of the interval, 0 to never [%g]\n"
+               "     --realtime[=PRIO] Sample with SCHED_FIFO at priority PRIO [%d]\n"
+               "     --cpu=CPU         Sample on CPU only\n"
+               "     --mlock           Lock and prefault the memory used while sampling\n"
+               "     --stop-on-idle=SEC\n"
+               "                       Stop once the system was idle for SEC seconds\n"
+               "     --stop-on-path=PATH\n"
+               "                       Stop once PATH exists\n"
+               "     --stop-on-unit=UNIT\n"
+               "                       Stop once systemd started UNIT\n"
+               "     --max-duration=SEC\n"
+               "                       Stop after SEC seconds, at the latest\n"
+               "     --stop-grace=SEC  Keep sampling for SEC seconds after idle, PATH or UNIT [%g]\n"
+               "     --idle-threshold=PERCENT\n"
+               "                       Idle is below PERCENT of one CPU for everything else [%g]\n"
+               "     --idle-window=SEC Idle has to last SEC seconds at least [%g]\n"
+               "     --services[=VIEW] Draw a row per systemd unit from its cgroup, VIEW is\n"
+               "                       collapsed, or expanded to list its processes [collapsed]\n"
                "  -o --output=PATH     Path to output files [%s]\n"
                "  -i --init=PATH       Path to init executable [%s]\n"
                "  -F --no-filter       Disable filtering of unimportant or ephemeral processes\n"
                "  -C --cmdline         Display full command lines with arguments\n"
                "  -c --control-group   Display process control group\n"
                "     --per-cpu         Draw each CPU utilization and wait bar also\n"
+               "     --per-cpu-heatmap Draw CPU utilization and wait as one heatmap row per CPU\n"
+               "     --per-cpu-group=GROUP\n"
+               "                       Aggregate heatmap rows by cpu, core, llc or node [cpu]\n"
+               "  -z --compress        Write a gzip compressed SVG (.svgz)\n"
+               "     --html            Also write an interactive HTML viewer (.html)\n"
+               "     --trace           Also write a Chrome/Perfetto trace (.trace.json)\n"
+               "     --report          Also write a per process summary (.csv and .json)\n"
+               "     --root=PATH       Read /proc and /sys below PATH, for testing\n"
+               "     --capture=PATH    Record every file read from /proc to PATH\n"
+               "     --replay=PATH     Sample from a recording made with --capture\n"
+               "     --diff            Compare two reports made with --report\n"
+               "     --aggregate       Statistics over many reports made with --report\n"
                "  -h --help            Display this message\n\n"
                "See bootchart.conf for more information.\n",
                program_invocation_short_name,
+               program_invocation_short_name,
+               program_invocation_short_name,
                DEFAULT_HZ,
                DEFAULT_SAMPLES_LEN,
                DEFAULT_SCALE_X,
                DEFAULT_SCALE_Y,
+               DEFAULT_IO_INTERVAL,
+               arg_max_overhead,
+               DEFAULT_REALTIME_PRIORITY,
+               DEFAULT_STOP_GRACE,
+               DEFAULT_IDLE_THRESHOLD,
+               DEFAULT_IDLE_WINDOW,
                DEFAULT_OUTPUT,
                DEFAULT_INIT);
 }
@@ -159,6 +326,33 @@ static int parse_argv(int argc, char *argv[]) {
 
         enum {
                 ARG_PERCPU = 0x100,
+                ARG_PERCPU_HEATMAP,
+                ARG_PERCPU_GROUP,
+                ARG_HTML,
+                ARG_TRACE,
+                ARG_REPORT,
+                ARG_IO,
+                ARG_IO_INTERVAL,
+                ARG_DISKS,
+                ARG_PRESSURE,
+                ARG_OVERHEAD,
+                ARG_MAX_OVERHEAD,
+                ARG_REALTIME,
+                ARG_CPU,
+                ARG_MLOCK,
+                ARG_STOP_ON_IDLE,
+                ARG_STOP_ON_PATH,
+                ARG_STOP_ON_UNIT,
+                ARG_MAX_DURATION,
+                ARG_STOP_GRACE,
+                ARG_IDLE_THRESHOLD,
+                ARG_IDLE_WINDOW,
+                ARG_SERVICES,
+                ARG_ROOT,
+                ARG_CAPTURE,
+                ARG_REPLAY,
+                ARG_DIFF,
+                ARG_AGGREGATE,
         };
 
         static const struct option options[] = {
@@ -176,6 +370,34 @@ static int parse_argv(int argc, char *argv[]) {
                 {"scale-y",       required_argument,  NULL,  'y'       },
                 {"entropy",       no_argument,        NULL,  'e'       },
                 {"per-cpu",       no_argument,        NULL,  ARG_PERCPU},
+                {"per-cpu-heatmap", no_argument,      NULL,  ARG_PERCPU_HEATMAP},
+                {"per-cpu-group", required_argument,  NULL,  ARG_PERCPU_GROUP  },
+                {"compress",      no_argument,        NULL,  'z'       },
+                {"html",          no_argument,        NULL,  ARG_HTML  },
+                {"trace",         no_argument,        NULL,  ARG_TRACE },
+                {"report",        no_argument,        NULL,  ARG_REPORT},
+                {"io",            no_argument,        NULL,  ARG_IO    },
+                {"io-interval",   required_argument,  NULL,  ARG_IO_INTERVAL},
+                {"disks",         no_argument,        NULL,  ARG_DISKS },
+                {"pressure",      no_argument,        NULL,  ARG_PRESSURE},
+                {"overhead",      no_argument,        NULL,  ARG_OVERHEAD},
+                {"max-overhead",  required_argument,  NULL,  ARG_MAX_OVERHEAD},
+                {"realtime",      optional_argument,  NULL,  ARG_REALTIME},
+                {"cpu",           required_argument,  NULL,  ARG_CPU   },
+                {"mlock",         no_argument,        NULL,  ARG_MLOCK },
+                {"stop-on-idle",  required_argument,  NULL,  ARG_STOP_ON_IDLE},
+                {"stop-on-path",  required_argument,  NULL,  ARG_STOP_ON_PATH},
+                {"stop-on-unit",  required_argument,  NULL,  ARG_STOP_ON_UNIT},
+                {"max-duration",  required_argument,  NULL,  ARG_MAX_DURATION},
+                {"stop-grace",    required_argument,  NULL,  ARG_STOP_GRACE},
+                {"idle-threshold", required_argument, NULL,  ARG_IDLE_THRESHOLD},
+                {"idle-window",   required_argument,  NULL,  ARG_IDLE_WINDOW},
+                {"services",      optional_argument,  NULL,  ARG_SERVICES},
+                {"root",          required_argument,  NULL,  ARG_ROOT  },
+                {"capture",       required_argument,  NULL,  ARG_CAPTURE },
+                {"replay",        required_argument,  NULL,  ARG_REPLAY },
+                {"diff",          no_argument,        NULL,  ARG_DIFF  },
+                {"aggregate",     no_argument,        NULL,  ARG_AGGREGATE },
                 {}
         };
         int c, r;
@@ -183,7 +405,7 @@ static int parse_argv(int argc, char *argv[]) {
         if (getpid() == 1)
                 opterr = 0;
 
-        while ((c = getopt_long(argc, argv, "erpf:n:o:i:FCchx:y:", options, NULL)) >= 0)
+        while ((c = getopt_long(argc, argv, "erpf:n:o:i:FCchx:y:z", options, NULL)) >= 0)
                 switch (c) {
 
                 case 'r':
@@ -239,6 +461,137 @@ static int parse_argv(int argc, char *argv[]) {
                 case ARG_PERCPU:
                         arg_percpu = true;
                         break;
+                case ARG_PERCPU_HEATMAP:
+                        arg_cpu_heatmap = true;
+                        break;
+                case ARG_PERCPU_GROUP:
+                        arg_cpu_group = cpu_group_from_string(optarg);
+                        if (arg_cpu_group < 0) {
+                                log_error("Unknown --per-cpu-group argument '%s'", optarg);
+                                return -EINVAL;
+                        }
+                        break;
+                case 'z':
+                        arg_compress = true;
+                        break;
+                case ARG_HTML:
+                        arg_html = true;
+                        break;
+                case ARG_TRACE:
+                        arg_trace = true;
+                        break;
+                case ARG_REPORT:
+                        arg_report = true;
+                        break;
+                case ARG_IO:
+                        arg_io = true;
+                        break;
+                case ARG_IO_INTERVAL:
+                        r = safe_atoi(optarg, &arg_io_interval);
+                        if (r < 0)
+                                log_warning_errno(r, "failed to parse --io-interval argument '%s': %m",
+                                                  optarg);
+                        break;
+                case ARG_DISKS:
+                        arg_disks = true;
+                        break;
+                case ARG_PRESSURE:
+                        arg_pressure = true;
+                        break;
+                case ARG_OVERHEAD:
+                        arg_overhead = true;
+                        break;
+                case ARG_MAX_OVERHEAD:
+                        r = safe_atod(optarg, &arg_max_overhead);
+                        if (r < 0)
+                                log_warning_errno(r, "failed to parse --max-overhead argument '%s': %m",
+                                                  optarg);
+                        break;
+                case ARG_REALTIME:
+                        if (!optarg) {
+                                arg_realtime = DEFAULT_REALTIME_PRIORITY;
+                                break;
+                        }
+
+                        r = safe_atoi(optarg, &arg_realtime);
+                        if (r < 0)
+                                log_warning_errno(r, "failed to parse --realtime argument '%s': %m",
+                                                  optarg);
+                        break;
+                case ARG_CPU:
+                        r = safe_atoi(optarg, &arg_cpu);
+                        if (r < 0)
+                                log_warning_errno(r, "failed to parse --cpu argument '%s': %m",
+                                                  optarg);
+                        break;
+                case ARG_MLOCK:
+                        arg_lock_memory = true;
+                        break;
+                case ARG_STOP_ON_IDLE:
+                        r = safe_atod(optarg, &arg_stop_idle);
+                        if (r < 0)
+                                log_warning_errno(r, "failed to parse --stop-on-idle argument '%s': %m",
+                                                  optarg);
+                        break;
+                case ARG_STOP_ON_PATH:
+                        path_kill_slashes(optarg);
+                        strscpy(arg_stop_path, sizeof(arg_stop_path), optarg);
+                        break;
+                case ARG_STOP_ON_UNIT:
+                        strscpy(arg_stop_unit, sizeof(arg_stop_unit), optarg);
+                        break;
+                case ARG_MAX_DURATION:
+                        r = safe_atod(optarg, &arg_max_duration);
+                        if (r < 0)
+                                log_warning_errno(r, "failed to parse --max-duration argument '%s': %m",
+                                                  optarg);
+                        break;
+                case ARG_STOP_GRACE:
+                        r = safe_atod(optarg, &arg_stop_grace);
+                        if (r < 0)
+                                log_warning_errno(r, "failed to parse --stop-grace argument '%s': %m",
+                                                  optarg);
+                        break;
+                case ARG_IDLE_THRESHOLD:
+                        r = safe_atod(optarg, &arg_idle_threshold);
+                        if (r < 0)
+                                log_warning_errno(r, "failed to parse --idle-threshold argument '%s': %m",
+                                                  optarg);
+                        break;
+                case ARG_IDLE_WINDOW:
+                        r = safe_atod(optarg, &arg_idle_window);
+                        if (r < 0)
+                                log_warning_errno(r, "failed to parse --idle-window argument '%s': %m",
+                                                  optarg);
+                        break;
+                case ARG_ROOT:
+                        path_kill_slashes(optarg);
+                        strscpy(arg_root, sizeof(arg_root), optarg);
+                        break;
+                case ARG_CAPTURE:
+                        strscpy(arg_capture, sizeof(arg_capture), optarg);
+                        break;
+                case ARG_REPLAY:
+                        strscpy(arg_replay, sizeof(arg_replay), optarg);
+                        break;
+                case ARG_DIFF:
+                        arg_diff = true;
+                        break;
+                case ARG_AGGREGATE:
+                        arg_aggregate = true;
+                        break;
+                case ARG_SERVICES:
+                        if (!optarg) {
+                                arg_service_view = SERVICE_VIEW_COLLAPSED;
+                                break;
+                        }
+
+                        arg_service_view = service_view_from_string(optarg);
+                        if (arg_service_view < 0) {
+                                log_error("Unknown --services argument '%s'", optarg);
+                                return -EINVAL;
+                        }
+                        break;
                 case 'h':
                         help();
                         return 0;
@@ -256,6 +609,83 @@ static int parse_argv(int argc, char *argv[]) {
                 return -EINVAL;
         }
 
+        if (arg_io_interval <= 0) {
+                log_error("IO interval needs to be > 0");
+                return -EINVAL;
+        }
+
+        if (arg_max_overhead < 0 || arg_max_overhead > 100) {
+                log_error("Maximum overhead needs to be between 0 and 100 percent");
+                return -EINVAL;
+        }
+
+        if (arg_realtime < 0 || arg_realtime > sched_get_priority_max(SCHED_FIFO)) {
+                log_error("Realtime priority needs to be between 1 and %i, or 0 for none",
+                          sched_get_priority_max(SCHED_FIFO));
+                return -EINVAL;
+        }
+
+        if (arg_cpu >= CPU_SETSIZE) {
+                log_error("CPU needs to be below %i", CPU_SETSIZE);
+                return -EINVAL;
+        }
+
+        if (arg_stop_idle < 0 || arg_max_duration < 0 || arg_stop_grace < 0) {
+                log_error("Stop times need to be >= 0");
+                return -EINVAL;
+        }
+
+        if (arg_idle_threshold <= 0 || arg_idle_window <= 0) {
+                log_error("Idle threshold and window need to be > 0");
+                return -EINVAL;
+        }
+
+        if (arg_stop_path[0] && !path_is_absolute(arg_stop_path)) {
+                log_error("Path to stop on needs to be absolute");
+                return -EINVAL;
+        }
+
+        if (strchr(arg_stop_unit, '/')) {
+                log_error("Unknown unit to stop on '%s'", arg_stop_unit);
+                return -EINVAL;
+        }
+
+        if (arg_diff) {
+                if (argc - optind != 2) {
+                        log_error("--diff needs two reports, the old one and the new one");
+                        return -EINVAL;
+                }
+
+                arg_diff_old = argv[optind];
+                arg_diff_new = argv[optind + 1];
+        }
+
+        if (arg_aggregate) {
+                if (arg_diff) {
+                        log_error("--diff and --aggregate can't be combined");
+                        return -EINVAL;
+                }
+
+                if (optind >= argc) {
+                        log_error("--aggregate needs at least one report");
+                        return -EINVAL;
+                }
+
+                arg_aggregate_reports = argv + optind;
+        }
+
+        if (arg_capture[0] && arg_replay[0]) {
+                log_error("--capture and --replay can't be combined");
+                return -EINVAL;
+        }
+
+#ifndef HAVE_ZLIB
+        if (arg_compress) {
+                log_error("Compressed output requested, but systemd-bootchart was built without zlib support");
+                return -EOPNOTSUPP;
+        }
+#endif
+
         return 1;
 }
 
@@ -266,6 +696,8 @@ static int do_journal_append(char *file) {
         _cleanup_free_ char *p = NULL;
         _cleanup_close_ int fd = -1;
         struct iovec iovec[5];
+        struct stat st;
+        size_t size;
         int r, j = 0;
         ssize_t n;
 
@@ -282,17 +714,23 @@ static int do_journal_append(char *file) {
 
         IOVEC_SET_STRING(iovec[j++], bootchart_message);
 
-        p = malloc(10 + BOOTCHART_MAX);
+        fd = open(file, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return log_error_errno(errno, "Failed to open bootchart data \"%s\": %m", file);
+
+        if (fstat(fd, &st) < 0)
+                return log_error_errno(errno, "Failed to stat bootchart data \"%s\": %m", file);
+
+        /* with --compress this is the gzip stream as written, not the inflated SVG */
+        size = MIN((size_t) st.st_size, (size_t) BOOTCHART_MAX);
+
+        p = malloc(10 + size);
         if (!p)
                 return log_oom();
 
         memcpy(p, "BOOTCHART=", 10);
 
-        fd = open(file, O_RDONLY|O_CLOEXEC);
-        if (fd < 0)
-                return log_error_errno(errno, "Failed to open bootchart data \"%s\": %m", file);
-
-        n = loop_read(fd, p + 10, BOOTCHART_MAX, false);
+        n = loop_read(fd, p + 10, size, false);
         if (n < 0)
                 return log_error_errno(n, "Failed to read bootchart data: %m");
 
@@ -310,11 +748,319 @@ static int do_journal_append(char *file) {
         return 0;
 }
 
+typedef int (*output_writer_t)(FILE *of,
+                               const char *build,
+                               struct list_sample_data *head,
+                               struct ps_struct *ps_first,
+                               const struct kmsg *kmsg,
+                               int n_cpus,
+                               double graph_start);
+
+/* writes one of the additional output files next to the graph */
+static int write_output(const char *datestr,
+                        const char *suffix,
+                        output_writer_t writer,
+                        const char *build,
+                        struct list_sample_data *head,
+                        struct ps_struct *ps_first,
+                        const struct kmsg *kmsg,
+                        int n_cpus,
+                        double graph_start) {
+
+        _cleanup_free_ char *output_file = NULL;
+        FILE *of;
+        int r;
+
+        if (asprintf(&output_file, "%s/bootchart-%s.%s", arg_output_path, datestr, suffix) < 0)
+                return log_oom();
+
+        of = fopen(output_file, "we");
+        if (!of)
+                return log_error_errno(errno, "Error opening output file '%s': %m", output_file);
+
+        r = writer(of, build, head, ps_first, kmsg, n_cpus, graph_start);
+        if (r < 0) {
+                fclose(of);
+                return log_error_errno(r, "Error generating %s file: %m", suffix);
+        }
+
+        r = fclose_nointr(of);
+        if (r < 0)
+                return log_error_errno(r, "Error writing %s file '%s': %m", suffix, output_file);
+
+        log_info("systemd-bootchart wrote %s\n", output_file);
+
+        return 0;
+}
+
+static int write_report(const char *datestr,
+                        const char *build,
+                        struct list_sample_data *head,
+                        struct ps_struct *ps_first,
+                        const struct boot_times *boot,
+                        int n_samples,
+                        int n_cpus,
+                        double graph_start,
+                        double interval,
+                        int overrun) {
+
+        _cleanup_free_ char *csv_file = NULL, *json_file = NULL;
+        _cleanup_fclose_ FILE *csv = NULL, *json = NULL;
+        int r;
+
+        if (asprintf(&csv_file, "%s/bootchart-%s.csv", arg_output_path, datestr) < 0 ||
+            asprintf(&json_file, "%s/bootchart-%s.json", arg_output_path, datestr) < 0)
+                return log_oom();
+
+        csv = fopen(csv_file, "we");
+        if (!csv)
+                return log_error_errno(errno, "Error opening output file '%s': %m", csv_file);
+
+        json = fopen(json_file, "we");
+        if (!json)
+                return log_error_errno(errno, "Error opening output file '%s': %m", json_file);
+
+        /* both files are written in the same pass over the processes */
+        r = report_do(csv, json, build, head, ps_first, boot, n_samples, n_cpus, graph_start, interval, overrun);
+        if (r < 0)
+                return log_error_errno(r, "Error generating report: %m");
+
+        r = fclose_nointr(csv);
+        csv = NULL;
+        if (r < 0)
+                return log_error_errno(r, "Error writing report file '%s': %m", csv_file);
+
+        r = fclose_nointr(json);
+        json = NULL;
+        if (r < 0)
+                return log_error_errno(r, "Error writing report file '%s': %m", json_file);
+
+        log_info("systemd-bootchart wrote %s and %s\n", csv_file, json_file);
+
+        return 0;
+}
+
+/* compares two reports, instead of sampling */
+static int write_diff(void) {
+        _cleanup_(diff_boot_done) struct diff_boot old_report = DIFF_BOOT_INIT, new_report = DIFF_BOOT_INIT;
+        _cleanup_(diff_keys_done) struct diff_keys keys = DIFF_KEYS_INIT;
+        _cleanup_free_ char *csv_file = NULL, *svg_file = NULL;
+        _cleanup_fclose_ FILE *csv = NULL, *svg = NULL;
+        char datestr[200];
+        time_t t;
+        int r;
+
+        r = diff_boot_load(&old_report, arg_diff_old);
+        if (r < 0)
+                return log_error_errno(r, "Failed to read report %s: %m", arg_diff_old);
+
+        r = diff_boot_load(&new_report, arg_diff_new);
+        if (r < 0)
+                return log_error_errno(r, "Failed to read report %s: %m", arg_diff_new);
+
+        r = diff_match(&keys, &old_report, &new_report);
+        if (r < 0)
+                return log_error_errno(r, "Failed to match processes: %m");
+
+        t = time(NULL);
+        r = strftime(datestr, sizeof(datestr), "%Y%m%d-%H%M", localtime(&t));
+        assert_se(r > 0);
+
+        if (asprintf(&csv_file, "%s/bootchart-diff-%s.csv", arg_output_path, datestr) < 0 ||
+            asprintf(&svg_file, "%s/bootchart-diff-%s.svg", arg_output_path, datestr) < 0)
+                return log_oom();
+
+        csv = fopen(csv_file, "we");
+        if (!csv)
+                return log_error_errno(errno, "Error opening output file '%s': %m", csv_file);
+
+        svg = fopen(svg_file, "we");
+        if (!svg)
+                return log_error_errno(errno, "Error opening output file '%s': %m", svg_file);
+
+        r = diff_write_csv(csv, &old_report, &new_report);
+        if (r >= 0)
+                r = diff_write_svg(svg, arg_diff_old, &old_report, arg_diff_new, &new_report);
+        if (r < 0)
+                return log_error_errno(r, "Error generating diff: %m");
+
+        r = fclose_nointr(csv);
+        csv = NULL;
+        if (r < 0)
+                return log_error_errno(r, "Error writing diff file '%s': %m", csv_file);
+
+        r = fclose_nointr(svg);
+        svg = NULL;
+        if (r < 0)
+                return log_error_errno(r, "Error writing diff file '%s': %m", svg_file);
+
+        log_info("systemd-bootchart wrote %s and %s\n", svg_file, csv_file);
+
+        return 0;
+}
+
+/* statistics over many reports, reading one at a time, instead of sampling */
+static int write_aggregate(void) {
+        _cleanup_(aggregate_done) struct aggregate a = AGGREGATE_INIT;
+        _cleanup_free_ char *csv_file = NULL, *svg_file = NULL;
+        _cleanup_fclose_ FILE *csv = NULL, *svg = NULL;
+        char datestr[200];
+        char **path;
+        time_t t;
+        int r;
+
+        STRV_FOREACH(path, arg_aggregate_reports) {
+                _cleanup_(diff_boot_done) struct diff_boot b = DIFF_BOOT_INIT;
+
+                r = diff_boot_load(&b, *path);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to read report %s: %m", *path);
+
+                r = aggregate_add(&a, &b);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to aggregate report %s: %m", *path);
+        }
+
+        t = time(NULL);
+        r = strftime(datestr, sizeof(datestr), "%Y%m%d-%H%M", localtime(&t));
+        assert_se(r > 0);
+
+        if (asprintf(&csv_file, "%s/bootchart-aggregate-%s.csv", arg_output_path, datestr) < 0 ||
+            asprintf(&svg_file, "%s/bootchart-aggregate-%s.svg", arg_output_path, datestr) < 0)
+                return log_oom();
+
+        csv = fopen(csv_file, "we");
+        if (!csv)
+                return log_error_errno(errno, "Error opening output file '%s': %m", csv_file);
+
+        svg = fopen(svg_file, "we");
+        if (!svg)
+                return log_error_errno(errno, "Error opening output file '%s': %m", svg_file);
+
+        r = aggregate_write_csv(csv, &a);
+        if (r >= 0)
+                r = aggregate_write_svg(svg, &a);
+        if (r < 0)
+                return log_error_errno(r, "Error generating aggregate: %m");
+
+        r = fclose_nointr(csv);
+        csv = NULL;
+        if (r < 0)
+                return log_error_errno(r, "Error writing aggregate file '%s': %m", csv_file);
+
+        r = fclose_nointr(svg);
+        svg = NULL;
+        if (r < 0)
+                return log_error_errno(r, "Error writing aggregate file '%s': %m", svg_file);
+
+        log_info("systemd-bootchart wrote %s and %s\n", svg_file, csv_file);
+
+        return 0;
+}
+
+/* what sampler_setup() changed, so rendering runs like any other process */
+struct sampler_state {
+        cpu_set_t affinity;
+        bool pinned;
+        bool realtime;
+        bool locked;
+};
+
+/*
+ * Keeps the sampler on time when the system is busiest. Sampling only
+ * reads small files and sleeps, even after a late sample, so it can run
+ * above everything else without starving it. Failures are not fatal, the options that didn't
+ * apply are turned off, so the title only names what was in effect.
+ */
+static void sampler_setup(struct sampler_state *s) {
+        if (arg_cpu >= 0) {
+                cpu_set_t set;
+
+                CPU_ZERO(&set);
+                CPU_SET(arg_cpu, &set);
+
+                if (sched_getaffinity(0, sizeof(s->affinity), &s->affinity) < 0 ||
+                    sched_setaffinity(0, sizeof(set), &set) < 0) {
+                        log_warning_errno(errno, "Failed to pin sampling to CPU %i, ignoring: %m", arg_cpu);
+                        arg_cpu = -1;
+                } else
+                        s->pinned = true;
+        }
+
+        if (arg_lock_memory) {
+                size_t size;
+                char *p;
+
+                /* keep freed memory in the heap, and large allocations out of mmap(), so it stays faulted in */
+                mallopt(M_TRIM_THRESHOLD, -1);
+                mallopt(M_MMAP_MAX, 0);
+
+                if (mlockall(MCL_CURRENT|MCL_FUTURE) < 0) {
+                        log_warning_errno(errno, "Failed to lock memory, ignoring: %m");
+                        arg_lock_memory = false;
+                } else
+                        s->locked = true;
+
+                /* fault in the heap for the samples to come, and give it back to malloc() */
+                size = MIN((size_t) arg_samples_len * (sizeof(struct list_sample_data) +
+                                                       PREFAULT_PROCESSES * sizeof(struct ps_sched_struct)),
+                           (size_t) PREFAULT_MAX);
+                p = malloc(size);
+                if (p) {
+                        size_t i;
+
+                        for (i = 0; i < size; i += page_size())
+                                ((volatile char *) p)[i] = 0;
+
+                        free(p);
+                }
+        }
+
+        if (arg_realtime > 0) {
+                struct sched_param param = {
+                        .sched_priority = arg_realtime,
+                };
+
+                if (sched_setscheduler(0, SCHED_FIFO, &param) < 0) {
+                        log_warning_errno(errno, "Failed to sample with SCHED_FIFO, ignoring: %m");
+                        arg_realtime = 0;
+                } else
+                        s->realtime = true;
+        }
+}
+
+static void sampler_restore(struct sampler_state *s) {
+        if (s->realtime) {
+                struct sched_param param = {};
+
+                (void) sched_setscheduler(0, SCHED_OTHER, &param);
+        }
+
+        if (s->pinned)
+                (void) sched_setaffinity(0, sizeof(s->affinity), &s->affinity);
+
+        if (s->locked)
+                (void) munlockall();
+
+        *s = (struct sampler_state) {};
+}
+
 int main(int argc, char *argv[]) {
         static struct list_sample_data *sampledata;
         _cleanup_closedir_ DIR *proc = NULL;
-        _cleanup_free_ char *build = NULL;
+        _cleanup_(system_info_done) struct system_info system = SYSTEM_INFO_INIT;
+        const struct system_info *info;
         _cleanup_fclose_ FILE *of = NULL;
+        _cleanup_(kmsg_done) struct kmsg kmsg = KMSG_INIT;
+        _cleanup_(disks_done) struct disks disks = DISKS_INIT;
+        _cleanup_(services_done) struct services services = SERVICES_INIT;
+        _cleanup_(capture_done) struct capture capture = CAPTURE_INIT;
+        struct governor governor = GOVERNOR_INIT(0.0);
+        struct autostop autostop = AUTOSTOP_INIT;
+        struct sampler_state sampler = {};
+        double next_start = 0.0;
+        struct boot_times boot = {};
+        bool has_boot = false;
         int schfd;
         struct ps_struct *ps_first;
         double graph_start;
@@ -333,6 +1079,7 @@ int main(int argc, char *argv[]) {
                 .sa_handler = signal_handler,
         };
         bool has_procfs = false;
+        const char *proc_path, *vmstat_path, *diskstats_path, *block_path, *cgroup_path, *unified_path;
 
         parse_conf();
 
@@ -343,6 +1090,12 @@ int main(int argc, char *argv[]) {
         if (r == 0)
                 return EXIT_SUCCESS;
 
+        if (arg_diff)
+                return write_diff() < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+        if (arg_aggregate)
+                return write_aggregate() < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
         /*
          * If the kernel executed us through init=/usr/lib/systemd/systemd-bootchart, then
          * fork:
@@ -356,7 +1109,7 @@ int main(int argc, char *argv[]) {
         }
         argv[0][0] = '@';
 
-        schfd = open("/proc/sys/kernel/sched_schedstats", O_WRONLY);
+        schfd = open(prefix_roota(arg_root, "/proc/sys/kernel/sched_schedstats"), O_WRONLY);
         if (schfd >= 0) {
                 write(schfd, "1\n", 2);
                 close(schfd);
@@ -368,6 +1121,8 @@ int main(int argc, char *argv[]) {
                 log_oom();
                 return EXIT_FAILURE;
         }
+        ps_first->name = -1;
+        ps_first->cgroup = -1;
 
         /* handle TERM/INT nicely */
         sigaction(SIGHUP, &sig, NULL);
@@ -394,7 +1149,69 @@ int main(int argc, char *argv[]) {
                 return EXIT_FAILURE;
         }
 
-        has_procfs = access("/proc/vmstat", F_OK) == 0;
+        if (arg_replay[0]) {
+                r = capture_open_replay(&capture, arg_replay);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to open recording %s: %m", arg_replay);
+                        return EXIT_FAILURE;
+                }
+
+                /* the recording knows how fast and since when it sampled, and ends when it ends */
+                arg_hz = capture.header.hz;
+                interval = (1.0 / arg_hz) * 1000000000.0;
+                graph_start = capture.header.graph_start;
+                log_start = capture.header.log_start;
+                arg_samples_len = INT_MAX;
+
+                /* only what log_sample() read is recorded, and nothing is sampled */
+                arg_disks = false;
+                arg_initcall = false;
+                arg_service_view = SERVICE_VIEW_NO;
+                arg_max_overhead = 0.0;
+                arg_realtime = 0;
+                arg_cpu = -1;
+                arg_lock_memory = false;
+                arg_stop_idle = arg_max_duration = 0.0;
+                arg_stop_path[0] = arg_stop_unit[0] = '\0';
+
+                log_sample_capture(&capture);
+        } else if (arg_capture[0]) {
+                r = capture_open(&capture, arg_capture, arg_hz, graph_start, log_start);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to create recording %s: %m", arg_capture);
+                        return EXIT_FAILURE;
+                }
+
+                log_sample_capture(&capture);
+        }
+
+        governor.max_share = arg_max_overhead / 100.0;
+
+        autostop.idle = arg_stop_idle;
+        autostop.idle_window = arg_idle_window;
+        autostop.idle_threshold = arg_idle_threshold / 100.0;
+        autostop.max_duration = arg_max_duration;
+        autostop.grace = arg_stop_grace;
+        if (arg_stop_path[0])
+                autostop.path = prefix_roota(arg_root, arg_stop_path);
+        if (arg_stop_unit[0]) {
+                /* systemd links this to the invocation ID of every unit it starts */
+                autostop.unit = arg_stop_unit;
+                autostop.unit_path = prefix_roota(arg_root, strjoina("/run/systemd/units/invocation:", arg_stop_unit));
+        }
+
+        sampler_setup(&sampler);
+
+        /* prefix_roota() is alloca(), only freed when main() returns, so it never runs per sample */
+        proc_path = prefix_roota(arg_root, "/proc");
+        vmstat_path = prefix_roota(arg_root, "/proc/vmstat");
+        diskstats_path = prefix_roota(arg_root, "/proc/diskstats");
+        block_path = prefix_roota(arg_root, "/sys/class/block");
+        /* the unified hierarchy, or its hybrid mount point */
+        cgroup_path = prefix_roota(arg_root, "/sys/fs/cgroup");
+        unified_path = prefix_roota(arg_root, "/sys/fs/cgroup/unified");
+
+        has_procfs = arg_replay[0] || access(vmstat_path, F_OK) == 0;
 
         LIST_HEAD_INIT(head);
 
@@ -404,6 +1221,9 @@ int main(int argc, char *argv[]) {
                 double sample_stop;
                 double elapsed;
                 double timeleft;
+                nsec_t cpu_start;
+                nsec_t probe_start;
+                const struct governor_rates *rates;
 
                 sampledata = new0(struct list_sample_data, 1);
                 if (sampledata == NULL) {
@@ -413,38 +1233,139 @@ int main(int argc, char *argv[]) {
 
                 sampledata->sampletime = gettime_ns();
                 sampledata->counter = samples;
-
-                if (!build) {
-                        if (parse_env_file("/etc/os-release", NEWLINE, "PRETTY_NAME", &build, NULL) == -ENOENT)
-                                parse_env_file("/usr/lib/os-release", NEWLINE, "PRETTY_NAME", &build, NULL);
+                sampledata->overhead.governor = governor.level;
+                cpu_start = now_nsec(CLOCK_THREAD_CPUTIME_ID);
+
+                /* how late the sample started, compared to when we asked to wake up, up to ~4.3s */
+                if (next_start > 0.0 && sampledata->sampletime > next_start)
+                        sampledata->overhead.latency = MIN((sampledata->sampletime - next_start) * NSEC_PER_SEC,
+                                                           (double) UINT32_MAX);
+
+                if (arg_replay[0]) {
+                        r = capture_next(&capture, &sampledata->sampletime);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to read recording %s: %m", arg_replay);
+                                return EXIT_FAILURE;
+                        }
+                        if (r == 0) {
+                                free(sampledata);
+                                break;
+                        }
                 }
 
                 if (!has_procfs) {
                         /* wait for /proc to become available, discarding samples */
-                        has_procfs = access("/proc/vmstat", F_OK) == 0;
+                        has_procfs = access(vmstat_path, F_OK) == 0;
                 } else if (proc) {
                         rewinddir(proc);
-                } else {
-                        proc = opendir("/proc");
+                } else if (!arg_replay[0]) {
+                        proc = opendir(proc_path);
+
+                        /* with /proc comes what the title says about the system, and a recording keeps it */
+                        if (proc) {
+                                system_info_read(&system, arg_root);
+                                if (arg_capture[0])
+                                        (void) capture_begin(&capture, &system);
+                        }
                 }
 
-                if (proc) {
+                if (proc || arg_replay[0]) {
+                        if (arg_capture[0])
+                                (void) capture_sample(&capture, sampledata->sampletime);
+
                         r = log_sample(proc, samples, ps_first, &sampledata, &pscount, &n_cpus);
                         if (r < 0)
                                 return EXIT_FAILURE;
+
+                        if (arg_disks) {
+                                probe_start = now_nsec(CLOCK_MONOTONIC);
+
+                                (void) disks_open(&disks, diskstats_path, block_path);
+
+                                r = disks_read(&disks, &sampledata->disks, &sampledata->n_disks);
+                                if (r < 0)
+                                        log_debug_errno(r, "Failed to read disk statistics, ignoring: %m");
+
+                                sampledata->overhead.probe[PROBE_DISKS] = now_nsec(CLOCK_MONOTONIC) - probe_start;
+                        }
+
+                        if (arg_service_view != SERVICE_VIEW_NO) {
+                                probe_start = now_nsec(CLOCK_MONOTONIC);
+
+                                if (services_open(&services, cgroup_path) < 0)
+                                        (void) services_open(&services, unified_path);
+
+                                r = services_read(&services, &sampledata->services, &sampledata->n_services);
+                                if (r < 0)
+                                        log_debug_errno(r, "Failed to read unit cgroups, ignoring: %m");
+
+                                sampledata->overhead.probe[PROBE_SERVICES] = now_nsec(CLOCK_MONOTONIC) - probe_start;
+                        }
+                }
+
+                /*
+                 * keep up with the kernel log, so no initcall drops out of the ring buffer;
+                 * they are only plotted against the time since boot
+                 */
+                if (arg_initcall && !arg_relative) {
+                        probe_start = now_nsec(CLOCK_MONOTONIC);
+
+                        (void) kmsg_open(&kmsg, "/dev/kmsg");
+
+                        r = kmsg_read(&kmsg);
+                        if (r < 0)
+                                log_debug_errno(r, "Failed to read kernel log, ignoring: %m");
+
+                        sampledata->overhead.probe[PROBE_KMSG] = now_nsec(CLOCK_MONOTONIC) - probe_start;
+                }
+
+                if (arg_replay[0]) {
+                        /* a replay runs as fast as it can, what that costs says nothing about the boot */
+                        sampledata->overhead = (struct sample_overhead) {};
+                        LIST_PREPEND(link, head, sampledata);
+                        continue;
                 }
 
                 sample_stop = gettime_ns();
 
+                sampledata->overhead.wall = (sample_stop - sampledata->sampletime) * NSEC_PER_SEC;
+                sampledata->overhead.cpu = now_nsec(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+                /* the sample itself, and the disk and unit counters read into it */
+                sampledata->overhead.allocations += 1 + !!sampledata->disks + !!sampledata->services;
+
+                if (governor_update(&governor, sampledata->overhead.cpu, interval))
+                        log_info("Sampling took %.1f%% of the interval, %s MaxOverheadPercent=%g%%, now %s.",
+                                 governor.share * 100.0,
+                                 governor.level > sampledata->overhead.governor ? "more than" : "well below",
+                                 arg_max_overhead, governor_level_to_string(governor.level));
+
+                /* the governor may stretch the interval, the recording still covers as much time */
+                rates = governor_rates(governor.level);
+                arg_samples_len -= rates->interval - 1;
+
                 elapsed = (sample_stop - sampledata->sampletime) * 1000000000.0;
-                timeleft = interval - elapsed;
+                timeleft = interval * rates->interval - elapsed;
 
                 /*
                  * check if we have not consumed our entire timeslice. If we
-                 * do, don't sleep and take a new sample right away.
-                 * we'll lose all the missed samples and overrun our total
-                 * time
+                 * do, don't sleep and take a new sample right away, save for
+                 * a short pause at SCHED_FIFO. we'll lose all the missed
+                 * samples and overrun our total time
                  */
+                if (timeleft > 0)
+                        next_start = sample_stop + timeleft / 1000000000.0;
+                else {
+                        /* taken right away, not at a time we asked for */
+                        next_start = 0.0;
+                        overrun++;
+                        /* calculate how many samples we lost and scrap them */
+                        arg_samples_len -= (int)(-timeleft / interval);
+
+                        /* above everything else on its CPU, never sleeping would starve it */
+                        if (sampler.realtime)
+                                timeleft = interval * REALTIME_MIN_SLEEP;
+                }
+
                 if (timeleft > 0) {
                         struct timespec req;
 
@@ -459,30 +1380,91 @@ int main(int argc, char *argv[]) {
                                 log_error_errno(errno, "nanosleep() failed: %m");
                                 return EXIT_FAILURE;
                         }
-                } else {
-                        overrun++;
-                        /* calculate how many samples we lost and scrap them */
-                        arg_samples_len -= (int)(-timeleft / interval);
                 }
                 LIST_PREPEND(link, head, sampledata);
+
+                if (autostop_check(&autostop, head, n_cpus, log_start)) {
+                        log_info("Stopped sampling after %.1fs, %s.", head->sampletime - log_start, autostop.reason);
+                        /* the title counts the samples taken, not the ones asked for */
+                        arg_samples_len = samples + 1;
+                }
         }
 
-        /* do some cleanup, close fd's */
-        ps = ps_first;
-        while (ps->next_running) {
-                ps = ps->next_running;
-                ps->schedstat = safe_close(ps->schedstat);
-                ps->sched = safe_close(ps->sched);
-                ps->smaps = safe_fclose(ps->smaps);
+        /* the rest is rendering, which shouldn't run above everything else */
+        sampler_restore(&sampler);
+
+        if (arg_initcall && !arg_relative) {
+                r = kmsg_read(&kmsg);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to read kernel log, ignoring: %m");
+        }
+
+        if (arg_replay[0]) {
+                arg_samples_len = samples;
+                info = &capture.system;
+        } else {
+                /* in case /proc never showed up while sampling */
+                system_info_read(&system, arg_root);
+                info = &system;
+        }
+
+        if (arg_capture[0]) {
+                r = capture_close(&capture);
+                if (r < 0)
+                        log_error_errno(r, "Failed to write recording %s: %m", arg_capture);
+                else
+                        log_info("systemd-bootchart wrote %s", arg_capture);
         }
 
+        /* nothing to render, a recording can hold no sample when /proc never showed up */
+        if (!head) {
+                if (arg_replay[0])
+                        log_error("Recording %s holds no samples.", arg_replay);
+                else
+                        log_error("No samples were taken.");
+                return EXIT_FAILURE;
+        }
+
+        /* the title names the disks that were used, even when they weren't graphed */
+        if (!arg_disks && !arg_replay[0] &&
+            disks_open(&disks, diskstats_path, block_path) >= 0) {
+                r = disks_read(&disks, &head->disks, &head->n_disks);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to read disk statistics, ignoring: %m");
+        }
+
+        /* firmware and boot loader ran before the kernel, so they only fit in front of the time since boot */
+        if (!arg_relative && !arg_replay[0])
+                has_boot = boot_times_read(prefix_roota(arg_root, "/sys/firmware/efi/efivars"),
+                                           prefix_roota(arg_root, "/sys/firmware/acpi/fpdt/boot"), &boot) >= 0;
+
+        /* do some cleanup, close fd's */
+        log_sample_done();
+
         if (!of) {
                 t = time(NULL);
                 r = strftime(datestr, sizeof(datestr), "%Y%m%d-%H%M", localtime(&t));
                 assert_se(r > 0);
 
-                snprintf(output_file, PATH_MAX, "%s/bootchart-%s.svg", arg_output_path, datestr);
-                of = fopen(output_file, "we");
+                snprintf(output_file, PATH_MAX, "%s/bootchart-%s.%s", arg_output_path, datestr,
+                         arg_compress ? "svgz" : "svg");
+
+                if (arg_compress) {
+                        int fd;
+
+                        fd = open(output_file, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+                        if (fd >= 0) {
+                                of = fdopen_gzip(fd, 9);
+                                if (!of) {
+                                        PROTECT_ERRNO;
+
+                                        safe_close(fd);
+                                        /* don't leave an empty chart behind */
+                                        (void) unlink(output_file);
+                                }
+                        }
+                } else
+                        of = fopen(output_file, "we");
         }
 
         if (!of) {
@@ -490,21 +1472,49 @@ int main(int argc, char *argv[]) {
                 return EXIT_FAILURE;
         }
 
-        r = svg_do(of, strna(build), head, ps_first,
+        r = svg_do(of, info, head, ps_first, &kmsg, &disks, &services, has_boot ? &boot : NULL,
                    samples, pscount, n_cpus, graph_start,
-                   log_start, interval, overrun);
+                   log_start, interval, overrun, NULL);
 
         if (r < 0) {
                 log_error_errno(r, "Error generating svg file: %m");
                 return EXIT_FAILURE;
         }
 
+        /* flush everything (and the gzip trailer) before the journal reads the file back */
+        r = fclose_nointr(of);
+        of = NULL;
+        if (r < 0) {
+                log_error_errno(r, "Error writing svg file '%s': %m", output_file);
+                return EXIT_FAILURE;
+        }
+
         log_info("systemd-bootchart wrote %s\n", output_file);
 
         r = do_journal_append(output_file);
         if (r < 0)
                 return EXIT_FAILURE;
 
+        if (arg_html) {
+                r = write_output(datestr, "html", html_do, strna(info->build), head, ps_first, &kmsg, n_cpus, graph_start);
+                if (r < 0)
+                        return EXIT_FAILURE;
+        }
+
+        if (arg_trace) {
+                r = write_output(datestr, "trace.json", trace_do, strna(info->build), head, ps_first, &kmsg, n_cpus,
+                                 graph_start);
+                if (r < 0)
+                        return EXIT_FAILURE;
+        }
+
+        if (arg_report) {
+                r = write_report(datestr, strna(info->build), head, ps_first, has_boot ? &boot : NULL,
+                                 samples, n_cpus, graph_start, interval, overrun);
+                if (r < 0)
+                        return EXIT_FAILURE;
+        }
+
         /* nitpic cleanups */
         ps = ps_first->next_ps;
         while (ps) {
@@ -519,20 +1529,22 @@ int main(int argc, char *argv[]) {
                         old->sample = old->sample->next;
                         free(oldsample);
                 }
-                free(old->cgroup);
+                free(old->cgroup_changes);
                 free(old->sample);
                 free(old);
         }
 
         free(ps_first);
-
-        sampledata = head;
-        while (sampledata->link_next) {
-                struct list_sample_data *old_sampledata = sampledata;
-                sampledata = sampledata->link_next;
-                free(old_sampledata);
+        strtab_done(&ps_names);
+        strtab_done(&cgroup_paths);
+
+        while (head) {
+                sampledata = head;
+                head = head->link_next;
+                free(sampledata->disks);
+                free(sampledata->services);
+                free(sampledata);
         }
-        free(sampledata);
 
         /* don't complain when overrun once, happens most commonly on 1st sample */
         if (overrun > 1)
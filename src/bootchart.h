@@ -24,13 +24,74 @@
 
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
+#include "cpu-topology.h"
 #include "list.h"
+#include "service.h"
+#include "string-util.h"
+#include "strtab.h"
 
 #define MAXCPUS        512
 #define MAXPIDS    4194304
 
+struct disk_sample;
+
+typedef enum PressureResource {
+        PRESSURE_CPU,
+        PRESSURE_IO,
+        PRESSURE_MEMORY,
+        _PRESSURE_RESOURCE_MAX,
+        _PRESSURE_RESOURCE_INVALID = -1,
+} PressureResource;
+
+struct pressure_stat_struct {
+        /* /proc/pressure/<resource> "some" and "full" total stall time in us */
+        uint64_t some;
+        uint64_t full;
+};
+
+/* the parts of a sample whose cost is measured, see struct sample_overhead */
+typedef enum SampleProbe {
+        PROBE_VMSTAT,
+        PROBE_SCHEDSTAT,
+        PROBE_SYSTEM,           /* entropy and pressure */
+        PROBE_PROCESSES,        /* the list of pids, new processes and their schedstat */
+        PROBE_THREADS,
+        PROBE_PSS,
+        PROBE_IO,
+        PROBE_RENAME,
+        PROBE_DISKS,
+        PROBE_SERVICES,
+        PROBE_KMSG,
+        _PROBE_MAX,
+        _PROBE_INVALID = -1,
+} SampleProbe;
+
+/*
+ * What taking a sample cost bootchart itself. The counters cover the
+ * files and directories read below /proc, where nearly all of the
+ * work is; listing a directory counts as one read.
+ */
+struct sample_overhead {
+        /* the whole sample, in ns of wall clock and of CPU time */
+        uint64_t wall;
+        uint64_t cpu;
+        /* wall clock time of each probe in ns */
+        uint32_t probe[_PROBE_MAX];
+        uint32_t opens;
+        uint32_t reads;
+        /* opens, reads and closes */
+        uint32_t syscalls;
+        uint32_t allocations;
+        uint64_t bytes;
+        /* the level of the governor the sample was taken at */
+        int governor;
+        /* how much later than asked for the sample started, in ns, at most UINT32_MAX */
+        uint32_t latency;
+};
+
 struct block_stat_struct {
         /* /proc/vmstat pgpgin & pgpgout */
         int bi;
@@ -43,10 +104,15 @@ struct ps_sched_struct {
         double runtime;
         double waittime;
         int pss;
+        /* /proc/<n>/io deltas since the previous IO sample, bytes in kB */
+        uint32_t io_read;
+        uint32_t io_write;
+        uint32_t io_syscr;
+        uint32_t io_syscw;
+        bool io;
         struct list_sample_data *sampledata;
         struct ps_sched_struct *next;
         struct ps_sched_struct *prev;
-        struct ps_sched_struct *cross; /* cross pointer */
         struct ps_struct *ps_new;
 };
 
@@ -56,35 +122,77 @@ struct list_sample_data {
         double sampletime;
         int entropy_avail;
         struct block_stat_struct blockstat;
+        struct pressure_stat_struct pressure[_PRESSURE_RESOURCE_MAX];
+        /* /proc/diskstats, indexed by disk slot */
+        struct disk_sample *disks;
+        int n_disks;
+        /* cgroup v2 unit counters, indexed like struct services */
+        struct service_sample *services;
+        int n_services;
+        struct sample_overhead overhead;
         LIST_FIELDS(struct list_sample_data, link); /* DLL */
         int counter;
 };
 
 /* process info */
+/* a process moved to another cgroup after it was first seen */
+struct cgroup_change {
+        double time;
+        int cgroup;
+};
+
+/*
+ * Sampler state of a process that is still running. Every sample
+ * looks up each pid in the list of these, so it is kept apart from
+ * ps_struct and small enough that the walk stays in a few cache lines.
+ */
+struct ps_running {
+        struct ps_running *next;
+        int pid;
+
+        /* used to garbage collect running process list*/
+        bool still_running;
+        bool io_seen;
+        /* no smaps_rollup, PSS is summed up from smaps */
+        bool no_rollup;
+        bool threads_seen;
+
+        /* cache fd's */
+        int sched;
+        int schedstat;
+        int io;
+        int smaps;
+
+        struct ps_struct *ps;
+
+        /* last cumulative /proc/<n>/io values */
+        uint64_t io_last[4];
+
+        /* the time of the other threads, when they were last read */
+        long long threads_runtime;
+        long long threads_waittime;
+};
+
 struct ps_struct {
         struct ps_struct *next_ps;      /* SLL pointer */
-        struct ps_struct *next_running; /* currently running */
         struct ps_struct *parent;       /* ppid ref */
         struct ps_struct *children;     /* children */
         struct ps_struct *next;         /* siblings */
 
-        /* must match - otherwise it's a new process with same PID */
-        char name[256];
         int pid;
         int ppid;
-        char *cgroup;
-
-        /* cache fd's */
-        int sched;
-        int schedstat;
-        FILE *smaps;
-
-        /* used to garbage collect running process list*/
-        bool still_running;
+        /* index into ps_names, -1 if unknown */
+        int name;
+        /* index into cgroup_paths, -1 if unknown */
+        int cgroup;
+        struct cgroup_change *cgroup_changes;
+        int n_cgroup_changes;
 
         /* pointers to first/last seen timestamps */
         struct ps_sched_struct *first;
         struct ps_sched_struct *last;
+        /* sampletime of the last sample that found the process, even if the governor skipped it */
+        double last_seen;
 
         /* records actual start time, may be way before bootchart runs */
         double starttime;
@@ -95,6 +203,12 @@ struct ps_struct {
         /* largest PSS size found */
         int pss_max;
 
+        /* IO totals since first seen */
+        uint64_t io_read;
+        uint64_t io_write;
+        uint64_t io_syscr;
+        uint64_t io_syscw;
+
         /* for drawing connection lines later */
         double pos_x;
         double pos_y;
@@ -110,10 +224,41 @@ extern bool arg_pss;
 extern bool arg_entropy;
 extern bool arg_percpu;
 extern bool arg_initcall;
+extern bool arg_compress;
+extern bool arg_cpu_heatmap;
+extern bool arg_html;
+extern bool arg_trace;
+extern bool arg_report;
+extern bool arg_io;
+extern bool arg_disks;
+extern bool arg_pressure;
+extern bool arg_overhead;
+extern CpuGroup arg_cpu_group;
+extern ServiceView arg_service_view;
 extern int  arg_samples_len;
+extern int  arg_io_interval;
 extern double arg_hz;
+extern double arg_max_overhead;
+extern int arg_realtime;
+extern int arg_cpu;
+extern bool arg_lock_memory;
+extern double arg_idle_threshold;
+extern double arg_idle_window;
 extern double arg_scale_x;
 extern double arg_scale_y;
 
 extern char arg_output_path[PATH_MAX];
 extern char arg_init_path[PATH_MAX];
+extern char arg_root[PATH_MAX];
+
+/* process names and cgroup paths, shared by all processes */
+extern struct strtab ps_names;
+extern struct strtab cgroup_paths;
+
+static inline const char *ps_name(const struct ps_struct *ps) {
+        return strempty(strtab_get(&ps_names, ps->name));
+}
+
+static inline const char *ps_cgroup(const struct ps_struct *ps) {
+        return strtab_get(&cgroup_paths, ps->cgroup);
+}
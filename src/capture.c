@@ -0,0 +1,397 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "capture.h"
+#include "fd-util.h"
+#include "macro.h"
+
+/* nothing below /proc comes close, larger sizes mean a broken recording */
+#define CAPTURE_SIZE_MAX (64U * 1024U * 1024U)
+/* the same for a string about the system */
+#define CAPTURE_SYSTEM_MAX (64U * 1024U)
+
+static int capture_add_file(struct capture *c, const char *path) {
+        size_t n = c->paths.n_strings;
+        int i;
+
+        /* room for a new path first, so every known path has its file */
+        if (!GREEDY_REALLOC(c->files, c->allocated_files, n + 1))
+                return -ENOMEM;
+
+        i = strtab_intern(&c->paths, path);
+        if (i < 0)
+                return i;
+        if (c->paths.n_strings > n)
+                c->files[i] = (struct capture_file) {};
+
+        return i;
+}
+
+static int capture_set_file(struct capture *c, int i, const char *data, ssize_t size) {
+        struct capture_file *file = &c->files[i];
+
+        if (size > 0) {
+                char *d;
+
+                d = realloc(file->data, size);
+                if (!d)
+                        return -ENOMEM;
+
+                memcpy(d, data, size);
+                file->data = d;
+        }
+
+        file->size = size;
+        file->seen = true;
+
+        return 0;
+}
+
+int capture_open(struct capture *c, const char *path, double hz, double graph_start, double log_start) {
+        assert(c);
+        assert(path);
+
+        c->f = fopen(path, "we");
+        if (!c->f)
+                return -errno;
+
+        memcpy(c->header.magic, CAPTURE_MAGIC, sizeof(c->header.magic));
+        c->header.version = CAPTURE_VERSION;
+        c->header.hz = hz;
+        c->header.graph_start = graph_start;
+        c->header.log_start = log_start;
+        c->replay = false;
+        c->started = false;
+
+        return 0;
+}
+
+int capture_begin(struct capture *c, const struct system_info *system) {
+        const struct system_info none = SYSTEM_INFO_INIT;
+        const char *strings[5];
+        size_t i;
+
+        assert(c);
+        assert(!c->replay);
+        assert(!c->started);
+
+        if (!system)
+                system = &none;
+
+        /* in the order of struct system_info */
+        strings[0] = system->build;
+        strings[1] = system->cmdline;
+        strings[2] = system->hostname;
+        strings[3] = system->kernel;
+        strings[4] = system->cpu;
+
+        c->header.n_system = ELEMENTSOF(strings);
+        c->started = true;
+
+        if (fwrite(&c->header, sizeof(c->header), 1, c->f) != 1)
+                goto fail;
+
+        for (i = 0; i < ELEMENTSOF(strings); i++) {
+                uint32_t l;
+
+                l = strings[i] ? MIN(strlen(strings[i]), (size_t) CAPTURE_SYSTEM_MAX) : UINT32_MAX;
+                if (fwrite(&l, sizeof(l), 1, c->f) != 1 ||
+                    (l != UINT32_MAX && fwrite(strings[i], 1, l, c->f) != l))
+                        goto fail;
+        }
+
+        return 0;
+
+fail:
+        c->error = c->error ?: -EIO;
+        return -EIO;
+}
+
+int capture_sample(struct capture *c, double sampletime) {
+        assert(c);
+        assert(!c->replay);
+        assert(c->started);
+
+        if (putc('t', c->f) == EOF || fwrite(&sampletime, sizeof(sampletime), 1, c->f) != 1) {
+                c->error = c->error ?: -EIO;
+                return -EIO;
+        }
+
+        return 0;
+}
+
+void capture_put(struct capture *c, const char *path, const char *data, ssize_t size) {
+        struct capture_file *file;
+        uint32_t p;
+        int32_t s;
+        size_t n;
+        int i, r;
+
+        assert(c);
+        assert(!c->replay);
+        assert(path);
+
+        n = c->paths.n_strings;
+        i = capture_add_file(c, path);
+        if (i < 0) {
+                c->error = c->error ?: i;
+                return;
+        }
+
+        if (c->paths.n_strings > n) {
+                p = strlen(path);
+                if (putc('p', c->f) == EOF ||
+                    fwrite(&p, sizeof(p), 1, c->f) != 1 ||
+                    fwrite(path, 1, p, c->f) != p)
+                        goto fail;
+        }
+
+        file = &c->files[i];
+        if (file->seen && file->size == size && (size <= 0 || memcmp(file->data, data, size) == 0))
+                return;
+
+        r = capture_set_file(c, i, data, size);
+        if (r < 0) {
+                c->error = c->error ?: r;
+                return;
+        }
+
+        p = i;
+        s = (int32_t) MIN(size, (ssize_t) INT32_MAX);
+        if (putc('r', c->f) == EOF ||
+            fwrite(&p, sizeof(p), 1, c->f) != 1 ||
+            fwrite(&s, sizeof(s), 1, c->f) != 1 ||
+            (s > 0 && fwrite(data, 1, s, c->f) != (size_t) s))
+                goto fail;
+
+        return;
+
+fail:
+        c->error = c->error ?: -EIO;
+}
+
+int capture_close(struct capture *c) {
+        int r;
+
+        assert(c);
+
+        if (!c->f)
+                return 0;
+
+        /* nothing was sampled, the recording is still one */
+        if (!c->started)
+                (void) capture_begin(c, NULL);
+
+        r = fclose(c->f) < 0 ? -errno : 0;
+        c->f = NULL;
+
+        return c->error ?: r;
+}
+
+static int capture_read_system(struct capture *c) {
+        char **strings[] = {
+                /* in the order of struct system_info */
+                &c->system.build,
+                &c->system.cmdline,
+                &c->system.hostname,
+                &c->system.kernel,
+                &c->system.cpu,
+        };
+        uint32_t i, l;
+
+        for (i = 0; i < c->header.n_system; i++) {
+                _cleanup_free_ char *s = NULL;
+
+                if (fread(&l, sizeof(l), 1, c->f) != 1)
+                        return -EBADMSG;
+                if (l == UINT32_MAX)
+                        continue;
+                if (l > CAPTURE_SYSTEM_MAX)
+                        return -EBADMSG;
+
+                s = new(char, l + 1);
+                if (!s)
+                        return -ENOMEM;
+
+                if (fread(s, 1, l, c->f) != l)
+                        return -EBADMSG;
+                s[l] = '\0';
+
+                if (i < ELEMENTSOF(strings)) {
+                        free(*strings[i]);
+                        *strings[i] = s;
+                        s = NULL;
+                }
+        }
+
+        return 0;
+}
+
+int capture_open_replay(struct capture *c, const char *path) {
+        assert(c);
+        assert(path);
+
+        c->f = fopen(path, "re");
+        if (!c->f)
+                return -errno;
+
+        c->replay = true;
+
+        if (fread(&c->header, sizeof(c->header), 1, c->f) != 1 ||
+            memcmp(c->header.magic, CAPTURE_MAGIC, sizeof(c->header.magic)) != 0)
+                return -EBADMSG;
+
+        if (c->header.version != CAPTURE_VERSION)
+                return -EPROTONOSUPPORT;
+
+        if (c->header.hz <= 0.0)
+                return -EBADMSG;
+
+        return capture_read_system(c);
+}
+
+static int capture_read_path(struct capture *c) {
+        char path[PATH_MAX];
+        uint32_t p;
+        size_t n;
+        int i;
+
+        if (fread(&p, sizeof(p), 1, c->f) != 1 || p >= sizeof(path))
+                return -EBADMSG;
+        if (fread(path, 1, p, c->f) != p)
+                return -EBADMSG;
+        path[p] = '\0';
+
+        n = c->paths.n_strings;
+        i = capture_add_file(c, path);
+        if (i < 0)
+                return i;
+
+        /* every path is named once, when it is first read */
+        if (c->paths.n_strings == n)
+                return -EBADMSG;
+
+        return 0;
+}
+
+static int capture_read_contents(struct capture *c) {
+        _cleanup_free_ char *data = NULL;
+        uint32_t p;
+        int32_t s;
+
+        if (fread(&p, sizeof(p), 1, c->f) != 1 || p >= c->paths.n_strings)
+                return -EBADMSG;
+        if (fread(&s, sizeof(s), 1, c->f) != 1 || (s > 0 && (uint32_t) s > CAPTURE_SIZE_MAX))
+                return -EBADMSG;
+
+        if (s > 0) {
+                data = new(char, s);
+                if (!data)
+                        return -ENOMEM;
+
+                if (fread(data, 1, s, c->f) != (size_t) s)
+                        return -EBADMSG;
+        }
+
+        return capture_set_file(c, p, data, s);
+}
+
+int capture_next(struct capture *c, double *ret_sampletime) {
+        double t;
+        int type, r;
+
+        assert(c);
+        assert(c->replay);
+        assert(ret_sampletime);
+
+        type = getc(c->f);
+        if (type == EOF)
+                return ferror(c->f) ? -EIO : 0;
+        if (type != 't' || fread(&t, sizeof(t), 1, c->f) != 1)
+                return -EBADMSG;
+
+        /* everything up to the next sample changed in this one */
+        for (;;) {
+                type = getc(c->f);
+                if (type == EOF)
+                        break;
+                if (type == 't') {
+                        ungetc(type, c->f);
+                        break;
+                }
+
+                if (type == 'p')
+                        r = capture_read_path(c);
+                else if (type == 'r')
+                        r = capture_read_contents(c);
+                else
+                        r = -EBADMSG;
+                if (r < 0)
+                        return r;
+        }
+
+        if (ferror(c->f))
+                return -EIO;
+
+        *ret_sampletime = t;
+
+        return 1;
+}
+
+ssize_t capture_get(const struct capture *c, const char *path, const char **ret) {
+        const struct capture_file *file;
+        int i;
+
+        assert(c);
+        assert(c->replay);
+        assert(path);
+        assert(ret);
+
+        i = strtab_find(&c->paths, path);
+        if (i < 0)
+                return i;
+
+        file = &c->files[i];
+        if (!file->seen)
+                return -ENOENT;
+
+        *ret = file->data;
+
+        return file->size;
+}
+
+void capture_done(struct capture *c) {
+        size_t i;
+
+        assert(c);
+
+        for (i = 0; i < c->paths.n_strings; i++)
+                free(c->files[i].data);
+
+        c->files = mfree(c->files);
+        c->allocated_files = 0;
+        strtab_done(&c->paths);
+        system_info_done(&c->system);
+        c->f = safe_fclose(c->f);
+}
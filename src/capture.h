@@ -0,0 +1,103 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "strtab.h"
+#include "system-info.h"
+
+#define CAPTURE_MAGIC "BCCAPTUR"
+/* bumped when a reader of an older version can't make sense of a recording */
+#define CAPTURE_VERSION 1
+
+/*
+ * A recording of the files log_sample() read, so a boot can be replayed
+ * later. Everything is in host byte order; a recording from a machine
+ * of the other byte order has a version that isn't known and is refused.
+ *
+ * The header is followed by n_system strings describing the system, in
+ * the order of struct system_info, each as <uint32 length> <string>,
+ * with a length of UINT32_MAX for one that couldn't be read. Strings a
+ * reader doesn't know are skipped, so more can be added without a new
+ * version. After that, the file is a sequence of records:
+ *
+ *   't' <double sampletime>                starts a sample
+ *   'p' <uint32 length> <path>             names the next path
+ *   'r' <uint32 path> <int32 size> <data>  new contents of a path, a
+ *                                          negative size is -errno
+ *
+ * Contents are only written when they differ from what the path held
+ * before, so a file that doesn't change costs nothing per sample.
+ * Paths are relative to /proc; directories are recorded as their
+ * numeric entries, one per line.
+ */
+struct capture_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t n_system;
+        double hz;
+        double graph_start;
+        double log_start;
+};
+
+struct capture_file {
+        char *data;
+        /* -errno if reading the file failed */
+        ssize_t size;
+        bool seen;
+};
+
+struct capture {
+        FILE *f;
+        bool replay;
+        /* the header was written, which waits for what it says about the system */
+        bool started;
+        struct capture_header header;
+        /* what the header said about the system, when replaying */
+        struct system_info system;
+        /* path -> index into files */
+        struct strtab paths;
+        struct capture_file *files;
+        size_t allocated_files;
+        /* the first error while recording, reported by capture_close() */
+        int error;
+};
+
+#define CAPTURE_INIT {}
+
+int capture_open(struct capture *c, const char *path, double hz, double graph_start, double log_start);
+/* writes the header, once /proc can tell about the system; system may be NULL */
+int capture_begin(struct capture *c, const struct system_info *system);
+/* starts recording the next sample */
+int capture_sample(struct capture *c, double sampletime);
+/* records the contents of a path in this sample, or -errno if reading it failed */
+void capture_put(struct capture *c, const char *path, const char *data, ssize_t size);
+/* flushes the recording, returns the first error seen while recording */
+int capture_close(struct capture *c);
+
+int capture_open_replay(struct capture *c, const char *path);
+/* moves on to the next recorded sample, 0 after the last one */
+int capture_next(struct capture *c, double *ret_sampletime);
+/* the contents of a path in the current sample, or -errno */
+ssize_t capture_get(const struct capture *c, const char *path, const char **ret);
+
+void capture_done(struct capture *c);
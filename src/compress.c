@@ -0,0 +1,100 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "compress.h"
+#include "fd-util.h"
+#include "macro.h"
+#include "stdio-util.h"
+#include "util.h"
+
+#ifdef HAVE_ZLIB
+static ssize_t gzip_write(void *cookie, const char *buf, size_t size) {
+        int n;
+
+        /* gzwrite() takes an unsigned length, stdio never hands us more than its buffer */
+        n = gzwrite((gzFile) cookie, buf, (unsigned) size);
+        if (n <= 0) {
+                errno = EIO;
+                return 0;
+        }
+
+        return n;
+}
+
+static int gzip_close(void *cookie) {
+        int r;
+
+        r = gzclose((gzFile) cookie);
+        if (r != Z_OK) {
+                errno = r == Z_ERRNO ? errno : EIO;
+                return EOF;
+        }
+
+        return 0;
+}
+#endif
+
+FILE *fdopen_gzip(int fd, int level) {
+#ifdef HAVE_ZLIB
+        static const cookie_io_functions_t gzip_io = {
+                .write = gzip_write,
+                .close = gzip_close,
+        };
+        char mode[4];
+        gzFile gz;
+        FILE *f;
+        int copy;
+
+        assert(fd >= 0);
+
+        xsprintf(mode, "wb%i", CLAMP(level, 1, 9));
+
+        /* gzclose() always closes the fd it was given, hand it a copy until we cannot fail anymore */
+        copy = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+        if (copy < 0)
+                return NULL;
+
+        gz = gzdopen(copy, mode);
+        if (!gz) {
+                errno = errno ?: ENOMEM;
+                safe_close(copy);
+                return NULL;
+        }
+
+        f = fopencookie(gz, "w", gzip_io);
+        if (!f) {
+                PROTECT_ERRNO;
+
+                gzclose(gz);
+                return NULL;
+        }
+
+        safe_close(fd);
+        return f;
+#else
+        errno = EOPNOTSUPP;
+        return NULL;
+#endif
+}
@@ -0,0 +1,204 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "cpu-topology.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "macro.h"
+#include "parse-util.h"
+#include "string-util.h"
+
+static const char * const cpu_group_table[_CPU_GROUP_MAX] = {
+        [CPU_GROUP_CPU] = "cpu",
+        [CPU_GROUP_CORE] = "core",
+        [CPU_GROUP_LLC] = "llc",
+        [CPU_GROUP_NODE] = "node",
+};
+
+const char *cpu_group_to_string(CpuGroup g) {
+        if (g < 0 || g >= _CPU_GROUP_MAX)
+                return NULL;
+
+        return cpu_group_table[g];
+}
+
+CpuGroup cpu_group_from_string(const char *s) {
+        CpuGroup g;
+
+        if (!s)
+                return _CPU_GROUP_INVALID;
+
+        for (g = 0; g < _CPU_GROUP_MAX; g++)
+                if (streq(cpu_group_table[g], s))
+                        return g;
+
+        return _CPU_GROUP_INVALID;
+}
+
+static int read_int_file(const char *fn, int *ret) {
+        _cleanup_free_ char *line = NULL;
+        int r;
+
+        r = read_one_line_file(fn, &line);
+        if (r < 0)
+                return r;
+
+        return safe_atoi(strstrip(line), ret);
+}
+
+/* the same package/core pair shares a row */
+static int cpu_core_key(const char *sysfs, int cpu, long *key) {
+        char fn[PATH_MAX];
+        int core, package, r;
+
+        snprintf(fn, sizeof(fn), "%s/devices/system/cpu/cpu%d/topology/core_id", sysfs, cpu);
+        r = read_int_file(fn, &core);
+        if (r < 0)
+                return r;
+
+        snprintf(fn, sizeof(fn), "%s/devices/system/cpu/cpu%d/topology/physical_package_id", sysfs, cpu);
+        r = read_int_file(fn, &package);
+        if (r < 0)
+                return r;
+
+        *key = ((long) package << 20) | core;
+        return 0;
+}
+
+/* CPUs sharing the highest level cache have the same first CPU in its shared_cpu_list */
+static int cpu_llc_key(const char *sysfs, int cpu, long *key) {
+        char fn[PATH_MAX];
+        int index, level, best_level = -1, first = -1;
+
+        for (index = 0; ; index++) {
+                _cleanup_free_ char *list = NULL;
+                char *e;
+
+                snprintf(fn, sizeof(fn), "%s/devices/system/cpu/cpu%d/cache/index%d/level", sysfs, cpu, index);
+                if (read_int_file(fn, &level) < 0)
+                        break;
+
+                if (level <= best_level)
+                        continue;
+
+                snprintf(fn, sizeof(fn), "%s/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", sysfs, cpu, index);
+                if (read_one_line_file(fn, &list) < 0)
+                        continue;
+
+                e = list + strspn(list, "0123456789");
+                *e = '\0';
+                if (safe_atoi(list, &first) < 0)
+                        continue;
+
+                best_level = level;
+        }
+
+        if (first < 0)
+                return -ENOENT;
+
+        *key = first;
+        return 0;
+}
+
+static int cpu_node_key(const char *sysfs, int cpu, long *key) {
+        _cleanup_closedir_ DIR *d = NULL;
+        char fn[PATH_MAX];
+        struct dirent *de;
+
+        snprintf(fn, sizeof(fn), "%s/devices/system/cpu/cpu%d", sysfs, cpu);
+        d = opendir(fn);
+        if (!d)
+                return -errno;
+
+        FOREACH_DIRENT(de, d, return -errno) {
+                int node;
+
+                if (!startswith(de->d_name, "node"))
+                        continue;
+
+                if (safe_atoi(de->d_name + 4, &node) < 0)
+                        continue;
+
+                *key = node;
+                return 0;
+        }
+
+        return -ENOENT;
+}
+
+int cpu_topology_group(const char *sysfs, int n_cpus, CpuGroup group, int *map) {
+        _cleanup_free_ long *keys = NULL;
+        int cpu, n_groups = 0;
+
+        assert(sysfs);
+        assert(map);
+
+        keys = new(long, n_cpus);
+        if (!keys)
+                return -ENOMEM;
+
+        for (cpu = 0; cpu < n_cpus; cpu++) {
+                long key;
+                int r, i;
+
+                switch (group) {
+                case CPU_GROUP_CPU:
+                        key = cpu;
+                        r = 0;
+                        break;
+                case CPU_GROUP_CORE:
+                        r = cpu_core_key(sysfs, cpu, &key);
+                        break;
+                case CPU_GROUP_LLC:
+                        r = cpu_llc_key(sysfs, cpu, &key);
+                        break;
+                case CPU_GROUP_NODE:
+                        r = cpu_node_key(sysfs, cpu, &key);
+                        break;
+                default:
+                        r = -EINVAL;
+                        break;
+                }
+
+                if (r < 0) {
+                        /* a row of its own, keyed so that nothing else can join it */
+                        keys[n_groups] = LONG_MIN + cpu;
+                        map[cpu] = n_groups++;
+                        continue;
+                }
+
+                for (i = 0; i < n_groups; i++)
+                        if (keys[i] == key)
+                                break;
+
+                if (i == n_groups)
+                        keys[n_groups++] = key;
+
+                map[cpu] = i;
+        }
+
+        return n_groups;
+}
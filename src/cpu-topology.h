@@ -0,0 +1,37 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+typedef enum CpuGroup {
+        CPU_GROUP_CPU,
+        CPU_GROUP_CORE,
+        CPU_GROUP_LLC,
+        CPU_GROUP_NODE,
+        _CPU_GROUP_MAX,
+        _CPU_GROUP_INVALID = -1,
+} CpuGroup;
+
+const char *cpu_group_to_string(CpuGroup g);
+CpuGroup cpu_group_from_string(const char *s);
+
+/*
+ * Fills map[0..n_cpus) with the row each CPU is aggregated into, rows
+ * are numbered in order of their lowest CPU. Returns the number of
+ * rows. CPUs whose topology can't be read get a row of their own.
+ */
+int cpu_topology_group(const char *sysfs, int n_cpus, CpuGroup group, int *map);
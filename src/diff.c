@@ -0,0 +1,551 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "alloc-util.h"
+#include "bootchart.h"
+#include "diff.h"
+#include "fd-util.h"
+#include "hashmap.h"
+#include "io-util.h"
+#include "macro.h"
+#include "report.h"
+#include "string-util.h"
+#include "utf8.h"
+
+/* a report of a few ten thousand processes is a few MB */
+#define DIFF_REPORT_MAX (256U * 1024U * 1024U)
+/* height of a process row of the chart */
+#define DIFF_ROW 16.0
+/* where the rows start, below the title */
+#define DIFF_TOP 130.0
+
+#define time_to_graph(t) ((t) * arg_scale_x)
+
+static int diff_read_file(const char *path, char **ret) {
+        _cleanup_free_ char *buf = NULL;
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        ssize_t n;
+
+        fd = open(path, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+        if (st.st_size > DIFF_REPORT_MAX)
+                return -EFBIG;
+
+        buf = new(char, st.st_size + 1);
+        if (!buf)
+                return -ENOMEM;
+
+        n = loop_read(fd, buf, st.st_size, false);
+        if (n < 0)
+                return n;
+        buf[n] = '\0';
+
+        *ret = buf;
+        buf = NULL;
+
+        return 0;
+}
+
+static const char *json_get_string(const struct json_value *v, const char *key) {
+        v = json_get(v, key);
+
+        return v && v->type == JSON_STRING ? v->string : NULL;
+}
+
+int diff_boot_load(struct diff_boot *b, const char *path) {
+        _cleanup_free_ char *text = NULL;
+        const struct json_value *system, *processes;
+        size_t i;
+        int r;
+
+        assert(b);
+        assert(path);
+
+        r = diff_read_file(path, &text);
+        if (r < 0)
+                return r;
+
+        r = json_parse(text, &b->json);
+        if (r < 0)
+                return r;
+
+        system = json_get(&b->json, "system");
+        processes = json_get(&b->json, "processes");
+        if (!system || !processes || processes->type != JSON_ARRAY)
+                return -EBADMSG;
+
+        b->build = json_get_string(&b->json, "build");
+        b->hz = json_get_number(json_get(system, "hz"), 0.0);
+        b->duration = json_get_number(json_get(system, "duration"), 0.0);
+        b->idle = json_get_number(json_get(system, "idle"), -1.0);
+
+        b->processes = new0(struct diff_process, processes->n_children);
+        if (!b->processes)
+                return -ENOMEM;
+
+        for (i = 0; i < processes->n_children; i++) {
+                const struct json_value *v = &processes->children[i];
+                struct diff_process *p = &b->processes[i];
+
+                if (v->type != JSON_OBJECT)
+                        return -EBADMSG;
+
+                p->pid = json_get_number(json_get(v, "pid"), 0.0);
+                p->ppid = json_get_number(json_get(v, "ppid"), 0.0);
+                p->name = strempty(json_get_string(v, "name"));
+                p->cgroup = json_get_string(v, "cgroup");
+                p->start = json_get_number(json_get(v, "start"), 0.0);
+                p->end = json_get_number(json_get(v, "end"), p->start);
+                p->cpu = json_get_number(json_get(v, "cpu"), 0.0);
+                p->wait = json_get_number(json_get(v, "wait"), 0.0);
+                p->match = -1;
+        }
+
+        b->n_processes = processes->n_children;
+
+        return 0;
+}
+
+void diff_boot_done(struct diff_boot *b) {
+        assert(b);
+
+        b->processes = mfree(b->processes);
+        b->n_processes = 0;
+        json_value_done(&b->json);
+}
+
+/* the key for the next process with this base, which names it apart from the ordinal */
+static int diff_key(struct diff_keys *k, const char *base) {
+        _cleanup_free_ char *key = NULL;
+        int i;
+
+        i = strtab_intern(&k->keys, base);
+        if (i < 0)
+                return i;
+
+        if (!GREEDY_REALLOC(k->ordinals, k->allocated_ordinals, i + 1))
+                return -ENOMEM;
+        while (k->n_ordinals <= (size_t) i)
+                k->ordinals[k->n_ordinals++] = 0;
+
+        if (asprintf(&key, "%i#%u", i, k->ordinals[i]++) < 0)
+                return -ENOMEM;
+
+        return strtab_intern(&k->keys, key);
+}
+
+int diff_keys_assign(struct diff_keys *k, struct diff_boot *b) {
+        _cleanup_(hashmap_freep) Hashmap *parents = NULL;
+        size_t i;
+        int r;
+
+        assert(k);
+        assert(b);
+
+        parents = hashmap_new(&trivial_hash_ops);
+        if (!parents)
+                return -ENOMEM;
+
+        /* ordinals count within one boot */
+        k->n_ordinals = 0;
+
+        /* a report lists parents before their children */
+        for (i = 0; i < b->n_processes; i++) {
+                _cleanup_free_ char *tree = NULL, *flat = NULL;
+                struct diff_process *p = &b->processes[i];
+                void *v;
+
+                v = hashmap_get(parents, INT_TO_PTR(p->ppid));
+
+                /* the line breaks keep these apart from each other and from the keys */
+                if (asprintf(&tree, "%i\n%s\n%s", v ? PTR_TO_INT(v) - 1 : -1, p->name, strempty(p->cgroup)) < 0 ||
+                    asprintf(&flat, "\n%s\n%s", p->name, strempty(p->cgroup)) < 0)
+                        return -ENOMEM;
+
+                p->tree_key = diff_key(k, tree);
+                if (p->tree_key < 0)
+                        return p->tree_key;
+
+                p->flat_key = diff_key(k, flat);
+                if (p->flat_key < 0)
+                        return p->flat_key;
+
+                /* a reused pid refers to the latest process that had it */
+                r = hashmap_replace(parents, INT_TO_PTR(p->pid), INT_TO_PTR(p->tree_key + 1));
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+int diff_match(struct diff_keys *k, struct diff_boot *a, struct diff_boot *b) {
+        _cleanup_free_ int *by_tree = NULL, *by_flat = NULL;
+        size_t i, n;
+        int r;
+
+        assert(k);
+        assert(a);
+        assert(b);
+
+        r = diff_keys_assign(k, a);
+        if (r < 0)
+                return r;
+
+        /* keys are unique within a boot, so each names at most one process of a */
+        n = k->keys.n_strings;
+        by_tree = new(int, n);
+        by_flat = new(int, n);
+        if (!by_tree || !by_flat)
+                return -ENOMEM;
+
+        for (i = 0; i < n; i++)
+                by_tree[i] = by_flat[i] = -1;
+
+        for (i = 0; i < a->n_processes; i++) {
+                by_tree[a->processes[i].tree_key] = i;
+                by_flat[a->processes[i].flat_key] = i;
+        }
+
+        r = diff_keys_assign(k, b);
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < b->n_processes; i++) {
+                struct diff_process *p = &b->processes[i];
+
+                if ((size_t) p->tree_key < n && by_tree[p->tree_key] >= 0) {
+                        p->match = by_tree[p->tree_key];
+                        a->processes[p->match].match = i;
+                }
+        }
+
+        /* whatever moved in the tree still has its name */
+        for (i = 0; i < b->n_processes; i++) {
+                struct diff_process *p = &b->processes[i];
+                int j;
+
+                if (p->match >= 0 || (size_t) p->flat_key >= n)
+                        continue;
+
+                j = by_flat[p->flat_key];
+                if (j >= 0 && a->processes[j].match < 0) {
+                        p->match = j;
+                        a->processes[j].match = i;
+                }
+        }
+
+        return 0;
+}
+
+void diff_keys_done(struct diff_keys *k) {
+        assert(k);
+
+        strtab_done(&k->keys);
+        k->ordinals = mfree(k->ordinals);
+        k->allocated_ordinals = k->n_ordinals = 0;
+}
+
+/* a process of either boot, or both */
+struct diff_row {
+        const struct diff_process *a;
+        const struct diff_process *b;
+        double order;
+};
+
+static double diff_row_start(const struct diff_row *r) {
+        return r->b ? r->b->start : r->a->start;
+}
+
+/* how much later the process ended, which is what makes a boot slower */
+static double diff_row_shift(const struct diff_row *r) {
+        return r->a && r->b ? r->b->end - r->a->end : 0.0;
+}
+
+static int diff_rows(const struct diff_boot *a, const struct diff_boot *b, struct diff_row **ret) {
+        struct diff_row *rows;
+        size_t i, n = 0;
+
+        rows = new(struct diff_row, a->n_processes + b->n_processes);
+        if (!rows)
+                return -ENOMEM;
+
+        for (i = 0; i < a->n_processes; i++)
+                rows[n++] = (struct diff_row) {
+                        .a = &a->processes[i],
+                        .b = a->processes[i].match >= 0 ? &b->processes[a->processes[i].match] : NULL,
+                };
+
+        for (i = 0; i < b->n_processes; i++)
+                if (b->processes[i].match < 0)
+                        rows[n++] = (struct diff_row) {
+                                .b = &b->processes[i],
+                        };
+
+        *ret = rows;
+
+        return n;
+}
+
+static int compare_rows(const void *x, const void *y) {
+        const struct diff_row *a = x, *b = y;
+
+        return a->order < b->order ? -1 : a->order > b->order;
+}
+
+static int compare_rows_by_class(const void *x, const void *y) {
+        const struct diff_row *a = x, *b = y;
+        int ca = !a->b ? 2 : !a->a, cb = !b->b ? 2 : !b->a;
+
+        /* the largest regressions first, then new, then missing processes */
+        if (ca != cb)
+                return ca - cb;
+
+        return compare_rows(x, y);
+}
+
+static const char *diff_row_status(const struct diff_row *r) {
+        return !r->a ? "new" : !r->b ? "missing" : "matched";
+}
+
+static void csv_write_process(FILE *f, const struct diff_process *p) {
+        if (p)
+                fprintf(f, ",%i,%.6f,%.6f,%.6f,%.6f", p->pid, p->start, p->end - p->start, p->cpu, p->wait);
+        else
+                fputs(",,,,,", f);
+}
+
+int diff_write_csv(FILE *f, const struct diff_boot *a, const struct diff_boot *b) {
+        _cleanup_free_ struct diff_row *rows = NULL;
+        int n, i;
+
+        assert(f);
+        assert(a);
+        assert(b);
+
+        n = diff_rows(a, b, &rows);
+        if (n < 0)
+                return n;
+
+        for (i = 0; i < n; i++)
+                rows[i].order = rows[i].a && rows[i].b ? -diff_row_shift(&rows[i]) : diff_row_start(&rows[i]);
+        qsort(rows, n, sizeof(struct diff_row), compare_rows_by_class);
+
+        fprintf(f, "# old_duration=%.6f\n# new_duration=%.6f\n", a->duration, b->duration);
+        if (a->idle >= 0.0)
+                fprintf(f, "# old_idle=%.6f\n", a->idle);
+        else
+                fputs("# old_idle=\n", f);
+        if (b->idle >= 0.0)
+                fprintf(f, "# new_idle=%.6f\n", b->idle);
+        else
+                fputs("# new_idle=\n", f);
+        if (a->idle >= 0.0 && b->idle >= 0.0)
+                fprintf(f, "# idle_delta=%.6f\n", b->idle - a->idle);
+        else
+                fputs("# idle_delta=\n", f);
+
+        fputs("status,name,cgroup,"
+              "old_pid,old_start,old_duration,old_cpu,old_wait,"
+              "new_pid,new_start,new_duration,new_cpu,new_wait,"
+              "start_shift,duration_delta,cpu_delta,wait_delta\n", f);
+
+        for (i = 0; i < n; i++) {
+                const struct diff_row *r = &rows[i];
+                const struct diff_process *p = r->b ?: r->a;
+
+                fprintf(f, "%s,", diff_row_status(r));
+                csv_write_string(f, p->name);
+                fputc(',', f);
+                csv_write_string(f, p->cgroup);
+                csv_write_process(f, r->a);
+                csv_write_process(f, r->b);
+
+                if (r->a && r->b)
+                        fprintf(f, ",%.6f,%.6f,%.6f,%.6f\n",
+                                r->b->start - r->a->start,
+                                (r->b->end - r->b->start) - (r->a->end - r->a->start),
+                                r->b->cpu - r->a->cpu,
+                                r->b->wait - r->a->wait);
+                else
+                        fputs(",,,,\n", f);
+        }
+
+        return 0;
+}
+
+static void svg_write_boot(FILE *f, double y, const char *label, const char *name, const struct diff_boot *b) {
+        fprintf(f, "<text class=\"t2\" x=\"20\" y=\"%.0f\">%s: <![CDATA[%s]]> (<![CDATA[%s]]>), %.03fs, ",
+                y, label, name, strna(b->build), b->duration);
+        if (b->idle >= 0.0)
+                fprintf(f, "idle after %.03fs</text>\n", b->idle);
+        else
+                fprintf(f, "never idle</text>\n");
+}
+
+int diff_write_svg(FILE *f, const char *a_name, const struct diff_boot *a,
+                   const char *b_name, const struct diff_boot *b) {
+        _cleanup_free_ struct diff_row *rows = NULL;
+        unsigned n_new = 0, n_missing = 0, n_slower = 0, n_faster = 0;
+        double end = 0.0, same;
+        int n, i, s;
+
+        assert(f);
+        assert(a);
+        assert(b);
+
+        n = diff_rows(a, b, &rows);
+        if (n < 0)
+                return n;
+
+        /* what moves by less than a sample interval didn't move as far as we can tell */
+        same = 1.0 / MAX(MIN(a->hz, b->hz), 1.0);
+
+        for (i = 0; i < n; i++) {
+                const struct diff_row *r = &rows[i];
+
+                rows[i].order = diff_row_start(r);
+                end = MAX(end, MAX(r->a ? r->a->end : 0.0, r->b ? r->b->end : 0.0));
+
+                if (!r->a)
+                        n_new++;
+                else if (!r->b)
+                        n_missing++;
+                else if (diff_row_shift(r) > same)
+                        n_slower++;
+                else if (diff_row_shift(r) < -same)
+                        n_faster++;
+        }
+        qsort(rows, n, sizeof(struct diff_row), compare_rows);
+
+        fprintf(f, "<?xml version=\"1.0\" standalone=\"no\"?>\n");
+        fprintf(f, "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" ");
+        fprintf(f, "\"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n");
+        fprintf(f, "<svg width=\"%.0fpx\" height=\"%.0fpx\" version=\"1.1\" xmlns=\"http://www.w3.org/2000/svg\">\n\n",
+                MAX(150.0 + 10.0 + time_to_graph(end) + 500.0, 1600.0), DIFF_TOP + DIFF_ROW * (n + 2));
+
+        fprintf(f, "<!-- This file is a bootchart diff, generated by bootchart version %s -->\n\n", VERSION);
+
+        fprintf(f, "<defs>\n  <style type=\"text/css\">\n    <![CDATA[\n");
+        fprintf(f, "      rect       { stroke-width: 1; }\n");
+        fprintf(f, "      rect.bg    { fill: rgb(255,255,255); }\n");
+        fprintf(f, "      rect.old   { fill: none; stroke: rgb(96,96,96); stroke-dasharray: 3 2; }\n");
+        fprintf(f, "      rect.same  { fill: rgb(192,192,192); stroke-width: 0; fill-opacity: 0.7; }\n");
+        fprintf(f, "      rect.slower { fill: rgb(240,64,64); stroke-width: 0; fill-opacity: 0.7; }\n");
+        fprintf(f, "      rect.faster { fill: rgb(64,176,64); stroke-width: 0; fill-opacity: 0.7; }\n");
+        fprintf(f, "      rect.new   { fill: rgb(240,176,0); stroke-width: 0; fill-opacity: 0.7; }\n");
+        fprintf(f, "      line       { stroke: rgb(64,64,64); stroke-width: 1; }\n");
+        fprintf(f, "      line.sec01 { stroke: rgb(224,224,224); stroke-width: 1; }\n");
+        fprintf(f, "      line.idle  { stroke: rgb(64,64,64); stroke-dasharray: 10 6; stroke-opacity: 0.7; }\n");
+        fprintf(f, "      line.oidle { stroke: rgb(160,160,160); stroke-dasharray: 10 6; stroke-opacity: 0.7; }\n");
+        fprintf(f, "      text       { font-family: Verdana, Helvetica; font-size: 10; }\n");
+        fprintf(f, "      text.sec   { font-size: 8; }\n");
+        fprintf(f, "      text.t1    { font-size: 24; }\n");
+        fprintf(f, "      text.t2    { font-size: 12; }\n");
+        fprintf(f, "    ]]>\n   </style>\n</defs>\n\n");
+
+        fprintf(f, "<rect class=\"bg\" width=\"100%%\" height=\"100%%\" />\n");
+        fprintf(f, "<text class=\"t1\" x=\"0\" y=\"30\">Bootchart diff</text>\n");
+        svg_write_boot(f, 50, "Old", a_name, a);
+        svg_write_boot(f, 65, "New", b_name, b);
+
+        fprintf(f, "<text class=\"t2\" x=\"20\" y=\"80\">Duration %+.03fs", b->duration - a->duration);
+        if (a->idle >= 0.0 && b->idle >= 0.0)
+                fprintf(f, ", time to idle %+.03fs", b->idle - a->idle);
+        fprintf(f, "; %u processes ended later and %u earlier by more than %.0fms, %u are new and %u missing</text>\n",
+                n_slower, n_faster, same * 1000.0, n_new, n_missing);
+        fprintf(f, "<text class=\"sec\" x=\"20\" y=\"95\">Dashed boxes are the old boot, "
+                "filled ones the new one: red ended later, green earlier, orange is new</text>\n");
+
+        fprintf(f, "<g transform=\"translate(10,%.0f)\">\n", DIFF_TOP);
+
+        for (s = 0; s <= (int) end + 1; s++) {
+                fprintf(f, "  <line class=\"sec01\" x1=\"%.03f\" y1=\"0\" x2=\"%.03f\" y2=\"%.03f\" />\n",
+                        time_to_graph(s), time_to_graph(s), DIFF_ROW * n);
+                fprintf(f, "  <text class=\"sec\" x=\"%.03f\" y=\"-3\">%ds</text>\n", time_to_graph(s), s);
+        }
+
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *escaped = NULL;
+                const struct diff_row *r = &rows[i];
+                const struct diff_process *p = r->b ?: r->a;
+                const char *name = p->name, *class;
+                double y = DIFF_ROW * i, right = 0.0;
+
+                if (!utf8_is_printable(name, strlen(name))) {
+                        escaped = utf8_escape_non_printable(name);
+                        if (escaped)
+                                name = escaped;
+                }
+
+                if (r->a) {
+                        fprintf(f, "  <rect class=\"old\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                                time_to_graph(r->a->start), y + 1.0,
+                                time_to_graph(r->a->end - r->a->start), DIFF_ROW - 2.0);
+                        right = r->a->end;
+                }
+
+                if (r->b) {
+                        if (!r->a)
+                                class = "new";
+                        else if (diff_row_shift(r) > same)
+                                class = "slower";
+                        else if (diff_row_shift(r) < -same)
+                                class = "faster";
+                        else
+                                class = "same";
+
+                        fprintf(f, "  <rect class=\"%s\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                                class, time_to_graph(r->b->start), y + 3.0,
+                                time_to_graph(r->b->end - r->b->start), DIFF_ROW - 6.0);
+                        right = MAX(right, r->b->end);
+                }
+
+                fprintf(f, "  <text x=\"%.03f\" y=\"%.03f\"><![CDATA[%s]]> ", time_to_graph(right) + 5.0, y + 12.0, name);
+                if (!r->a)
+                        fprintf(f, "new, %.03fs CPU</text>\n", r->b->cpu);
+                else if (!r->b)
+                        fprintf(f, "missing, had %.03fs CPU</text>\n", r->a->cpu);
+                else
+                        fprintf(f, "start %+.03fs, end %+.03fs, CPU %+.03fs, wait %+.03fs</text>\n",
+                                r->b->start - r->a->start, r->b->end - r->a->end,
+                                r->b->cpu - r->a->cpu, r->b->wait - r->a->wait);
+        }
+
+        if (a->idle >= 0.0)
+                fprintf(f, "  <line class=\"oidle\" x1=\"%.03f\" y1=\"0\" x2=\"%.03f\" y2=\"%.03f\" />\n",
+                        time_to_graph(a->idle), time_to_graph(a->idle), DIFF_ROW * n);
+        if (b->idle >= 0.0)
+                fprintf(f, "  <line class=\"idle\" x1=\"%.03f\" y1=\"0\" x2=\"%.03f\" y2=\"%.03f\" />\n",
+                        time_to_graph(b->idle), time_to_graph(b->idle), DIFF_ROW * n);
+
+        fprintf(f, "</g>\n</svg>\n");
+
+        return 0;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+
+#include "json.h"
+#include "strtab.h"
+
+/* a process from a --report, as JSON */
+struct diff_process {
+        int pid;
+        int ppid;
+        const char *name;
+        const char *cgroup;
+        double start;
+        double end;
+        double cpu;
+        double wait;
+
+        /* index into the key table, by tree position and by name alone */
+        int tree_key;
+        int flat_key;
+        /* the same process in the other boot, or -1 */
+        int match;
+};
+
+struct diff_boot {
+        struct json_value json;
+        const char *build;
+        double hz;
+        double duration;
+        /* < 0 when the system never went idle */
+        double idle;
+        struct diff_process *processes;
+        size_t n_processes;
+};
+
+#define DIFF_BOOT_INIT { .idle = -1.0 }
+
+/*
+ * Processes are matched in two passes, each a lookup per process:
+ * first by name, control group, and the key of the parent with an
+ * ordinal for siblings that share all of them, so the n-th udev
+ * worker of one boot is compared to the n-th one of the other. What
+ * is left unmatched is then matched by name and control group alone.
+ */
+struct diff_keys {
+        struct strtab keys;
+        /* per boot, how often a key was seen before */
+        unsigned *ordinals;
+        size_t n_ordinals;
+        size_t allocated_ordinals;
+};
+
+#define DIFF_KEYS_INIT { STRTAB_INIT }
+
+int diff_boot_load(struct diff_boot *b, const char *path);
+void diff_boot_done(struct diff_boot *b);
+
+/* sets the keys of the processes of b, which are the same for the same process in another boot */
+int diff_keys_assign(struct diff_keys *k, struct diff_boot *b);
+/* matches the processes of b against those of a, setting match in both */
+int diff_match(struct diff_keys *k, struct diff_boot *a, struct diff_boot *b);
+void diff_keys_done(struct diff_keys *k);
+
+/* writes the table and chart of what changed from a to b */
+int diff_write_csv(FILE *f, const struct diff_boot *a, const struct diff_boot *b);
+int diff_write_svg(FILE *f, const char *a_name, const struct diff_boot *a,
+                   const char *b_name, const struct diff_boot *b);
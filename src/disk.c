@@ -0,0 +1,315 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "disk.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "macro.h"
+#include "string-util.h"
+#include "util.h"
+
+static char *next_field(char **p) {
+        char *s = *p, *e;
+
+        s += strspn(s, WHITESPACE);
+        if (*s == 0)
+                return NULL;
+
+        e = s + strcspn(s, WHITESPACE);
+        if (*e != 0)
+                *(e++) = 0;
+        *p = e;
+
+        return s;
+}
+
+static int next_u64(char **p, uint64_t *ret) {
+        char *s = *p, *e;
+        unsigned long long v;
+
+        errno = 0;
+        v = strtoull(s, &e, 10);
+        if (errno > 0)
+                return -errno;
+        if (e == s)
+                return -EINVAL;
+
+        *p = e;
+        *ret = v;
+
+        return 0;
+}
+
+int disks_parse_line(char *line, char **ret_name, struct disk_sample *ret) {
+        uint64_t v[11];
+        char *p = line, *name;
+        unsigned i;
+        int r;
+
+        assert(line);
+        assert(ret_name);
+        assert(ret);
+
+        /* major, minor */
+        if (!next_field(&p) || !next_field(&p))
+                return -EINVAL;
+
+        name = next_field(&p);
+        if (!name)
+                return -EINVAL;
+
+        /* newer kernels append discard and flush counters, which we don't need */
+        for (i = 0; i < ELEMENTSOF(v); i++) {
+                r = next_u64(&p, &v[i]);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = (struct disk_sample) {
+                .rd_sectors = v[2],
+                .wr_sectors = v[6],
+                .ios = v[0] + v[4],
+                .ticks = v[3] + v[7],
+                .in_flight = (uint32_t) v[8],
+                .io_ticks = v[9],
+                .queue_ticks = v[10],
+                .valid = true,
+        };
+        *ret_name = name;
+
+        return 0;
+}
+
+int disks_open(struct disks *d, const char *diskstats, const char *sysfs) {
+        assert(d);
+
+        if (d->fd >= 0)
+                return 0;
+
+        if (!d->sysfs) {
+                d->sysfs = strdup(sysfs);
+                if (!d->sysfs)
+                        return -ENOMEM;
+        }
+
+        d->fd = open(diskstats, O_RDONLY|O_CLOEXEC);
+        if (d->fd < 0)
+                return -errno;
+
+        return 0;
+}
+
+static char *disk_label(const char *sysfs, const char *name) {
+        _cleanup_free_ char *p = NULL;
+        char *label = NULL;
+
+        /* real disks know their model, device mapper targets their name */
+        if (asprintf(&p, "%s/%s/device/model", sysfs, name) < 0)
+                return NULL;
+        if (read_one_line_file(p, &label) < 0) {
+                p = mfree(p);
+                if (asprintf(&p, "%s/%s/dm/name", sysfs, name) < 0)
+                        return NULL;
+                if (read_one_line_file(p, &label) < 0)
+                        return NULL;
+        }
+
+        strstrip(label);
+        if (isempty(label))
+                label = mfree(label);
+
+        return label;
+}
+
+static bool disk_is_partition(const char *sysfs, const char *name) {
+        _cleanup_free_ char *p = NULL;
+
+        if (asprintf(&p, "%s/%s/partition", sysfs, name) < 0)
+                return false;
+
+        return access(p, F_OK) >= 0;
+}
+
+static int disks_add(struct disks *d, const char *name) {
+        struct disk *k;
+        int r;
+
+        r = hashmap_ensure_allocated(&d->index, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        if (!GREEDY_REALLOC(d->disks, d->allocated_disks, d->n_disks + 1))
+                return -ENOMEM;
+
+        k = &d->disks[d->n_disks];
+        *k = (struct disk) {
+                .name = strdup(name),
+                .slot = -1,
+        };
+        if (!k->name)
+                return -ENOMEM;
+
+        /* ram disks and partitions would only repeat what their parent shows */
+        if (!startswith(name, "ram") && !startswith(name, "zram") && !disk_is_partition(d->sysfs, name)) {
+                k->label = disk_label(d->sysfs, name);
+                k->slot = d->n_slots;
+        }
+
+        r = hashmap_put(d->index, k->name, INT_TO_PTR(d->n_disks + 1));
+        if (r < 0) {
+                k->name = mfree(k->name);
+                k->label = mfree(k->label);
+                return r;
+        }
+
+        if (k->slot >= 0)
+                d->n_slots++;
+
+        return (int) d->n_disks++;
+}
+
+static int disks_fill(struct disks *d) {
+        ssize_t n;
+
+        if (d->size == 0) {
+                d->buf = new(char, 4096);
+                if (!d->buf)
+                        return -ENOMEM;
+                d->size = 4096;
+        }
+
+        /* one line per block device, grow until the whole file fits */
+        for (;;) {
+                char *b;
+
+                n = pread(d->fd, d->buf, d->size - 1, 0);
+                if (n < 0)
+                        return -errno;
+                if ((size_t) n < d->size - 1)
+                        break;
+
+                b = realloc(d->buf, d->size * 2);
+                if (!b)
+                        return -ENOMEM;
+                d->buf = b;
+                d->size *= 2;
+        }
+
+        d->buf[n] = 0;
+
+        return 0;
+}
+
+int disks_read(struct disks *d, struct disk_sample **ret, int *ret_n) {
+        _cleanup_free_ struct disk_sample *samples = NULL;
+        size_t allocated = 0;
+        char *line, *next;
+        int n = 0, r;
+
+        assert(d);
+        assert(ret);
+        assert(ret_n);
+
+        if (d->fd < 0)
+                return -EBADF;
+
+        r = disks_fill(d);
+        if (r < 0)
+                return r;
+
+        for (line = d->buf; line && *line; line = next) {
+                struct disk_sample s;
+                char *name;
+                void *v;
+                int i, slot;
+
+                next = strchr(line, '\n');
+                if (next)
+                        *(next++) = 0;
+
+                if (disks_parse_line(line, &name, &s) < 0)
+                        continue;
+
+                v = hashmap_get(d->index, name);
+                if (v)
+                        i = PTR_TO_INT(v) - 1;
+                else {
+                        i = disks_add(d, name);
+                        if (i < 0)
+                                return i;
+                }
+
+                slot = d->disks[i].slot;
+                if (slot < 0)
+                        continue;
+
+                if (slot >= n) {
+                        if (!GREEDY_REALLOC(samples, allocated, slot + 1))
+                                return -ENOMEM;
+                        memzero(samples + n, (slot + 1 - n) * sizeof(*samples));
+                        n = slot + 1;
+                }
+
+                samples[slot] = s;
+        }
+
+        *ret = samples;
+        *ret_n = n;
+        samples = NULL;
+
+        return 0;
+}
+
+const struct disk *disks_get_slot(const struct disks *d, int slot) {
+        size_t i;
+
+        assert(d);
+
+        for (i = 0; i < d->n_disks; i++)
+                if (d->disks[i].slot == slot)
+                        return &d->disks[i];
+
+        return NULL;
+}
+
+void disks_done(struct disks *d) {
+        size_t i;
+
+        assert(d);
+
+        for (i = 0; i < d->n_disks; i++) {
+                free(d->disks[i].name);
+                free(d->disks[i].label);
+        }
+
+        d->disks = mfree(d->disks);
+        d->n_disks = d->allocated_disks = 0;
+        d->n_slots = 0;
+        d->index = hashmap_free(d->index);
+        d->buf = mfree(d->buf);
+        d->size = 0;
+        d->sysfs = mfree(d->sysfs);
+        d->fd = safe_close(d->fd);
+}
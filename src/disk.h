@@ -0,0 +1,78 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hashmap.h"
+
+/* one line of /proc/diskstats, all counters are cumulative */
+struct disk_sample {
+        uint64_t rd_sectors;
+        uint64_t wr_sectors;
+        /* reads and writes completed */
+        uint64_t ios;
+        /* ms spent reading and writing, summed over all requests */
+        uint64_t ticks;
+        /* ms during which the device had requests in flight */
+        uint64_t io_ticks;
+        /* ms spent in queue, weighted by the number of requests */
+        uint64_t queue_ticks;
+        uint32_t in_flight;
+        bool valid;
+};
+
+struct disk {
+        char *name;
+        /* device model, or the device mapper name, if known */
+        char *label;
+        /* position in the per sample arrays, -1 for partitions */
+        int slot;
+};
+
+/*
+ * Block devices seen in /proc/diskstats. Whole disks get a slot in the
+ * per sample arrays in the order they first show up; partitions are
+ * remembered only so they are not looked up in sysfs again.
+ */
+struct disks {
+        int fd;
+        char *sysfs;
+        char *buf;
+        size_t size;
+
+        struct disk *disks;
+        size_t n_disks;
+        size_t allocated_disks;
+        int n_slots;
+        /* device name -> index + 1 */
+        Hashmap *index;
+};
+
+#define DISKS_INIT { .fd = -1 }
+
+int disks_open(struct disks *d, const char *diskstats, const char *sysfs);
+int disks_read(struct disks *d, struct disk_sample **ret, int *ret_n);
+void disks_done(struct disks *d);
+
+const struct disk *disks_get_slot(const struct disks *d, int slot);
+
+/* parses one line in place, the name is terminated inside the line */
+int disks_parse_line(char *line, char **ret_name, struct disk_sample *ret);
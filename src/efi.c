@@ -0,0 +1,158 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "efi.h"
+#include "fileio.h"
+#include "macro.h"
+#include "parse-util.h"
+#include "string-util.h"
+
+/* the vendor GUID of the boot loader interface */
+#define LOADER_GUID "4a67b082-0a4c-41cf-b6c7-440b29bb8c4f"
+
+static const char * const boot_phase_table[_BOOT_PHASE_MAX] = {
+        [BOOT_PHASE_FIRMWARE] = "firmware",
+        [BOOT_PHASE_LOADER] = "loader",
+        [BOOT_PHASE_KERNEL] = "kernel",
+        [BOOT_PHASE_USERSPACE] = "userspace",
+};
+
+const char *boot_phase_to_string(BootPhase p) {
+        if (p < 0 || p >= _BOOT_PHASE_MAX)
+                return NULL;
+
+        return boot_phase_table[p];
+}
+
+static int read_efi_usec(const char *efivars, const char *name, uint64_t *ret) {
+        _cleanup_free_ char *p = NULL, *buf = NULL;
+        char digits[DECIMAL_STR_MAX(uint64_t)];
+        size_t size, i, n = 0;
+        int r;
+
+        p = strjoin(efivars, "/", name, "-" LOADER_GUID, NULL);
+        if (!p)
+                return -ENOMEM;
+
+        r = read_full_file(p, &buf, &size);
+        if (r < 0)
+                return r;
+
+        /* 32 bit attributes, followed by the value as an UTF-16LE string */
+        for (i = 4; i + 1 < size && n < sizeof(digits) - 1; i += 2) {
+                if (buf[i + 1] != 0 || buf[i] == 0)
+                        break;
+
+                digits[n++] = buf[i];
+        }
+        digits[n] = 0;
+
+        return safe_atou64(digits, ret);
+}
+
+static int read_fpdt_usec(const char *fpdt, const char *name, uint64_t *ret) {
+        _cleanup_free_ char *p = NULL, *line = NULL;
+        uint64_t ns;
+        int r;
+
+        p = strjoin(fpdt, "/", name, NULL);
+        if (!p)
+                return -ENOMEM;
+
+        r = read_one_line_file(p, &line);
+        if (r < 0)
+                return r;
+
+        r = safe_atou64(line, &ns);
+        if (r < 0)
+                return r;
+
+        *ret = ns / 1000;
+        return 0;
+}
+
+int boot_times_read(const char *efivars, const char *fpdt, struct boot_times *ret) {
+        struct boot_times b = {};
+
+        assert(ret);
+
+        /* everything is optional, any of it may be missing or unreadable */
+        if (efivars) {
+                (void) read_efi_usec(efivars, "LoaderTimeInitUSec", &b.loader_start);
+                (void) read_efi_usec(efivars, "LoaderTimeExecUSec", &b.loader_exec);
+        }
+
+        if (fpdt) {
+                (void) read_fpdt_usec(fpdt, "firmware_start_ns", &b.firmware_start);
+                if (b.loader_start == 0)
+                        (void) read_fpdt_usec(fpdt, "bootloader_launch_ns", &b.loader_start);
+                (void) read_fpdt_usec(fpdt, "exitbootservice_end_ns", &b.kernel_start);
+        }
+
+        if (b.loader_exec == 0)
+                b.loader_exec = b.kernel_start;
+        if (b.kernel_start < b.loader_exec)
+                b.kernel_start = b.loader_exec;
+        if (b.firmware_start > b.loader_start)
+                b.firmware_start = 0;
+
+        if (b.loader_start == 0 || b.loader_exec < b.loader_start)
+                return -ENODATA;
+
+        *ret = b;
+        return 0;
+}
+
+bool boot_times_phases(const struct boot_times *b,
+                       struct ps_struct *ps_first,
+                       double graph_start,
+                       double ready,
+                       double start[_BOOT_PHASE_MAX],
+                       double end[_BOOT_PHASE_MAX]) {
+
+        struct ps_struct *ps;
+        double k, init = -1.0;
+
+        if (!b || b->kernel_start == 0)
+                return false;
+
+        k = b->kernel_start / 1000000.0;
+
+        start[BOOT_PHASE_FIRMWARE] = b->firmware_start / 1000000.0 - k;
+        end[BOOT_PHASE_FIRMWARE] = start[BOOT_PHASE_LOADER] = b->loader_start / 1000000.0 - k;
+        end[BOOT_PHASE_LOADER] = start[BOOT_PHASE_KERNEL] = b->loader_exec / 1000000.0 - k;
+
+        /* the kernel ends where init starts, which is the first thing we see of userspace */
+        for (ps = ps_first->next_ps; ps; ps = ps->next_ps)
+                if (ps->pid == 1) {
+                        init = ps->starttime;
+                        break;
+                }
+        if (init <= 0.0 && ps_first->next_ps)
+                init = ps_first->next_ps->first->sampledata->sampletime - graph_start;
+
+        end[BOOT_PHASE_KERNEL] = start[BOOT_PHASE_USERSPACE] = MAX(init, 0.0);
+        end[BOOT_PHASE_USERSPACE] = MAX(ready, end[BOOT_PHASE_KERNEL]);
+
+        return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bootchart.h"
+#include "macro.h"
+
+typedef enum BootPhase {
+        BOOT_PHASE_FIRMWARE,
+        BOOT_PHASE_LOADER,
+        BOOT_PHASE_KERNEL,
+        BOOT_PHASE_USERSPACE,
+        _BOOT_PHASE_MAX,
+        _BOOT_PHASE_INVALID = -1,
+} BootPhase;
+
+/* microseconds since the firmware came out of reset, 0 when not known */
+struct boot_times {
+        uint64_t firmware_start;
+        uint64_t loader_start;
+        uint64_t loader_exec;
+        /* when the kernel took over from the EFI boot services */
+        uint64_t kernel_start;
+};
+
+/* reads the boot loader interface variables and the ACPI FPDT boot record */
+int boot_times_read(const char *efivars, const char *fpdt, struct boot_times *ret);
+
+/*
+ * start and end of each phase in seconds since the kernel started, the
+ * pre-boot phases are negative; false when no pre-boot times are known
+ */
+bool boot_times_phases(const struct boot_times *b,
+                       struct ps_struct *ps_first,
+                       double graph_start,
+                       double ready,
+                       double start[_BOOT_PHASE_MAX],
+                       double end[_BOOT_PHASE_MAX]);
+
+const char *boot_phase_to_string(BootPhase p) _const_;
@@ -0,0 +1,93 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include "governor.h"
+
+/* samples the smoothed share needs to follow a change of level */
+#define GOVERNOR_SETTLE 8
+
+/*
+ * Each level at most halves the cost of one part of a sample, so going
+ * back up is safe once the share is below half the maximum.
+ */
+static const struct {
+        struct governor_rates rates;
+        const char *name;
+} governor_table[] = {
+        { { 1, 1, 1 }, "everything in every sample" },
+        { { 2, 1, 1 }, "PSS, threads and command lines every 2nd sample" },
+        { { 4, 1, 1 }, "PSS, threads and command lines every 4th sample" },
+        { { 8, 1, 1 }, "PSS, threads and command lines every 8th sample" },
+        { { 8, 2, 1 }, "processes every 2nd sample" },
+        { { 8, 4, 1 }, "processes every 4th sample" },
+        { { 8, 4, 2 }, "one sample per 2 intervals" },
+        { { 8, 4, 4 }, "one sample per 4 intervals" },
+        { { 8, 4, 8 }, "one sample per 8 intervals" },
+};
+
+const struct governor_rates *governor_rates(int level) {
+        if (level < 0 || level >= (int) ELEMENTSOF(governor_table))
+                level = 0;
+
+        return &governor_table[level].rates;
+}
+
+const char *governor_level_to_string(int level) {
+        if (level < 0 || level >= (int) ELEMENTSOF(governor_table))
+                return NULL;
+
+        return governor_table[level].name;
+}
+
+int governor_max_level(void) {
+        return ELEMENTSOF(governor_table) - 1;
+}
+
+bool governor_update(struct governor *g, nsec_t cpu, double interval) {
+        double share;
+
+        assert(g);
+
+        if (g->max_share <= 0.0 || interval <= 0.0)
+                return false;
+
+        /* the first sample opens every file, it says little about the ones after it */
+        if (g->n_samples++ == 0)
+                return false;
+
+        share = cpu / (interval * governor_rates(g->level)->interval);
+        if (g->n_samples == 2)
+                g->share = share;
+        else
+                g->share = g->share * 0.75 + share * 0.25;
+
+        if (g->settle > 0) {
+                g->settle--;
+                return false;
+        }
+
+        if (g->share > g->max_share && g->level < governor_max_level())
+                g->level++;
+        else if (g->share < g->max_share / 2 && g->level > 0)
+                g->level--;
+        else
+                return false;
+
+        g->settle = GOVERNOR_SETTLE;
+
+        return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+
+#include "macro.h"
+#include "time-util.h"
+
+/*
+ * How often each part of a sample is taken at a level of the governor,
+ * in samples: 1 is every sample, 2 every other sample and so on.
+ */
+struct governor_rates {
+        /* PSS, the threads of each process and their command lines */
+        unsigned expensive;
+        /* the schedstat of each process */
+        unsigned processes;
+        /* the sample interval, as a multiple of the one asked for */
+        unsigned interval;
+};
+
+/*
+ * Keeps the CPU time spent sampling below a share of the sample
+ * interval. When it is exceeded, the expensive probes are taken less
+ * often first, then the processes, then everything; when sampling
+ * gets cheap again, the levels are climbed back one at a time.
+ */
+struct governor {
+        /* of the sample interval, 0 to never leave level 0 */
+        double max_share;
+        int level;
+        /* smoothed share of the interval spent sampling */
+        double share;
+        /* samples to wait before changing the level again */
+        int settle;
+        unsigned n_samples;
+};
+
+#define GOVERNOR_INIT(max) { .max_share = (max) }
+
+const struct governor_rates *governor_rates(int level) _const_;
+const char *governor_level_to_string(int level) _const_;
+int governor_max_level(void) _const_;
+
+/*
+ * Feeds the CPU time the last sample took, returns true if the level
+ * changed and applies to the next sample.
+ */
+bool governor_update(struct governor *g, nsec_t cpu, double interval);
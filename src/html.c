@@ -0,0 +1,398 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+/*
+ * Self-contained HTML viewer. The sample data is embedded as base64
+ * encoded little endian typed arrays, and a small canvas renderer only
+ * paints the rows and samples inside the visible window, so even
+ * recordings with tens of thousands of processes open instantly. Rows
+ * are the same processes, in the same order, as in the SVG.
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "bootchart.h"
+#include "hashmap.h"
+#include "html.h"
+#include "json.h"
+#include "list.h"
+#include "macro.h"
+#include "svg.h"
+#include "util.h"
+
+struct html_buf {
+        uint8_t *data;
+        size_t size;
+        size_t allocated;
+};
+
+static int buf_append(struct html_buf *b, const void *p, size_t l) {
+        if (!GREEDY_REALLOC(b->data, b->allocated, b->size + l))
+                return -ENOMEM;
+
+        memcpy(b->data + b->size, p, l);
+        b->size += l;
+        return 0;
+}
+
+static int buf_append_u32(struct html_buf *b, uint32_t v) {
+        v = htole32(v);
+        return buf_append(b, &v, sizeof(v));
+}
+
+static int buf_append_f64(struct html_buf *b, double d) {
+        uint64_t v;
+
+        memcpy(&v, &d, sizeof(v));
+        v = htole64(v);
+        return buf_append(b, &v, sizeof(v));
+}
+
+static uint8_t to_level(double fraction) {
+        if (!(fraction > 0.0))
+                return 0;
+        if (fraction >= 1.0)
+                return 255;
+        return (uint8_t) (fraction * 255.0 + 0.5);
+}
+
+static void write_array(FILE *of, const char *name, const struct html_buf *b) {
+        fprintf(of, ",\n\"%s\":", name);
+        json_write_base64(of, b->data, b->size);
+}
+
+static const char html_head[] =
+        "<!DOCTYPE html>\n"
+        "<html>\n"
+        "<head>\n"
+        "<meta charset=\"utf-8\">\n"
+        "<title>Bootchart</title>\n"
+        "<style>\n"
+        "  html, body { margin: 0; height: 100%; overflow: hidden; font: 11px Verdana, Helvetica, sans-serif; }\n"
+        "  canvas { display: block; cursor: grab; }\n"
+        "  #tip { position: fixed; pointer-events: none; background: rgba(255,255,224,0.95);\n"
+        "         border: 1px solid #888; padding: 2px 4px; display: none; white-space: pre; }\n"
+        "  #help { position: fixed; right: 8px; top: 4px; color: #666; }\n"
+        "</style>\n"
+        "</head>\n"
+        "<body>\n"
+        "<canvas id=\"chart\"></canvas>\n"
+        "<div id=\"tip\"></div>\n"
+        "<div id=\"help\">wheel: zoom &middot; drag / shift+wheel: pan &middot; 0: reset</div>\n"
+        "<script id=\"bootchart-data\" type=\"application/json\">\n";
+
+static const char html_tail[] =
+        "</script>\n"
+        "<script>\n"
+        "\"use strict\";\n"
+        "const D = JSON.parse(document.getElementById('bootchart-data').textContent);\n"
+        "function dec(s, T) {\n"
+        "  const b = atob(s), u = new Uint8Array(b.length);\n"
+        "  for (let i = 0; i < b.length; i++) u[i] = b.charCodeAt(i);\n"
+        "  return new T(u.buffer);\n"
+        "}\n"
+        "const time = dec(D.time, Float64Array), scpu = dec(D.cpu, Uint8Array), swait = dec(D.wait, Uint8Array);\n"
+        "const pid = dec(D.pid, Int32Array), parent = dec(D.parent, Int32Array);\n"
+        "const start = dec(D.start, Uint32Array), len = dec(D.len, Uint32Array);\n"
+        "const pcpu = dec(D.pcpu, Uint8Array), pwait = dec(D.pwait, Uint8Array);\n"
+        "const names = D.names, rows = names.length, off = new Uint32Array(rows + 1);\n"
+        "for (let r = 0; r < rows; r++) off[r + 1] = off[r] + len[r];\n"
+        "const ROW = 16, HEAD = 40, SYS = 50, TOP = HEAD + SYS + 20;\n"
+        "const tend = time.length ? time[time.length - 1] : 1;\n"
+        "const cv = document.getElementById('chart'), ctx = cv.getContext('2d'), tip = document.getElementById('tip');\n"
+        "let t0 = 0, t1 = tend, y0 = 0, W = 0, H = 0, pending = false;\n"
+        "function X(t) { return (t - t0) / (t1 - t0) * W; }\n"
+        "function T(x) { return t0 + x / W * (t1 - t0); }\n"
+        "function lower(t) {\n"
+        "  let a = 0, b = time.length;\n"
+        "  while (a < b) { const m = (a + b) >> 1; if (time[m] < t) a = m + 1; else b = m; }\n"
+        "  return a;\n"
+        "}\n"
+        "function bars(y, h, a, n, s, v, color) {\n"
+        "  ctx.fillStyle = color;\n"
+        "  const i0 = Math.max(lower(t0) - s - 1, 0), i1 = Math.min(lower(t1) - s + 1, n);\n"
+        "  for (let i = i0; i < i1; i++) {\n"
+        "    const l = v[a + i];\n"
+        "    if (l < 26) continue;\n"
+        "    const x = X(time[s + i]), w = Math.max(X(time[s + i + 1]) - x, 0.5), bh = h * l / 255;\n"
+        "    ctx.fillRect(x, y + h - bh, w, bh);\n"
+        "  }\n"
+        "}\n"
+        "function draw() {\n"
+        "  pending = false;\n"
+        "  const dpr = window.devicePixelRatio || 1;\n"
+        "  W = window.innerWidth; H = window.innerHeight;\n"
+        "  cv.width = W * dpr; cv.height = H * dpr; cv.style.width = W + 'px'; cv.style.height = H + 'px';\n"
+        "  ctx.setTransform(dpr, 0, 0, dpr, 0, 0);\n"
+        "  ctx.fillStyle = '#fff'; ctx.fillRect(0, 0, W, H);\n"
+        "  ctx.fillStyle = '#000'; ctx.font = '16px Verdana, Helvetica, sans-serif';\n"
+        "  ctx.fillText('Bootchart - ' + D.meta.build + ' - ' + rows + ' processes, ' + D.meta.cpus + ' CPUs', 8, 22);\n"
+        "  ctx.font = '11px Verdana, Helvetica, sans-serif';\n"
+        "  /* time grid, about one line per 100px */\n"
+        "  let step = Math.pow(10, Math.floor(Math.log10((t1 - t0) / W * 100)));\n"
+        "  if ((t1 - t0) / step > W / 40) step *= 5; else if ((t1 - t0) / step > W / 80) step *= 2;\n"
+        "  ctx.strokeStyle = '#e0e0e0'; ctx.fillStyle = '#444';\n"
+        "  for (let t = Math.ceil(t0 / step) * step; t <= t1; t += step) {\n"
+        "    const x = Math.round(X(t)) + 0.5;\n"
+        "    ctx.beginPath(); ctx.moveTo(x, HEAD); ctx.lineTo(x, H); ctx.stroke();\n"
+        "    ctx.fillText(t.toFixed(step < 0.01 ? 3 : step < 1 ? 2 : 1) + 's', x + 2, HEAD - 4);\n"
+        "  }\n"
+        "  /* overall cpu (blue) over wait (yellow) */\n"
+        "  bars(HEAD, SYS, 0, time.length - 1, 0, swait, 'rgba(240,240,0,0.7)');\n"
+        "  bars(HEAD, SYS, 0, time.length - 1, 0, scpu, 'rgba(64,64,240,0.7)');\n"
+        "  ctx.save(); ctx.beginPath(); ctx.rect(0, TOP, W, H - TOP); ctx.clip();\n"
+        "  const r0 = Math.max(Math.floor(y0 / ROW), 0), r1 = Math.min(Math.ceil((y0 + H - TOP) / ROW), rows);\n"
+        "  for (let r = r0; r < r1; r++) {\n"
+        "    const y = TOP + r * ROW - y0, s = start[r], n = len[r];\n"
+        "    const xs = X(time[s]), xe = X(time[s + n]);\n"
+        "    if (xe >= 0 && xs <= W) {\n"
+        "      ctx.fillStyle = 'rgba(192,192,192,0.7)'; ctx.fillRect(xs, y, Math.max(xe - xs, 1), ROW);\n"
+        "      ctx.strokeStyle = '#808080'; ctx.strokeRect(xs + 0.5, y + 0.5, Math.max(xe - xs, 1), ROW);\n"
+        "      bars(y, ROW, off[r], n, s, pwait, 'rgba(240,240,0,0.7)');\n"
+        "      bars(y, ROW, off[r], n, s, pcpu, 'rgba(64,64,240,0.7)');\n"
+        "    }\n"
+        "    if (parent[r] >= 0) {\n"
+        "      const px = X(time[start[parent[r]]]), py = TOP + parent[r] * ROW - y0 + ROW;\n"
+        "      ctx.strokeStyle = '#404040'; ctx.setLineDash([2, 4]); ctx.beginPath();\n"
+        "      ctx.moveTo(xs, y + ROW / 2); ctx.lineTo(px, y + ROW / 2); ctx.lineTo(px, Math.max(py, TOP));\n"
+        "      ctx.stroke(); ctx.setLineDash([]);\n"
+        "    }\n"
+        "    ctx.fillStyle = '#000';\n"
+        "    ctx.fillText(names[r] + ' [' + pid[r] + ']', Math.max(xe - xs < 150 ? xe + 4 : xs + 4, 4), y + ROW - 4);\n"
+        "  }\n"
+        "  ctx.restore();\n"
+        "}\n"
+        "function redraw() { if (!pending) { pending = true; requestAnimationFrame(draw); } }\n"
+        "function clampY() { y0 = Math.min(Math.max(y0, 0), Math.max(rows * ROW - (H - TOP), 0)); }\n"
+        "function zoom(x, f) {\n"
+        "  const t = T(x), span = Math.min(Math.max((t1 - t0) * f, 0.001), tend * 2);\n"
+        "  t0 = t - (x / W) * span; t1 = t0 + span; redraw();\n"
+        "}\n"
+        "cv.addEventListener('wheel', e => {\n"
+        "  e.preventDefault();\n"
+        "  if (e.shiftKey) { y0 += e.deltaY; clampY(); redraw(); }\n"
+        "  else zoom(e.offsetX, Math.exp(e.deltaY * 0.002));\n"
+        "}, { passive: false });\n"
+        "let drag = null;\n"
+        "cv.addEventListener('mousedown', e => { drag = { x: e.clientX, y: e.clientY, t0: t0, t1: t1, y0: y0 }; cv.style.cursor = 'grabbing'; });\n"
+        "window.addEventListener('mouseup', () => { drag = null; cv.style.cursor = 'grab'; });\n"
+        "window.addEventListener('mousemove', e => {\n"
+        "  if (drag) {\n"
+        "    const dt = (e.clientX - drag.x) / W * (drag.t1 - drag.t0);\n"
+        "    t0 = drag.t0 - dt; t1 = drag.t1 - dt; y0 = drag.y0 - (e.clientY - drag.y); clampY(); redraw();\n"
+        "    tip.style.display = 'none'; return;\n"
+        "  }\n"
+        "  const r = Math.floor((e.clientY - TOP + y0) / ROW);\n"
+        "  if (e.clientY < TOP || r < 0 || r >= rows) { tip.style.display = 'none'; return; }\n"
+        "  const t = T(e.clientX), i = lower(t) - 1 - start[r];\n"
+        "  let txt = names[r] + ' [' + pid[r] + ']\\n' + time[start[r]].toFixed(3) + 's - ' + time[start[r] + len[r]].toFixed(3) + 's';\n"
+        "  if (i >= 0 && i < len[r]) txt += '\\ncpu ' + Math.round(pcpu[off[r] + i] / 2.55) + '%  wait ' + Math.round(pwait[off[r] + i] / 2.55) + '%';\n"
+        "  tip.textContent = txt; tip.style.display = 'block';\n"
+        "  tip.style.left = (e.clientX + 12) + 'px'; tip.style.top = (e.clientY + 12) + 'px';\n"
+        "});\n"
+        "window.addEventListener('keydown', e => {\n"
+        "  if (e.key === '0') { t0 = 0; t1 = tend; y0 = 0; redraw(); }\n"
+        "  else if (e.key === '+' || e.key === '=') zoom(W / 2, 0.5);\n"
+        "  else if (e.key === '-') zoom(W / 2, 2);\n"
+        "  else if (e.key === 'PageDown' || e.key === 'ArrowDown') { y0 += e.key === 'PageDown' ? H - TOP : ROW; clampY(); redraw(); }\n"
+        "  else if (e.key === 'PageUp' || e.key === 'ArrowUp') { y0 -= e.key === 'PageUp' ? H - TOP : ROW; clampY(); redraw(); }\n"
+        "});\n"
+        "window.addEventListener('resize', redraw);\n"
+        "redraw();\n"
+        "</script>\n"
+        "</body>\n"
+        "</html>\n";
+
+int html_do(FILE *of,
+            const char *build,
+            struct list_sample_data *head,
+            struct ps_struct *ps_first,
+            const struct kmsg *kmsg,
+            int n_cpus,
+            double graph_start) {
+
+        _cleanup_free_ int *sample_index = NULL;
+        _cleanup_(hashmap_freep) Hashmap *rows = NULL;
+        struct html_buf time = {}, cpu = {}, wait = {};
+        struct html_buf pid = {}, parent = {}, start = {}, len = {};
+        struct html_buf pcpu = {}, pwait = {};
+        struct list_sample_data *sampledata, *prev_sampledata;
+        struct ps_struct *ps;
+        int n_samples = 0, n_rows = 0, max_counter = 0, r = -ENOMEM;
+
+        LIST_FIND_TAIL(link, head, head);
+
+        /* samples are addressed by their position in the recording */
+        for (sampledata = head; sampledata; sampledata = sampledata->link_prev)
+                max_counter = MAX(max_counter, sampledata->counter);
+
+        sample_index = new(int, max_counter + 1);
+        if (!sample_index)
+                return -ENOMEM;
+
+        prev_sampledata = head;
+        for (sampledata = head; sampledata; sampledata = sampledata->link_prev) {
+                double trt = 0.0, twt = 0.0, dt;
+                int c;
+
+                sample_index[sampledata->counter] = n_samples++;
+
+                dt = sampledata->sampletime - prev_sampledata->sampletime;
+                for (c = 0; c < n_cpus; c++) {
+                        trt += sampledata->runtime[c] - prev_sampledata->runtime[c];
+                        twt += sampledata->waittime[c] - prev_sampledata->waittime[c];
+                }
+
+                if (buf_append_f64(&time, sampledata->sampletime - graph_start) < 0)
+                        goto finish;
+
+                /* the value of an interval is stored at the index it starts at */
+                if (sampledata != head) {
+                        uint8_t l;
+
+                        l = to_level(dt > 0.0 && n_cpus > 0 ? trt / 1000000000.0 / dt / n_cpus : 0.0);
+                        if (buf_append(&cpu, &l, 1) < 0)
+                                goto finish;
+
+                        l = to_level(dt > 0.0 && n_cpus > 0 ? twt / 1000000000.0 / dt / n_cpus : 0.0);
+                        if (buf_append(&wait, &l, 1) < 0)
+                                goto finish;
+                }
+
+                prev_sampledata = sampledata;
+        }
+
+        rows = hashmap_new(&trivial_hash_ops);
+        if (!rows)
+                goto finish;
+
+        ps = ps_first;
+        while ((ps = get_next_ps(ps, ps_first))) {
+                struct ps_sched_struct *sample;
+                struct ps_struct *p;
+                int s, e, row_parent = -1;
+                size_t base;
+
+                if (ps_filter(ps))
+                        continue;
+
+                /* hook up to the nearest painted ancestor, like the SVG does */
+                for (p = ps->parent; p; p = p->parent) {
+                        void *v;
+
+                        v = hashmap_get(rows, p);
+                        if (v) {
+                                row_parent = PTR_TO_INT(v) - 1;
+                                break;
+                        }
+                }
+
+                s = sample_index[ps->first->sampledata->counter];
+                e = sample_index[ps->last->sampledata->counter];
+
+                if (hashmap_put(rows, ps, INT_TO_PTR(n_rows + 1)) < 0 ||
+                    buf_append_u32(&pid, ps->pid) < 0 ||
+                    buf_append_u32(&parent, (uint32_t) row_parent) < 0 ||
+                    buf_append_u32(&start, s) < 0 ||
+                    buf_append_u32(&len, e - s) < 0)
+                        goto finish;
+
+                base = pcpu.size;
+                if (!GREEDY_REALLOC(pcpu.data, pcpu.allocated, base + e - s) ||
+                    !GREEDY_REALLOC(pwait.data, pwait.allocated, base + e - s))
+                        goto finish;
+                memzero(pcpu.data + base, e - s);
+                memzero(pwait.data + base, e - s);
+                pcpu.size = pwait.size = base + e - s;
+
+                for (sample = ps->first; sample->next; sample = sample->next) {
+                        struct ps_sched_struct *next = sample->next;
+                        double dt;
+                        uint8_t lc, lw;
+                        int a, b, i;
+
+                        a = sample_index[sample->sampledata->counter];
+                        b = sample_index[next->sampledata->counter];
+                        dt = next->sampledata->sampletime - sample->sampledata->sampletime;
+                        if (b <= a || dt <= 0.0)
+                                continue;
+
+                        lc = to_level((next->runtime - sample->runtime) / 1000000000.0 / dt);
+                        lw = to_level((next->waittime - sample->waittime) / 1000000000.0 / dt);
+
+                        /* missed samples in between get the average of the whole gap */
+                        for (i = a; i < b; i++) {
+                                pcpu.data[base + i - s] = lc;
+                                pwait.data[base + i - s] = lw;
+                        }
+                }
+
+                n_rows++;
+        }
+
+        fputs(html_head, of);
+
+        fputs("{\"meta\":{\"build\":", of);
+        json_write_string(of, build);
+        fprintf(of, ",\"version\":\"%s\",\"hz\":%g,\"cpus\":%i,\"samples\":%i},\n\"names\":[",
+                VERSION, arg_hz, n_cpus, n_samples);
+
+        n_rows = 0;
+        ps = ps_first;
+        while ((ps = get_next_ps(ps, ps_first))) {
+                if (ps_filter(ps))
+                        continue;
+
+                if (n_rows++ > 0)
+                        fputc(',', of);
+                json_write_string(of, ps_name(ps));
+        }
+        fputc(']', of);
+
+        write_array(of, "time", &time);
+        write_array(of, "cpu", &cpu);
+        write_array(of, "wait", &wait);
+        write_array(of, "pid", &pid);
+        write_array(of, "parent", &parent);
+        write_array(of, "start", &start);
+        write_array(of, "len", &len);
+        write_array(of, "pcpu", &pcpu);
+        write_array(of, "pwait", &pwait);
+        fputs("}\n", of);
+
+        fputs(html_tail, of);
+
+        r = 0;
+
+finish:
+        free(time.data);
+        free(cpu.data);
+        free(wait.data);
+        free(pid.data);
+        free(parent.data);
+        free(start.data);
+        free(len.data);
+        free(pcpu.data);
+        free(pwait.data);
+
+        return r;
+}
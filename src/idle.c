@@ -0,0 +1,100 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include "idle.h"
+#include "macro.h"
+#include "time-util.h"
+
+static double sample_runtime(const struct list_sample_data *s, int n_cpus) {
+        double runtime = 0.0;
+        int c;
+
+        for (c = 0; c < n_cpus; c++)
+                runtime += s->runtime[c];
+
+        return runtime;
+}
+
+/* self is what the samples from start up to, but without, end cost */
+static bool window_idle(const struct list_sample_data *start, const struct list_sample_data *end,
+                        double runtime_start, double runtime_end, double self, double threshold) {
+        double busy = runtime_end - runtime_start;
+
+        /* without schedstat, nothing ever seems to run */
+        if (busy <= 0.0)
+                return false;
+
+        return busy - self < threshold * (end->sampletime - start->sampletime) * NSEC_PER_SEC;
+}
+
+double idle_find(const struct list_sample_data *first, int n_cpus, double graph_start,
+                 double window, double threshold) {
+        const struct list_sample_data *start, *end = first;
+        double runtime_start, runtime_end = 0.0;
+        double self = 0.0;
+
+        if (!first || window <= 0.0)
+                return -1.0;
+
+        runtime_start = sample_runtime(first, n_cpus);
+
+        for (start = first; start; start = start->link_prev) {
+                bool moved = false;
+
+                /* what a sample costs is spent after its sampletime, so it counts until the next one */
+                while (end && end->sampletime - start->sampletime < window) {
+                        self += end->overhead.cpu;
+                        end = end->link_prev;
+                        moved = true;
+                }
+
+                if (!end)
+                        break;
+
+                if (moved)
+                        runtime_end = sample_runtime(end, n_cpus);
+
+                if (window_idle(start, end, runtime_start, runtime_end, self, threshold))
+                        return start->sampletime - graph_start;
+
+                self -= start->overhead.cpu;
+                if (start->link_prev)
+                        runtime_start = sample_runtime(start->link_prev, n_cpus);
+        }
+
+        return -1.0;
+}
+
+bool idle_recent(const struct list_sample_data *last, int n_cpus, double window, double threshold) {
+        const struct list_sample_data *start = last;
+        double self = 0.0;
+
+        assert(last);
+
+        if (window <= 0.0)
+                return false;
+
+        while (last->sampletime - start->sampletime < window) {
+                start = start->link_next;
+                if (!start)
+                        return false;
+
+                self += start->overhead.cpu;
+        }
+
+        return window_idle(start, last, sample_runtime(start, n_cpus), sample_runtime(last, n_cpus), self, threshold);
+}
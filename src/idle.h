@@ -0,0 +1,43 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+
+#include "bootchart.h"
+
+/*
+ * The system is idle over a window of time when all CPUs together ran
+ * anything but bootchart for less than a share of one CPU. What
+ * bootchart cost is what its samples measured themselves; a replay
+ * doesn't know that, so there bootchart counts as busy too.
+ *
+ * The runtime of the CPUs is a running total already, and so is what
+ * the samples in a window cost, so both functions look at each sample
+ * at most twice, whatever the size of the window.
+ */
+
+/*
+ * Seconds after graph_start at which the first idle window begins,
+ * starting from the oldest sample, or < 0 if the system never went idle.
+ */
+double idle_find(const struct list_sample_data *first, int n_cpus, double graph_start,
+                 double window, double threshold);
+
+/* true if the window that ends with the newest sample was idle */
+bool idle_recent(const struct list_sample_data *last, int n_cpus, double window, double threshold);
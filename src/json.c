@@ -0,0 +1,403 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "json.h"
+#include "string-util.h"
+#include "utf8.h"
+
+/* reports nest three deep, anything much deeper isn't one */
+#define JSON_DEPTH_MAX 32
+
+void json_write_string(FILE *f, const char *s) {
+        _cleanup_free_ char *escaped = NULL;
+        const unsigned char *p;
+
+        if (!s) {
+                fputs("null", f);
+                return;
+        }
+
+        /* JSON must be valid UTF-8, process names don't have to be */
+        if (!utf8_is_valid(s)) {
+                escaped = utf8_escape_invalid(s);
+                if (escaped)
+                        s = escaped;
+        }
+
+        fputc('"', f);
+
+        for (p = (const unsigned char *) s; *p; p++) {
+                switch (*p) {
+                case '"':
+                        fputs("\\\"", f);
+                        break;
+                case '\\':
+                        fputs("\\\\", f);
+                        break;
+                case '\n':
+                        fputs("\\n", f);
+                        break;
+                case '\t':
+                        fputs("\\t", f);
+                        break;
+                case '<':
+                        /* keep "</script>" from ending an embedding HTML script block */
+                        fputs("\\u003c", f);
+                        break;
+                default:
+                        if (*p < 0x20)
+                                fprintf(f, "\\u%04x", *p);
+                        else
+                                fputc(*p, f);
+                }
+        }
+
+        fputc('"', f);
+}
+
+void json_write_base64(FILE *f, const void *p, size_t l) {
+        static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        const uint8_t *x = p;
+        size_t i;
+
+        fputc('"', f);
+
+        for (i = 0; i + 2 < l; i += 3) {
+                fputc(table[x[i] >> 2], f);
+                fputc(table[((x[i] & 3) << 4) | (x[i+1] >> 4)], f);
+                fputc(table[((x[i+1] & 15) << 2) | (x[i+2] >> 6)], f);
+                fputc(table[x[i+2] & 63], f);
+        }
+
+        if (l - i == 1) {
+                fputc(table[x[i] >> 2], f);
+                fputc(table[(x[i] & 3) << 4], f);
+                fputs("==", f);
+        } else if (l - i == 2) {
+                fputc(table[x[i] >> 2], f);
+                fputc(table[((x[i] & 3) << 4) | (x[i+1] >> 4)], f);
+                fputc(table[(x[i+1] & 15) << 2], f);
+                fputc('=', f);
+        }
+
+        fputc('"', f);
+}
+
+static void json_skip_space(const char **p) {
+        *p += strspn(*p, " \t\r\n");
+}
+
+static size_t json_encode_utf8(char *out, char32_t c) {
+        if (c < 0x80) {
+                out[0] = c;
+                return 1;
+        }
+        if (c < 0x800) {
+                out[0] = 0xc0 | (c >> 6);
+                out[1] = 0x80 | (c & 0x3f);
+                return 2;
+        }
+        if (c < 0x10000) {
+                out[0] = 0xe0 | (c >> 12);
+                out[1] = 0x80 | ((c >> 6) & 0x3f);
+                out[2] = 0x80 | (c & 0x3f);
+                return 3;
+        }
+
+        out[0] = 0xf0 | (c >> 18);
+        out[1] = 0x80 | ((c >> 12) & 0x3f);
+        out[2] = 0x80 | ((c >> 6) & 0x3f);
+        out[3] = 0x80 | (c & 0x3f);
+        return 4;
+}
+
+static int json_parse_hex4(const char *p, char16_t *ret) {
+        static const char hex[] = "0123456789abcdef";
+        char16_t c = 0;
+        int i;
+
+        for (i = 0; i < 4; i++) {
+                const char *x;
+
+                x = p[i] ? strchr(hex, tolower(p[i])) : NULL;
+                if (!x)
+                        return -EBADMSG;
+                c = (c << 4) | (x - hex);
+        }
+
+        *ret = c;
+        return 0;
+}
+
+static int json_parse_string(const char **p, char **ret) {
+        _cleanup_free_ char *s = NULL;
+        const char *q = *p + 1, *e;
+        size_t n = 0;
+
+        assert(**p == '"');
+
+        /* escapes only ever get shorter, so the raw length is enough */
+        for (e = q; *e && *e != '"'; e++)
+                if (*e == '\\' && e[1])
+                        e++;
+
+        s = new(char, e - q + 1);
+        if (!s)
+                return -ENOMEM;
+
+        for (;;) {
+                char16_t u, trail;
+                char32_t c;
+
+                if (*q == '\0' || (unsigned char) *q < 0x20)
+                        return -EBADMSG;
+                if (*q == '"')
+                        break;
+                if (*q != '\\') {
+                        s[n++] = *q++;
+                        continue;
+                }
+
+                q++;
+                switch (*q) {
+                case '"':
+                case '\\':
+                case '/':
+                        s[n++] = *q;
+                        break;
+                case 'b':
+                        s[n++] = '\b';
+                        break;
+                case 'f':
+                        s[n++] = '\f';
+                        break;
+                case 'n':
+                        s[n++] = '\n';
+                        break;
+                case 'r':
+                        s[n++] = '\r';
+                        break;
+                case 't':
+                        s[n++] = '\t';
+                        break;
+                case 'u':
+                        if (json_parse_hex4(q + 1, &u) < 0)
+                                return -EBADMSG;
+                        q += 4;
+
+                        c = u;
+                        if (utf16_is_surrogate(u)) {
+                                if (utf16_is_trailing_surrogate(u) ||
+                                    q[1] != '\\' || q[2] != 'u' ||
+                                    json_parse_hex4(q + 3, &trail) < 0 ||
+                                    !utf16_is_trailing_surrogate(trail))
+                                        return -EBADMSG;
+
+                                c = utf16_surrogate_pair_to_unichar(u, trail);
+                                q += 6;
+                        }
+
+                        /* a string is a C string in the end */
+                        if (c == 0)
+                                return -EBADMSG;
+
+                        n += json_encode_utf8(s + n, c);
+                        break;
+                default:
+                        return -EBADMSG;
+                }
+                q++;
+        }
+
+        s[n] = '\0';
+        *p = q + 1;
+        *ret = s;
+        s = NULL;
+
+        return 0;
+}
+
+static int json_parse_value(const char **p, struct json_value *v, unsigned depth);
+
+static int json_parse_children(const char **p, struct json_value *v, unsigned depth) {
+        bool object = v->type == JSON_OBJECT;
+        char end = object ? '}' : ']';
+        int r;
+
+        (*p)++;
+        json_skip_space(p);
+        if (**p == end) {
+                (*p)++;
+                return 0;
+        }
+
+        for (;;) {
+                _cleanup_free_ char *key = NULL;
+                struct json_value child = {};
+
+                json_skip_space(p);
+
+                if (object) {
+                        if (**p != '"')
+                                return -EBADMSG;
+
+                        r = json_parse_string(p, &key);
+                        if (r < 0)
+                                return r;
+
+                        json_skip_space(p);
+                        if (**p != ':')
+                                return -EBADMSG;
+                        (*p)++;
+                }
+
+                r = json_parse_value(p, &child, depth + 1);
+                if (r < 0) {
+                        json_value_done(&child);
+                        return r;
+                }
+
+                if (!GREEDY_REALLOC(v->children, v->allocated_children, v->n_children + 1)) {
+                        json_value_done(&child);
+                        return -ENOMEM;
+                }
+
+                child.key = key;
+                key = NULL;
+                v->children[v->n_children++] = child;
+
+                json_skip_space(p);
+                if (**p == end) {
+                        (*p)++;
+                        return 0;
+                }
+                if (**p != ',')
+                        return -EBADMSG;
+                (*p)++;
+        }
+}
+
+static int json_parse_value(const char **p, struct json_value *v, unsigned depth) {
+        char *e;
+
+        if (depth > JSON_DEPTH_MAX)
+                return -EBADMSG;
+
+        json_skip_space(p);
+
+        switch (**p) {
+        case '{':
+                v->type = JSON_OBJECT;
+                return json_parse_children(p, v, depth);
+        case '[':
+                v->type = JSON_ARRAY;
+                return json_parse_children(p, v, depth);
+        case '"':
+                v->type = JSON_STRING;
+                return json_parse_string(p, &v->string);
+        }
+
+        if (startswith(*p, "null")) {
+                v->type = JSON_NULL;
+                *p += 4;
+        } else if (startswith(*p, "true")) {
+                v->type = JSON_BOOLEAN;
+                v->number = 1;
+                *p += 4;
+        } else if (startswith(*p, "false")) {
+                v->type = JSON_BOOLEAN;
+                *p += 5;
+        } else {
+                if (!strchr("-0123456789", **p) || **p == '\0')
+                        return -EBADMSG;
+
+                errno = 0;
+                v->type = JSON_NUMBER;
+                v->number = strtod(*p, &e);
+                if (e == *p || errno != 0)
+                        return -EBADMSG;
+                *p = e;
+        }
+
+        return 0;
+}
+
+int json_parse(const char *text, struct json_value *ret) {
+        struct json_value v = {};
+        int r;
+
+        assert(text);
+        assert(ret);
+
+        r = json_parse_value(&text, &v, 0);
+        if (r >= 0) {
+                json_skip_space(&text);
+                if (*text != '\0')
+                        r = -EBADMSG;
+        }
+        if (r < 0) {
+                json_value_done(&v);
+                return r;
+        }
+
+        *ret = v;
+
+        return 0;
+}
+
+const struct json_value *json_get(const struct json_value *v, const char *key) {
+        size_t i;
+
+        if (!v || v->type != JSON_OBJECT)
+                return NULL;
+
+        for (i = 0; i < v->n_children; i++)
+                if (streq(v->children[i].key, key))
+                        return &v->children[i];
+
+        return NULL;
+}
+
+double json_get_number(const struct json_value *v, double def) {
+        if (!v || v->type != JSON_NUMBER)
+                return def;
+
+        return v->number;
+}
+
+void json_value_done(struct json_value *v) {
+        size_t i;
+
+        if (!v)
+                return;
+
+        for (i = 0; i < v->n_children; i++)
+                json_value_done(&v->children[i]);
+
+        free(v->children);
+        free(v->key);
+        free(v->string);
+        *v = (struct json_value) {};
+}
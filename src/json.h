@@ -0,0 +1,59 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* writes s as a quoted JSON string, NULL is written as null */
+void json_write_string(FILE *f, const char *s);
+
+/* writes l bytes at p as a quoted base64 string */
+void json_write_base64(FILE *f, const void *p, size_t l);
+
+typedef enum JsonType {
+        JSON_NULL,
+        JSON_BOOLEAN,
+        JSON_NUMBER,
+        JSON_STRING,
+        JSON_ARRAY,
+        JSON_OBJECT,
+} JsonType;
+
+/*
+ * A parsed JSON document. Booleans are numbers that are 0 or 1, the
+ * members of an object are its children, named by their key.
+ */
+struct json_value {
+        JsonType type;
+        /* the name of a member of an object */
+        char *key;
+        double number;
+        char *string;
+        struct json_value *children;
+        size_t n_children;
+        size_t allocated_children;
+};
+
+/* parses all of text, or returns -EBADMSG */
+int json_parse(const char *text, struct json_value *ret);
+/* the member of an object named key, or NULL */
+const struct json_value *json_get(const struct json_value *v, const char *key);
+/* the number v holds, or def if it isn't one */
+double json_get_number(const struct json_value *v, double def);
+void json_value_done(struct json_value *v);
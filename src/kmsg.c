@@ -0,0 +1,409 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "kmsg.h"
+#include "macro.h"
+#include "parse-util.h"
+#include "string-util.h"
+
+/* the kernel never hands out records longer than this */
+#define KMSG_RECORD_MAX 8192
+
+static const char * const kernel_event_type_table[_KERNEL_EVENT_TYPE_MAX] = {
+        [KERNEL_EVENT_MODULE] = "module",
+        [KERNEL_EVENT_PROBE] = "probe",
+        [KERNEL_EVENT_FIRMWARE] = "firmware",
+};
+
+const char *kernel_event_type_to_string(KernelEventType t) {
+        if (t < 0 || t >= _KERNEL_EVENT_TYPE_MAX)
+                return NULL;
+
+        return kernel_event_type_table[t];
+}
+
+int kmsg_open(struct kmsg *k, const char *path) {
+        assert(k);
+
+        if (k->fd >= 0)
+                return 0;
+
+        /* a freshly opened /dev/kmsg starts at the oldest record still in the ring buffer */
+        k->fd = open(path, O_RDONLY|O_NONBLOCK|O_CLOEXEC|O_NOCTTY);
+        if (k->fd < 0)
+                return -errno;
+
+        return 0;
+}
+
+int kmsg_parse_initcall(const char *message, uint64_t ts_usec, struct initcall *ret) {
+        _cleanup_free_ char *func = NULL, *module = NULL;
+        const char *p, *m = NULL;
+        size_t n, f, ml = 0;
+        int result, usecs;
+
+        assert(message);
+        assert(ret);
+
+        p = startswith(message, "initcall ");
+        if (!p)
+                return 0;
+
+        /* chop the +0xXX/0xXX stuff */
+        n = strcspn(p, " ");
+        f = strcspn(p, "+ ");
+        if (n == 0)
+                return 0;
+        p += n;
+        p += strspn(p, " ");
+
+        /* initcalls done by module loading carry the module name */
+        if (*p == '[') {
+                ml = strcspn(p + 1, "]");
+                if (p[1 + ml] != ']')
+                        return 0;
+
+                m = p + 1;
+                p += ml + 2;
+                p += strspn(p, " ");
+        }
+
+        if (sscanf(p, "returned %d after %d usecs", &result, &usecs) != 2)
+                return 0;
+
+        func = strndup(message + strlen("initcall "), f);
+        if (!func)
+                return -ENOMEM;
+
+        if (m) {
+                module = strndup(m, ml);
+                if (!module)
+                        return -ENOMEM;
+        }
+
+        *ret = (struct initcall) {
+                .func = func,
+                .module = module,
+                .time = ts_usec / 1000000.0,
+                .usecs = usecs,
+                .ret = result,
+        };
+        func = module = NULL;
+
+        return 1;
+}
+
+/* splits "<driver> <device>: <text>", as printed by dev_printk() */
+static const char *kmsg_device_prefix(const char *message, char **ret_driver, char **ret_device) {
+        const char *e;
+        size_t d, n;
+
+        d = strcspn(message, " :");
+        if (d == 0 || message[d] != ' ')
+                return message;
+
+        /* device names may contain colons themselves, e.g. PCI addresses */
+        e = strstr(message + d + 1, ": ");
+        if (!e)
+                return message;
+
+        n = e - (message + d + 1);
+        if (n == 0 || memchr(message + d + 1, ' ', n))
+                return message;
+
+        *ret_driver = strndup(message, d);
+        *ret_device = strndup(message + d + 1, n);
+        return e + 2;
+}
+
+int kmsg_parse_kernel_event(const char *message, uint64_t ts_usec, char **ret_module, struct kernel_event *ret) {
+        _cleanup_free_ char *driver = NULL, *device = NULL, *module = NULL, *name = NULL;
+        KernelEventType type;
+        const char *p, *q;
+        int result = 0;
+        uint64_t usecs = 0;
+        size_t n;
+
+        assert(message);
+        assert(ret_module);
+        assert(ret);
+
+        p = kmsg_device_prefix(message, &driver, &device);
+        if (p != message && (!driver || !device))
+                return -ENOMEM;
+
+        if ((q = startswith(p, "probe with driver "))) {
+                /* "probe with driver <drv> returned <ret> after <usecs> usecs" */
+                n = strcspn(q, " ");
+                if (n == 0 || sscanf(q + n, " returned %d after %" SCNu64 " usecs", &result, &usecs) != 2)
+                        return 0;
+
+                type = KERNEL_EVENT_PROBE;
+                module = strndup(q, n);
+                name = strdup(device ?: module ?: "");
+
+        } else if ((q = startswith(p, "probe of "))) {
+                /* older kernels: "probe of <device> returned <ret> after <usecs> usecs" */
+                n = strcspn(q, " ");
+                if (n == 0 || sscanf(q + n, " returned %d after %" SCNu64 " usecs", &result, &usecs) != 2)
+                        return 0;
+
+                type = KERNEL_EVENT_PROBE;
+                module = strdup(driver ?: "probe");
+                name = strndup(q, n);
+
+        } else if ((q = startswith(p, "firmware: direct-loading firmware ")) ||
+                   (q = startswith(p, "firmware: requesting "))) {
+
+                type = KERNEL_EVENT_FIRMWARE;
+                module = strdup(driver ?: "firmware");
+                name = strdup(q);
+
+        } else if ((q = startswith(p, "Direct firmware load for "))) {
+                const char *e;
+
+                e = strstr(q, " failed with error ");
+                if (!e || sscanf(e, " failed with error %d", &result) != 1)
+                        return 0;
+
+                type = KERNEL_EVENT_FIRMWARE;
+                module = strdup(driver ?: "firmware");
+                name = strndup(q, e - q);
+
+        } else
+                return 0;
+
+        if (!module || !name)
+                return -ENOMEM;
+
+        *ret = (struct kernel_event) {
+                .type = type,
+                .name = name,
+                .start = (ts_usec - MIN(usecs, ts_usec)) / 1000000.0,
+                .end = ts_usec / 1000000.0,
+                .ret = result,
+        };
+        *ret_module = module;
+        name = module = NULL;
+
+        return 1;
+}
+
+static int kmsg_add_kernel_event(struct kmsg *k, const char *module, const struct kernel_event *ev) {
+        struct kernel_module *m;
+        void *v;
+        int r;
+
+        r = hashmap_ensure_allocated(&k->module_index, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        v = hashmap_get(k->module_index, module);
+        if (v)
+                m = &k->modules[PTR_TO_INT(v) - 1];
+        else {
+                if (!GREEDY_REALLOC(k->modules, k->allocated_modules, k->n_modules + 1))
+                        return -ENOMEM;
+
+                m = &k->modules[k->n_modules];
+                *m = (struct kernel_module) {
+                        .name = strdup(module),
+                        .start = ev->start,
+                        .end = ev->end,
+                };
+                if (!m->name)
+                        return -ENOMEM;
+
+                r = hashmap_put(k->module_index, m->name, INT_TO_PTR(k->n_modules + 1));
+                if (r < 0) {
+                        m->name = mfree(m->name);
+                        return r;
+                }
+
+                k->n_modules++;
+        }
+
+        if (!GREEDY_REALLOC(m->events, m->allocated_events, m->n_events + 1))
+                return -ENOMEM;
+
+        m->events[m->n_events++] = *ev;
+        m->start = MIN(m->start, ev->start);
+        m->end = MAX(m->end, ev->end);
+        if (ev->type == KERNEL_EVENT_FIRMWARE)
+                m->firmware = true;
+
+        return 0;
+}
+
+static int kmsg_add_initcall(struct kmsg *k, const struct initcall *ic) {
+        if (!GREEDY_REALLOC(k->initcalls, k->allocated_initcalls, k->n_initcalls + 1))
+                return -ENOMEM;
+
+        /* initcalls of modules also show up as module load events */
+        if (ic->module) {
+                struct kernel_event ev = {
+                        .type = KERNEL_EVENT_MODULE,
+                        .name = strdup(ic->func),
+                        .start = ic->time - ic->usecs / 1000000.0,
+                        .end = ic->time,
+                        .ret = ic->ret,
+                };
+                int r;
+
+                if (!ev.name)
+                        return -ENOMEM;
+
+                r = kmsg_add_kernel_event(k, ic->module, &ev);
+                if (r < 0) {
+                        free(ev.name);
+                        return r;
+                }
+        }
+
+        k->initcalls[k->n_initcalls++] = *ic;
+        return 0;
+}
+
+static int kmsg_parse_record(struct kmsg *k, char *record) {
+        _cleanup_free_ char *module = NULL;
+        struct kernel_event ev;
+        struct initcall ic;
+        uint64_t ts_usec;
+        char *message, *ts, *e;
+        int r;
+
+        /* "<prio>,<seq>,<usec>,<flags>[,...];<message>\n[ KEY=value\n...]" */
+        message = strchr(record, ';');
+        if (!message)
+                return 0;
+        *message++ = 0;
+
+        e = strchr(message, '\n');
+        if (e)
+                *e = 0;
+
+        ts = strchr(record, ',');
+        if (!ts)
+                return 0;
+        ts = strchr(ts + 1, ',');
+        if (!ts)
+                return 0;
+        ts++;
+
+        e = strchr(ts, ',');
+        if (e)
+                *e = 0;
+
+        if (safe_atou64(ts, &ts_usec) < 0)
+                return 0;
+
+        r = kmsg_parse_initcall(message, ts_usec, &ic);
+        if (r < 0)
+                return r;
+        if (r > 0) {
+                r = kmsg_add_initcall(k, &ic);
+                if (r < 0) {
+                        free(ic.func);
+                        free(ic.module);
+                }
+
+                return r;
+        }
+
+        r = kmsg_parse_kernel_event(message, ts_usec, &module, &ev);
+        if (r <= 0)
+                return r;
+
+        r = kmsg_add_kernel_event(k, module, &ev);
+        if (r < 0)
+                free(ev.name);
+
+        return r;
+}
+
+int kmsg_read(struct kmsg *k) {
+        char record[KMSG_RECORD_MAX + 1];
+        int r;
+
+        assert(k);
+
+        if (k->fd < 0)
+                return 0;
+
+        for (;;) {
+                ssize_t l;
+
+                /* each read returns exactly one record */
+                l = read(k->fd, record, KMSG_RECORD_MAX);
+                if (l < 0) {
+                        if (errno == EAGAIN)
+                                return 0;
+                        /* records were overwritten before we got to them, carry on with the next */
+                        if (errno == EPIPE || errno == EINTR)
+                                continue;
+                        return -errno;
+                }
+                if (l == 0)
+                        return 0;
+
+                record[l] = 0;
+
+                r = kmsg_parse_record(k, record);
+                if (r < 0)
+                        return r;
+        }
+}
+
+void kmsg_done(struct kmsg *k) {
+        size_t i;
+
+        assert(k);
+
+        for (i = 0; i < k->n_initcalls; i++) {
+                free(k->initcalls[i].func);
+                free(k->initcalls[i].module);
+        }
+
+        k->initcalls = mfree(k->initcalls);
+        k->n_initcalls = k->allocated_initcalls = 0;
+
+        for (i = 0; i < k->n_modules; i++) {
+                struct kernel_module *m = &k->modules[i];
+                size_t j;
+
+                for (j = 0; j < m->n_events; j++)
+                        free(m->events[j].name);
+
+                free(m->events);
+                free(m->name);
+        }
+
+        k->modules = mfree(k->modules);
+        k->n_modules = k->allocated_modules = 0;
+        k->module_index = hashmap_free(k->module_index);
+        k->fd = safe_close(k->fd);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hashmap.h"
+#include "macro.h"
+
+struct initcall {
+        char *func;
+        /* module the initcall belongs to, NULL for built-in ones */
+        char *module;
+        /* seconds since boot at which the initcall returned */
+        double time;
+        int usecs;
+        int ret;
+};
+
+typedef enum KernelEventType {
+        KERNEL_EVENT_MODULE,    /* module init function */
+        KERNEL_EVENT_PROBE,     /* driver probe, needs initcall_debug */
+        KERNEL_EVENT_FIRMWARE,  /* firmware request, has no duration */
+        _KERNEL_EVENT_TYPE_MAX,
+        _KERNEL_EVENT_TYPE_INVALID = -1,
+} KernelEventType;
+
+struct kernel_event {
+        KernelEventType type;
+        /* init function, device or firmware file */
+        char *name;
+        /* seconds since boot */
+        double start;
+        double end;
+        int ret;
+};
+
+/* all events of one module or driver, in the order they were logged */
+struct kernel_module {
+        char *name;
+        struct kernel_event *events;
+        size_t n_events;
+        size_t allocated_events;
+        double start;
+        double end;
+        bool firmware;
+};
+
+/*
+ * Kernel log records of interest, collected from /dev/kmsg. Reading
+ * never blocks and only consumes the records that are available, so
+ * kmsg_read() can be called during sampling as well as once at the end.
+ */
+struct kmsg {
+        int fd;
+        struct initcall *initcalls;
+        size_t n_initcalls;
+        size_t allocated_initcalls;
+
+        struct kernel_module *modules;
+        size_t n_modules;
+        size_t allocated_modules;
+        /* module name -> index + 1 */
+        Hashmap *module_index;
+};
+
+#define KMSG_INIT { .fd = -1 }
+
+int kmsg_open(struct kmsg *k, const char *path);
+int kmsg_read(struct kmsg *k);
+void kmsg_done(struct kmsg *k);
+
+/* parses "initcall <func>+0x../0x.. [<module>] returned <ret> after <usecs> usecs" */
+int kmsg_parse_initcall(const char *message, uint64_t ts_usec, struct initcall *ret);
+/* parses driver probe and firmware request messages, ret_module is the driver the event belongs to */
+int kmsg_parse_kernel_event(const char *message, uint64_t ts_usec, char **ret_module, struct kernel_event *ret);
+
+const char *kernel_event_type_to_string(KernelEventType t) _const_;
@@ -0,0 +1,147 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+/*
+ * Machine readable summary of a recording. The CSV file has one row
+ * per process, the system statistics are prepended as '#' comments;
+ * the JSON file has both. All times are in seconds, relative to the
+ * start of the graph, PSS is in kB.
+ */
+
+#include <stdio.h>
+
+#include "bootchart.h"
+#include "efi.h"
+#include "idle.h"
+#include "json.h"
+#include "list.h"
+#include "macro.h"
+#include "report.h"
+#include "svg.h"
+
+void csv_write_string(FILE *f, const char *s) {
+        if (!s)
+                return;
+
+        fputc('"', f);
+        for (; *s; s++) {
+                if (*s == '"')
+                        fputc('"', f);
+                fputc(*s, f);
+        }
+        fputc('"', f);
+}
+
+int report_do(FILE *csv,
+              FILE *json,
+              const char *build,
+              struct list_sample_data *head,
+              struct ps_struct *ps_first,
+              const struct boot_times *boot,
+              int n_samples,
+              int n_cpus,
+              double graph_start,
+              double interval,
+              int overrun) {
+
+        struct list_sample_data *tail = head;
+        double phase_start[_BOOT_PHASE_MAX], phase_end[_BOOT_PHASE_MAX];
+        struct ps_struct *ps;
+        double idle, start, end;
+        bool phases;
+        BootPhase p;
+        int n_ps = 0;
+
+        LIST_FIND_TAIL(link, tail, tail);
+
+        start = tail->sampletime - graph_start;
+        end = head->sampletime - graph_start;
+        idle = idle_find(tail, n_cpus, graph_start, arg_idle_window, arg_idle_threshold / 100.0);
+
+        for (ps = ps_first->next_ps; ps; ps = ps->next_ps)
+                n_ps++;
+
+        phases = boot_times_phases(boot, ps_first, graph_start, idle >= 0.0 ? idle : end, phase_start, phase_end);
+
+        fputs("{\"build\":", json);
+        json_write_string(json, build);
+        fprintf(json, ",\"version\":\"%s\",\n\"system\":{"
+                "\"cpus\":%i,\"samples\":%i,\"hz\":%g,\"start\":%.6f,\"end\":%.6f,\"duration\":%.6f,"
+                "\"overruns\":%i,\"processes\":%i,\"idle\":",
+                VERSION, n_cpus, n_samples, arg_hz, start, end, end - start, overrun, n_ps);
+        if (idle >= 0.0)
+                fprintf(json, "%.6f", idle);
+        else
+                fputs("null", json);
+        fprintf(json, ",\"idle_threshold\":%g,\"idle_window\":%g", arg_idle_threshold, arg_idle_window);
+        for (p = 0; phases && p < _BOOT_PHASE_MAX; p++)
+                fprintf(json, ",\"%s\":%.6f", boot_phase_to_string(p), phase_end[p] - phase_start[p]);
+        fputs("},\n\"processes\":[", json);
+
+        fprintf(csv, "# cpus=%i\n# samples=%i\n# hz=%g\n# start=%.6f\n# end=%.6f\n# duration=%.6f\n# overruns=%i\n# processes=%i\n",
+                n_cpus, n_samples, arg_hz, start, end, end - start, overrun, n_ps);
+        if (idle >= 0.0)
+                fprintf(csv, "# idle=%.6f\n", idle);
+        else
+                fputs("# idle=\n", csv);
+        fprintf(csv, "# idle_threshold=%g\n# idle_window=%g\n", arg_idle_threshold, arg_idle_window);
+        for (p = 0; phases && p < _BOOT_PHASE_MAX; p++)
+                fprintf(csv, "# %s=%.6f\n", boot_phase_to_string(p), phase_end[p] - phase_start[p]);
+        fputs("pid,ppid,name,cgroup,start,end,cpu,wait,pss_max,samples\n", csv);
+
+        n_ps = 0;
+        ps = ps_first;
+        while ((ps = get_next_ps(ps, ps_first))) {
+                struct ps_sched_struct *sample;
+                double ps_start, ps_end, cpu, wait;
+                int samples = 0, c;
+
+                /* the first sample is a placeholder for the start values */
+                for (sample = ps->first; sample->next; sample = sample->next)
+                        samples++;
+
+                ps_start = ps->first->sampledata->sampletime - graph_start;
+                ps_end = ps->last->sampledata->sampletime - graph_start;
+                cpu = (ps->last->runtime - ps->first->runtime) / 1000000000.0;
+                wait = (ps->last->waittime - ps->first->waittime) / 1000000000.0;
+
+                fprintf(csv, "%i,%i,", ps->pid, ps->ppid);
+                csv_write_string(csv, ps_name(ps));
+                fputc(',', csv);
+                csv_write_string(csv, ps_cgroup(ps));
+                fprintf(csv, ",%.6f,%.6f,%.6f,%.6f,%i,%i\n",
+                        ps_start, ps_end, cpu, wait, ps->pss_max, samples);
+
+                fprintf(json, "%s\n{\"pid\":%i,\"ppid\":%i,\"name\":", n_ps++ > 0 ? "," : "", ps->pid, ps->ppid);
+                json_write_string(json, ps_name(ps));
+                fputs(",\"cgroup\":", json);
+                json_write_string(json, ps_cgroup(ps));
+                fputs(",\"cgroup_changes\":[", json);
+                for (c = 0; c < ps->n_cgroup_changes; c++) {
+                        fprintf(json, "%s{\"time\":%.6f,\"cgroup\":", c > 0 ? "," : "",
+                                ps->cgroup_changes[c].time - graph_start);
+                        json_write_string(json, strtab_get(&cgroup_paths, ps->cgroup_changes[c].cgroup));
+                        fputc('}', json);
+                }
+                fprintf(json, "],\"start\":%.6f,\"end\":%.6f,\"cpu\":%.6f,\"wait\":%.6f,\"pss_max\":%i,\"samples\":%i}",
+                        ps_start, ps_end, cpu, wait, ps->pss_max, samples);
+        }
+
+        fputs("\n]}\n", json);
+
+        return 0;
+}
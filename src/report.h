@@ -0,0 +1,38 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+
+#include "bootchart.h"
+#include "efi.h"
+
+/* writes s as a quoted CSV field, NULL as an empty one */
+void csv_write_string(FILE *f, const char *s);
+
+int report_do(FILE *csv,
+              FILE *json,
+              const char *build,
+              struct list_sample_data *head,
+              struct ps_struct *ps_first,
+              const struct boot_times *boot,
+              int n_samples,
+              int n_cpus,
+              double graph_start,
+              double interval,
+              int overrun);
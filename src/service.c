@@ -0,0 +1,379 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "bootchart.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "macro.h"
+#include "service.h"
+#include "string-util.h"
+#include "util.h"
+
+/* slices nest, but not deeply: -.slice/user.slice/user-1000.slice/... */
+#define SERVICE_SLICE_DEPTH_MAX 8
+
+static const char * const service_view_table[_SERVICE_VIEW_MAX] = {
+        [SERVICE_VIEW_NO] = "no",
+        [SERVICE_VIEW_COLLAPSED] = "collapsed",
+        [SERVICE_VIEW_EXPANDED] = "expanded",
+};
+
+const char *service_view_to_string(ServiceView v) {
+        if (v < 0 || v >= _SERVICE_VIEW_MAX)
+                return NULL;
+
+        return service_view_table[v];
+}
+
+ServiceView service_view_from_string(const char *s) {
+        ServiceView v;
+
+        if (!s)
+                return _SERVICE_VIEW_INVALID;
+
+        for (v = 0; v < _SERVICE_VIEW_MAX; v++)
+                if (streq(service_view_table[v], s))
+                        return v;
+
+        return _SERVICE_VIEW_INVALID;
+}
+
+static const char * const service_file_table[_SERVICE_FILE_MAX] = {
+        [SERVICE_CPU_STAT] = "cpu.stat",
+        [SERVICE_IO_STAT] = "io.stat",
+        [SERVICE_MEMORY_CURRENT] = "memory.current",
+        [SERVICE_CPU_PRESSURE] = "cpu.pressure",
+        [SERVICE_IO_PRESSURE] = "io.pressure",
+        [SERVICE_MEMORY_PRESSURE] = "memory.pressure",
+};
+
+static bool is_unit_cgroup(const char *name) {
+        /* the unit types that get a cgroup of their own, slices aside */
+        return endswith(name, ".service") ||
+               endswith(name, ".scope") ||
+               endswith(name, ".socket") ||
+               endswith(name, ".mount") ||
+               endswith(name, ".swap");
+}
+
+int services_open(struct services *s, const char *root) {
+        assert(s);
+
+        if (s->root_fd >= 0)
+                return 0;
+
+        /* cpu.stat is there for every cgroup v2 cgroup, controllers or not */
+        s->root_fd = open(root, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (s->root_fd < 0)
+                return -errno;
+
+        if (faccessat(s->root_fd, "cgroup.controllers", F_OK, 0) < 0) {
+                s->root_fd = safe_close(s->root_fd);
+                return -EOPNOTSUPP;
+        }
+
+        return 0;
+}
+
+static int services_add(struct services *s, const char *path) {
+        struct service *u;
+        unsigned i;
+        int r;
+
+        r = hashmap_ensure_allocated(&s->index, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        if (!GREEDY_REALLOC(s->services, s->allocated_services, s->n_services + 1))
+                return -ENOMEM;
+
+        u = &s->services[s->n_services];
+        *u = (struct service) {
+                .path = strdup(path),
+                .present = true,
+        };
+        if (!u->path)
+                return -ENOMEM;
+        u->name = strrchr(u->path, '/') + 1;
+
+        for (i = 0; i < _SERVICE_FILE_MAX; i++)
+                u->fd[i] = -1;
+
+        r = hashmap_put(s->index, u->path, INT_TO_PTR(s->n_services + 1));
+        if (r < 0) {
+                u->path = mfree(u->path);
+                return r;
+        }
+
+        s->n_services++;
+
+        return 0;
+}
+
+static int services_scan(struct services *s, const char *path, unsigned depth) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        int fd, r;
+
+        /* the root itself is "/", everything below is relative to it */
+        fd = openat(s->root_fd, isempty(path) ? "." : path + 1, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (fd < 0)
+                return errno == ENOENT ? 0 : -errno;
+
+        d = fdopendir(fd);
+        if (!d) {
+                safe_close(fd);
+                return -errno;
+        }
+
+        FOREACH_DIRENT(de, d, return -errno) {
+                _cleanup_free_ char *p = NULL;
+                void *v;
+
+                if (de->d_type != DT_DIR || de->d_name[0] == '.')
+                        continue;
+
+                if (endswith(de->d_name, ".slice")) {
+                        if (depth >= SERVICE_SLICE_DEPTH_MAX)
+                                continue;
+
+                        p = strjoin(path, "/", de->d_name, NULL);
+                        if (!p)
+                                return -ENOMEM;
+
+                        r = services_scan(s, p, depth + 1);
+                        if (r < 0)
+                                return r;
+
+                        continue;
+                }
+
+                if (!is_unit_cgroup(de->d_name))
+                        continue;
+
+                p = strjoin(path, "/", de->d_name, NULL);
+                if (!p)
+                        return -ENOMEM;
+
+                v = hashmap_get(s->index, p);
+                if (v) {
+                        s->services[PTR_TO_INT(v) - 1].present = true;
+                        continue;
+                }
+
+                r = services_add(s, p);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static void service_close(struct service *u) {
+        unsigned i;
+
+        for (i = 0; i < _SERVICE_FILE_MAX; i++)
+                u->fd[i] = safe_close(u->fd[i]);
+}
+
+static int service_read_file(int root_fd, struct service *u, ServiceFile f, char *buf, size_t size) {
+        ssize_t n;
+
+        if (u->missing & (1U << f))
+                return -ENOENT;
+
+        if (u->fd[f] < 0) {
+                _cleanup_free_ char *p = NULL;
+
+                p = strjoin(u->path + 1, "/", service_file_table[f], NULL);
+                if (!p)
+                        return -ENOMEM;
+
+                u->fd[f] = openat(root_fd, p, O_RDONLY|O_CLOEXEC);
+                if (u->fd[f] < 0) {
+                        /* controller not enabled for this cgroup, don't look again */
+                        if (errno == ENOENT && f != SERVICE_CPU_STAT)
+                                u->missing |= 1U << f;
+                        return -errno;
+                }
+        }
+
+        n = pread(u->fd[f], buf, size - 1, 0);
+        if (n < 0)
+                return -errno;
+        buf[n] = 0;
+
+        return 0;
+}
+
+static int find_u64(const char *buf, const char *key, uint64_t *ret) {
+        const char *p;
+
+        p = strstr(buf, key);
+        if (!p)
+                return -ENODATA;
+
+        *ret = strtoull(p + strlen(key), NULL, 10);
+
+        return 0;
+}
+
+static int service_read(int root_fd, struct service *u, struct service_sample *ret) {
+        char buf[4096];
+        PressureResource res;
+        int r;
+
+        /* a removed cgroup fails reads with ENODEV, it may come back later */
+        r = service_read_file(root_fd, u, SERVICE_CPU_STAT, buf, sizeof(buf));
+        if (r < 0) {
+                service_close(u);
+                return r;
+        }
+        r = find_u64(buf, "usage_usec ", &ret->usage_usec);
+        if (r < 0)
+                return r;
+
+        if (service_read_file(root_fd, u, SERVICE_MEMORY_CURRENT, buf, sizeof(buf)) >= 0)
+                ret->memory = strtoull(buf, NULL, 10);
+
+        /* one line per device: "8:0 rbytes=1 wbytes=2 rios=3 ..." */
+        if (service_read_file(root_fd, u, SERVICE_IO_STAT, buf, sizeof(buf)) >= 0) {
+                char *l, *next;
+
+                for (l = buf; l && *l; l = next) {
+                        uint64_t v;
+
+                        next = strchr(l, '\n');
+                        if (next)
+                                *(next++) = 0;
+
+                        if (find_u64(l, "rbytes=", &v) >= 0)
+                                ret->rbytes += v;
+                        if (find_u64(l, "wbytes=", &v) >= 0)
+                                ret->wbytes += v;
+                }
+        }
+
+        for (res = 0; arg_pressure && res < _PRESSURE_RESOURCE_MAX; res++)
+                if (service_read_file(root_fd, u, SERVICE_CPU_PRESSURE + res, buf, sizeof(buf)) >= 0)
+                        (void) find_u64(buf, "total=", &ret->pressure[res]);
+
+        ret->valid = true;
+
+        return 0;
+}
+
+int services_read(struct services *s, struct service_sample **ret, int *ret_n) {
+        _cleanup_free_ struct service_sample *samples = NULL;
+        size_t i;
+        int r;
+
+        assert(s);
+        assert(ret);
+        assert(ret_n);
+
+        if (s->root_fd < 0)
+                return -EBADF;
+
+        for (i = 0; i < s->n_services; i++)
+                s->services[i].present = false;
+
+        /* picks up units started since the last sample */
+        r = services_scan(s, "", 0);
+        if (r < 0)
+                return r;
+
+        if (s->n_services == 0) {
+                *ret = NULL;
+                *ret_n = 0;
+                return 0;
+        }
+
+        samples = new0(struct service_sample, s->n_services);
+        if (!samples)
+                return -ENOMEM;
+
+        for (i = 0; i < s->n_services; i++) {
+                struct service *u = &s->services[i];
+
+                if (!u->present) {
+                        service_close(u);
+                        continue;
+                }
+
+                (void) service_read(s->root_fd, u, &samples[i]);
+        }
+
+        *ret = samples;
+        *ret_n = (int) s->n_services;
+        samples = NULL;
+
+        return 0;
+}
+
+int services_find(const struct services *s, const char *cgroup) {
+        _cleanup_free_ char *p = NULL;
+        char *e;
+
+        assert(s);
+
+        if (!cgroup)
+                return -1;
+
+        p = strdup(cgroup);
+        if (!p)
+                return -1;
+
+        /* processes may live in a sub-cgroup of their unit */
+        for (;;) {
+                void *v;
+
+                v = hashmap_get(s->index, p);
+                if (v)
+                        return PTR_TO_INT(v) - 1;
+
+                e = strrchr(p, '/');
+                if (!e || e == p)
+                        return -1;
+                *e = 0;
+        }
+}
+
+void services_done(struct services *s) {
+        size_t i;
+
+        assert(s);
+
+        for (i = 0; i < s->n_services; i++) {
+                service_close(&s->services[i]);
+                free(s->services[i].path);
+        }
+
+        s->services = mfree(s->services);
+        s->n_services = s->allocated_services = 0;
+        s->index = hashmap_free(s->index);
+        s->root_fd = safe_close(s->root_fd);
+}
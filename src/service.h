@@ -0,0 +1,93 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hashmap.h"
+#include "macro.h"
+
+typedef enum ServiceView {
+        SERVICE_VIEW_NO,
+        SERVICE_VIEW_COLLAPSED, /* one row per unit */
+        SERVICE_VIEW_EXPANDED,  /* each unit followed by its processes */
+        _SERVICE_VIEW_MAX,
+        _SERVICE_VIEW_INVALID = -1,
+} ServiceView;
+
+typedef enum ServiceFile {
+        SERVICE_CPU_STAT,
+        SERVICE_IO_STAT,
+        SERVICE_MEMORY_CURRENT,
+        SERVICE_CPU_PRESSURE,
+        SERVICE_IO_PRESSURE,
+        SERVICE_MEMORY_PRESSURE,
+        _SERVICE_FILE_MAX,
+} ServiceFile;
+
+/* cgroup v2 counters of one unit, all but memory are cumulative */
+struct service_sample {
+        uint64_t usage_usec;
+        uint64_t rbytes;
+        uint64_t wbytes;
+        uint64_t memory;
+        /* "some" total stall time in us, indexed by PressureResource */
+        uint64_t pressure[_SERVICE_FILE_MAX - SERVICE_CPU_PRESSURE];
+        bool valid;
+};
+
+struct service {
+        /* relative to the cgroup root, as in /proc/<pid>/cgroup */
+        char *path;
+        const char *name;
+        int fd[_SERVICE_FILE_MAX];
+        /* files the kernel doesn't provide for this cgroup */
+        unsigned missing;
+        /* found in the last walk of the hierarchy */
+        bool present;
+};
+
+/*
+ * systemd units found in the cgroup v2 hierarchy. Units are looked up
+ * again on every sample, but their files are only opened once, so a
+ * sample costs a few reads per unit rather than per process. Units
+ * keep their position in the per sample arrays when they go away, so
+ * a restarted unit continues on the same row.
+ */
+struct services {
+        int root_fd;
+        struct service *services;
+        size_t n_services;
+        size_t allocated_services;
+        /* path -> index + 1 */
+        Hashmap *index;
+};
+
+#define SERVICES_INIT { .root_fd = -1 }
+
+int services_open(struct services *s, const char *root);
+int services_read(struct services *s, struct service_sample **ret, int *ret_n);
+void services_done(struct services *s);
+
+/* the index of the unit a cgroup path belongs to, or -1 */
+int services_find(const struct services *s, const char *cgroup);
+
+const char *service_view_to_string(ServiceView v) _const_;
+ServiceView service_view_from_string(const char *s) _pure_;
@@ -32,25 +32,79 @@
 
 #include "alloc-util.h"
 #include "bootchart.h"
-#include "cgroup-util.h"
+#include "capture.h"
 #include "def.h"
 #include "dirent-util.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "formats-util.h"
+#include "governor.h"
 #include "log.h"
 #include "parse-util.h"
+#include "stdio-util.h"
 #include "store.h"
 #include "string-util.h"
 #include "strxcpyx.h"
 #include "time-util.h"
 
-/*
- * Alloc a static 4k buffer for stdio - primarily used to increase
- * PSS buffering from the default 1k stdin buffer to reduce
- * read() overhead.
- */
-static char smaps_buf[4096];
+/* processes seen in the last sample, in the order they were found */
+static struct ps_running *running = NULL;
+
+/* the pids listed in /proc, kept to save reallocating them every sample */
+static int *pids = NULL;
+static size_t allocated_pids = 0;
+static size_t n_pids = 0;
+
+/* the same for the threads of one process */
+static int *tids = NULL;
+static size_t allocated_tids = 0;
+static size_t n_tids = 0;
+
+/* the contents of the file read last, reused for every read */
+static char *read_buf = NULL;
+static size_t read_allocated = 0;
+
+/* records what is read, or with replay set, answers reads from a recording */
+static struct capture *capture = NULL;
+
+/* the cost of the sample being taken, and the probe its time is charged to */
+static struct sample_overhead *overhead = NULL;
+static SampleProbe probe = _PROBE_INVALID;
+static nsec_t probe_start = 0;
+
+static const char * const pressure_resource_table[_PRESSURE_RESOURCE_MAX] = {
+        [PRESSURE_CPU] = "cpu",
+        [PRESSURE_IO] = "io",
+        [PRESSURE_MEMORY] = "memory",
+};
+
+const char *pressure_resource_to_string(PressureResource r) {
+        if (r < 0 || r >= _PRESSURE_RESOURCE_MAX)
+                return NULL;
+
+        return pressure_resource_table[r];
+}
+
+static const char * const sample_probe_table[_PROBE_MAX] = {
+        [PROBE_VMSTAT] = "vmstat",
+        [PROBE_SCHEDSTAT] = "schedstat",
+        [PROBE_SYSTEM] = "system",
+        [PROBE_PROCESSES] = "processes",
+        [PROBE_THREADS] = "threads",
+        [PROBE_PSS] = "pss",
+        [PROBE_IO] = "io",
+        [PROBE_RENAME] = "rename",
+        [PROBE_DISKS] = "disks",
+        [PROBE_SERVICES] = "services",
+        [PROBE_KMSG] = "kmsg",
+};
+
+const char *sample_probe_to_string(SampleProbe p) {
+        if (p < 0 || p >= _PROBE_MAX)
+                return NULL;
+
+        return sample_probe_table[p];
+}
 
 double gettime_ns(void) {
         struct timespec n;
@@ -73,50 +127,505 @@ static char *bufgetline(char *buf) {
         return c;
 }
 
+void log_sample_capture(struct capture *c) {
+        capture = c;
+}
+
+/*
+ * Charges the time since the last switch to the probe that was
+ * running, and starts timing the next one. One clock read covers
+ * both, so timing the probes of every process stays cheap.
+ */
+static void probe_switch(SampleProbe next) {
+        nsec_t t;
+
+        t = now_nsec(CLOCK_MONOTONIC);
+        if (probe >= 0)
+                overhead->probe[probe] += t - probe_start;
+
+        probe = next;
+        probe_start = t;
+}
+
+static ssize_t proc_read_fd(int procfd, const char *path, int *fd) {
+        size_t size = 0;
+        ssize_t n;
+
+        if (*fd < 0) {
+                overhead->opens++;
+                overhead->syscalls++;
+
+                *fd = openat(procfd, path, O_RDONLY|O_CLOEXEC);
+                if (*fd < 0)
+                        return -errno;
+        }
+
+        /* a short read is the end of the file, grow until the whole file fits */
+        for (;;) {
+                size_t allocated = read_allocated;
+
+                if (!GREEDY_REALLOC(read_buf, read_allocated, size + 4096))
+                        return -ENOMEM;
+                if (read_allocated != allocated)
+                        overhead->allocations++;
+
+                overhead->reads++;
+                overhead->syscalls++;
+
+                n = pread(*fd, read_buf + size, read_allocated - size - 1, size);
+                if (n < 0) {
+                        n = -errno;
+                        *fd = safe_close(*fd);
+                        overhead->syscalls++;
+                        return n;
+                }
+
+                overhead->bytes += n;
+                size += n;
+                if (size < read_allocated - 1)
+                        break;
+        }
+
+        read_buf[size] = '\0';
+
+        return size;
+}
+
+/*
+ * Reads a whole file below /proc, the contents are NUL terminated and
+ * valid until the next read. With fd, the file is kept open between
+ * samples. Everything log_sample() reads goes through here, so that
+ * it can be recorded, and replayed without /proc.
+ */
+static ssize_t proc_read(int procfd, const char *path, int *fd, char **ret) {
+        _cleanup_close_ int tmp = -1;
+        ssize_t n;
+
+        if (capture && capture->replay) {
+                const char *data;
+
+                n = capture_get(capture, path, &data);
+                if (n < 0)
+                        return n;
+
+                if (!GREEDY_REALLOC(read_buf, read_allocated, n + 1))
+                        return -ENOMEM;
+
+                memcpy(read_buf, data, n);
+                read_buf[n] = '\0';
+                *ret = read_buf;
+
+                return n;
+        }
+
+        n = proc_read_fd(procfd, path, fd ?: &tmp);
+        if (tmp >= 0)
+                overhead->syscalls++;
+        if (capture)
+                capture_put(capture, path, read_buf, n);
+        if (n < 0)
+                return n;
+
+        *ret = read_buf;
+
+        return n;
+}
+
+static int compare_pid(const void *a, const void *b) {
+        const int *x = a, *y = b;
+
+        return *x < *y ? -1 : *x > *y;
+}
+
+static int proc_list_dir(DIR *d, int **ret, size_t *allocated, size_t *n) {
+        struct dirent *ent;
+
+        overhead->reads++;
+        overhead->syscalls++;
+
+        while ((ent = readdir(d)) != NULL) {
+                size_t a = *allocated;
+                int pid;
+
+                if ((ent->d_name[0] < '0') || (ent->d_name[0] > '9'))
+                        continue;
+
+                pid = atoi(ent->d_name);
+
+                if (pid >= MAXPIDS)
+                        continue;
+
+                if (!GREEDY_REALLOC(*ret, *allocated, *n + 1))
+                        return -ENOMEM;
+                if (*allocated != a)
+                        overhead->allocations++;
+
+                (*ret)[(*n)++] = pid;
+        }
+
+        return 0;
+}
+
+static int proc_list_parse(const char *data, size_t size, int **ret, size_t *allocated, size_t *n) {
+        const char *p = data, *e = data + size;
+
+        while (p < e) {
+                char *end;
+                long pid;
+
+                pid = strtol(p, &end, 10);
+                if (end == p || end >= e || *end != '\n' || pid < 0 || pid >= MAXPIDS)
+                        return -EBADMSG;
+
+                if (!GREEDY_REALLOC(*ret, *allocated, *n + 1))
+                        return -ENOMEM;
+
+                (*ret)[(*n)++] = (int) pid;
+                p = end + 1;
+        }
+
+        return 0;
+}
+
+static void proc_list_capture(const char *path, const int *list, size_t n) {
+        size_t i, size = 0;
+
+        /* one pid per line, written with room to spare */
+        if (!GREEDY_REALLOC(read_buf, read_allocated, n * 12 + 1)) {
+                capture_put(capture, path, NULL, -ENOMEM);
+                return;
+        }
+
+        for (i = 0; i < n; i++)
+                size += sprintf(read_buf + size, "%d\n", list[i]);
+
+        capture_put(capture, path, read_buf, size);
+}
+
+/*
+ * Lists the numbered entries of a directory below /proc, the pids or
+ * the tids of a process. The tree of processes is built assuming
+ * parents are found before their children, which holds for /proc as
+ * it lists pids in ascending order. Directories on other file systems,
+ * like the trees used with --root, are sorted to match.
+ */
+static int proc_list(int procfd, DIR *d, const char *path, int **ret, size_t *allocated, size_t *n) {
+        _cleanup_closedir_ DIR *opened = NULL;
+        bool sorted = true;
+        size_t i;
+        int r;
+
+        *n = 0;
+
+        if (capture && capture->replay) {
+                const char *data;
+                ssize_t size;
+
+                size = capture_get(capture, path, &data);
+                if (size < 0)
+                        return size;
+
+                return proc_list_parse(data, size, ret, allocated, n);
+        }
+
+        if (!d) {
+                int fd;
+
+                /* the open, and the close when done */
+                overhead->opens++;
+                overhead->syscalls += 2;
+
+                fd = openat(procfd, path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+                if (fd < 0) {
+                        r = -errno;
+                        goto finish;
+                }
+
+                opened = fdopendir(fd);
+                if (!opened) {
+                        r = -errno;
+                        safe_close(fd);
+                        goto finish;
+                }
+
+                d = opened;
+        }
+
+        r = proc_list_dir(d, ret, allocated, n);
+        if (r < 0)
+                goto finish;
+
+        for (i = 1; i < *n; i++)
+                if ((*ret)[i - 1] > (*ret)[i])
+                        sorted = false;
+
+        if (!sorted)
+                qsort(*ret, *n, sizeof(int), compare_pid);
+
+finish:
+        if (capture) {
+                if (r < 0)
+                        capture_put(capture, path, NULL, r);
+                else
+                        proc_list_capture(path, *ret, *n);
+        }
+
+        return r;
+}
+
 static int pid_cmdline_strscpy(int procfd, char *buffer, size_t buf_len, int pid) {
         char filename[PATH_MAX];
-        _cleanup_close_ int fd = -1;
+        char *buf;
         ssize_t n;
+        int i;
 
         sprintf(filename, "%d/cmdline", pid);
-        fd = openat(procfd, filename, O_RDONLY|O_CLOEXEC);
-        if (fd < 0)
-                return -errno;
-
-        n = read(fd, buffer, buf_len-1);
-        if (n > 0) {
-                int i;
-                for (i = 0; i < n; i++)
-                        if (buffer[i] == '\0')
-                                buffer[i] = ' ';
-                buffer[n] = '\0';
+        n = proc_read(procfd, filename, NULL, &buf);
+        if (n < 0)
+                return n;
+        /* kernel threads have no command line */
+        if (n == 0)
+                return -ENODATA;
+
+        n = MIN(n, (ssize_t) buf_len - 1);
+        for (i = 0; i < n; i++)
+                buffer[i] = buf[i] == '\0' ? ' ' : buf[i];
+        buffer[n] = '\0';
+
+        return 0;
+}
+
+static void ps_set_name(struct ps_struct *ps, const char *name) {
+        int r;
+
+        /* on failure keep the old name, it's only cosmetic */
+        r = strtab_intern(&ps_names, name);
+        if (r >= 0)
+                ps->name = r;
+}
+
+static int pressure_read(int procfd, PressureResource res, int *fd, struct pressure_stat_struct *ret) {
+        char filename[32];
+        char *buf;
+        char *m;
+        ssize_t n;
+
+        xsprintf(filename, "pressure/%s", pressure_resource_to_string(res));
+        n = proc_read(procfd, filename, fd, &buf);
+        if (n <= 0) {
+                *fd = safe_close(*fd);
+                return n < 0 ? n : -ENODATA;
+        }
+
+        /* "some avg10=0.00 avg60=0.00 avg300=0.00 total=0", the same for "full" */
+        for (m = buf; m; m = bufgetline(m)) {
+                unsigned long long total;
+                char *t;
+
+                t = strstr(m, "total=");
+                if (!t || sscanf(t, "total=%llu", &total) != 1)
+                        continue;
+
+                if (startswith(m, "some "))
+                        ret->some = total;
+                else if (startswith(m, "full "))
+                        ret->full = total;
         }
 
         return 0;
 }
 
-static void garbage_collect_dead_processes(struct ps_struct *ps_first) {
-        struct ps_struct *ps;
-        struct ps_struct *ps_next;
-
-        ps = ps_first;
-        while ((ps_next = ps->next_running)) {
-                if (!ps_next->still_running) {
-                        /* close the stream and fds */
-                        ps_next->schedstat = safe_close(ps_next->schedstat);
-                        ps_next->sched = safe_close(ps_next->sched);
-                        if (ps_next->smaps) {
-                                fclose(ps_next->smaps);
-                                ps_next->smaps = NULL;
-                        }
+static uint32_t io_delta(uint64_t *last, uint64_t now, uint64_t unit) {
+        uint64_t d;
 
-                        ps->next_running = ps_next->next_running;
-                } else {
-                        ps = ps_next;
+        /* counters are monotonic, but a reused pid could look otherwise */
+        if (now < *last) {
+                *last = now;
+                return 0;
+        }
+
+        /* only consume whole units, so rounding never accumulates */
+        d = (now - *last) / unit;
+        *last += d * unit;
+
+        return (uint32_t) MIN(d, (uint64_t) UINT32_MAX);
+}
+
+static void sample_io(int procfd, struct ps_running *run) {
+        struct ps_struct *ps = run->ps;
+        char filename[PATH_MAX];
+        char *buf;
+        char *m;
+        uint64_t v[4] = {};
+        unsigned found = 0;
+        ssize_t s;
+
+        sprintf(filename, "%d/io", ps->pid);
+        s = proc_read(procfd, filename, &run->io, &buf);
+        if (s <= 0) {
+                run->io = safe_close(run->io);
+                return;
+        }
+
+        for (m = buf; m; m = bufgetline(m)) {
+                unsigned long long val;
+
+                if (sscanf(m, "read_bytes: %llu", &val) == 1) {
+                        v[0] = val;
+                        found |= 1;
+                } else if (sscanf(m, "write_bytes: %llu", &val) == 1) {
+                        v[1] = val;
+                        found |= 2;
+                } else if (sscanf(m, "syscr: %llu", &val) == 1) {
+                        v[2] = val;
+                        found |= 4;
+                } else if (sscanf(m, "syscw: %llu", &val) == 1) {
+                        v[3] = val;
+                        found |= 8;
                 }
-                /* this resets the flag for both running and dead processes*/
-                ps_next->still_running = false;
         }
+
+        if (found != 15)
+                return;
+
+        /* the first read only establishes the baseline */
+        if (!run->io_seen) {
+                memcpy(run->io_last, v, sizeof(v));
+                run->io_seen = true;
+                return;
+        }
+
+        ps->sample->io_read = io_delta(&run->io_last[0], v[0], 1024);
+        ps->sample->io_write = io_delta(&run->io_last[1], v[1], 1024);
+        ps->sample->io_syscr = io_delta(&run->io_last[2], v[2], 1);
+        ps->sample->io_syscw = io_delta(&run->io_last[3], v[3], 1);
+        ps->sample->io = true;
+
+        ps->io_read += ps->sample->io_read;
+        ps->io_write += ps->sample->io_write;
+        ps->io_syscr += ps->sample->io_syscr;
+        ps->io_syscw += ps->sample->io_syscw;
+}
+
+/*
+ * Looks up the cgroup of a process in the systemd hierarchy, or the
+ * unified one if there is no named systemd hierarchy. This is called
+ * repeatedly for every process, so unlike cg_pid_get_path() it reads
+ * the file into the shared buffer and doesn't allocate the path.
+ */
+static int pid_cgroup(int procfd, int pid, int *ret) {
+        char filename[PATH_MAX];
+        char *buf, *line, *next, *path = NULL;
+        ssize_t n;
+        int r;
+
+        sprintf(filename, "%d/cgroup", pid);
+        n = proc_read(procfd, filename, NULL, &buf);
+        if (n < 0)
+                return n;
+
+        /* lines are "hierarchy-ID:controller-list:path" */
+        for (line = buf; line && *line; line = next) {
+                char *p;
+
+                next = strchr(line, '\n');
+                if (next)
+                        *(next++) = '\0';
+
+                p = startswith(line, "0::");
+                if (p) {
+                        if (!path)
+                                path = p;
+                        continue;
+                }
+
+                p = strchr(line, ':');
+                if (!p)
+                        continue;
+                p = startswith(p + 1, "name=systemd:");
+                if (p) {
+                        path = p;
+                        break;
+                }
+        }
+
+        if (!path)
+                return -ENODATA;
+
+        r = strtab_intern(&cgroup_paths, path);
+        if (r < 0)
+                return r;
+
+        *ret = r;
+
+        return 0;
+}
+
+static int update_cgroup(int procfd, struct ps_struct *ps, double t) {
+        struct cgroup_change *c;
+        int cgroup, r;
+
+        r = pid_cgroup(procfd, ps->pid, &cgroup);
+        if (r < 0)
+                return r;
+
+        if (cgroup == ps->cgroup)
+                return 0;
+
+        /* the cgroup found with the process isn't a change */
+        if (ps->cgroup >= 0) {
+                c = realloc_multiply(ps->cgroup_changes, ps->n_cgroup_changes + 1, sizeof(*c));
+                if (!c)
+                        return -ENOMEM;
+
+                c[ps->n_cgroup_changes++] = (struct cgroup_change) {
+                        .time = t,
+                        .cgroup = cgroup,
+                };
+                ps->cgroup_changes = c;
+        }
+
+        ps->cgroup = cgroup;
+
+        return 1;
+}
+
+static struct ps_running *running_free(struct ps_running *run) {
+        struct ps_running *next = run->next;
+
+        /* close the stream and fds */
+        safe_close(run->schedstat);
+        safe_close(run->sched);
+        safe_close(run->io);
+        safe_close(run->smaps);
+        free(run);
+
+        return next;
+}
+
+static void garbage_collect_dead_processes(void) {
+        struct ps_running **run = &running;
+
+        while (*run) {
+                if (!(*run)->still_running)
+                        *run = running_free(*run);
+                else {
+                        (*run)->still_running = false;
+                        run = &(*run)->next;
+                }
+        }
+}
+
+void log_sample_done(void) {
+        while (running)
+                running = running_free(running);
+
+        pids = mfree(pids);
+        n_pids = allocated_pids = 0;
+        tids = mfree(tids);
+        n_tids = allocated_tids = 0;
+        read_buf = mfree(read_buf);
+        read_allocated = 0;
 }
 
 
@@ -128,9 +637,9 @@ int log_sample(DIR *proc,
                int *cpus) {
 
         static int vmstat = -1;
-        _cleanup_free_ char *buf_schedstat = NULL;
-        char buf[4096];
+        char *buf;
         char key[256];
+        char cmdline[256];
         char val[256];
         char rt[256];
         char wt[256];
@@ -139,39 +648,37 @@ int log_sample(DIR *proc,
         int c;
         int p;
         int mod;
+        size_t i;
         static int e_fd = -1;
+        static int pressure_fd[_PRESSURE_RESOURCE_MAX] = { -1, -1, -1 };
+        static bool pressure_missing = false;
         ssize_t s;
         ssize_t n;
-        struct dirent *ent;
-        int fd;
         struct list_sample_data *sampledata;
-        struct ps_sched_struct *ps_prev = NULL;
-        int procfd;
-        int taskfd = -1;
+        const struct governor_rates *rates;
+        int procfd = -1;
 
         sampledata = *ptr;
-
-        procfd = dirfd(proc);
-        if (procfd < 0)
-                return -errno;
-
-        if (vmstat < 0) {
-                /* block stuff */
-                vmstat = openat(procfd, "vmstat", O_RDONLY|O_CLOEXEC);
-                if (vmstat < 0)
-                        return log_error_errno(errno, "Failed to open /proc/vmstat: %m");
+        overhead = &sampledata->overhead;
+        rates = governor_rates(overhead->governor);
+        probe_switch(PROBE_VMSTAT);
+
+        /* a replay has no /proc */
+        if (proc) {
+                procfd = dirfd(proc);
+                if (procfd < 0)
+                        return -errno;
         }
 
-        n = pread(vmstat, buf, sizeof(buf) - 1, 0);
+        /* block stuff */
+        n = proc_read(procfd, "vmstat", &vmstat, &buf);
         if (n <= 0) {
                 vmstat = safe_close(vmstat);
                 if (n < 0)
-                        return -errno;
+                        return log_error_errno(n, "Failed to read /proc/vmstat: %m");
                 return -ENODATA;
         }
 
-        buf[n] = '\0';
-
         m = buf;
         while (m) {
                 if (sscanf(m, "%s %s", key, val) < 2)
@@ -189,11 +696,12 @@ vmstat_next:
         }
 
         /* Parse "/proc/schedstat" for overall CPU utilization */
-        r = read_full_file("/proc/schedstat", &buf_schedstat, NULL);
-        if (r < 0)
-            return log_error_errno(r, "Unable to read schedstat: %m");
+        probe_switch(PROBE_SCHEDSTAT);
+        n = proc_read(procfd, "schedstat", NULL, &buf);
+        if (n < 0)
+            return log_error_errno(n, "Unable to read schedstat: %m");
 
-        m = buf_schedstat;
+        m = buf;
         while (m) {
                 if (sscanf(m, "%s %*s %*s %*s %*s %*s %*s %s %s", key, rt, wt) < 3)
                         goto schedstat_next;
@@ -215,95 +723,114 @@ schedstat_next:
                         break;
         }
 
-        if (arg_entropy) {
-                if (e_fd < 0) {
-                        e_fd = openat(procfd, "sys/kernel/random/entropy_avail", O_RDONLY|O_CLOEXEC);
-                        if (e_fd < 0)
-                                return log_error_errno(errno, "Failed to open /proc/sys/kernel/random/entropy_avail: %m");
-                }
+        probe_switch(PROBE_SYSTEM);
 
-                n = pread(e_fd, buf, sizeof(buf) - 1, 0);
-                if (n <= 0) {
+        if (arg_entropy) {
+                n = proc_read(procfd, "sys/kernel/random/entropy_avail", &e_fd, &buf);
+                if (n == -ENOENT)
+                        return log_error_errno(n, "Failed to open /proc/sys/kernel/random/entropy_avail: %m");
+                if (n <= 0)
                         e_fd = safe_close(e_fd);
-                } else {
-                        buf[n] = '\0';
+                else
                         sampledata->entropy_avail = atoi(buf);
+        }
+
+        if (arg_pressure && !pressure_missing) {
+                PressureResource res;
+
+                for (res = 0; res < _PRESSURE_RESOURCE_MAX; res++) {
+                        r = pressure_read(procfd, res, &pressure_fd[res], &sampledata->pressure[res]);
+                        if (r == -ENOENT || r == -EOPNOTSUPP) {
+                                /* kernel without CONFIG_PSI, or booted with psi=0 */
+                                log_info_errno(r, "Pressure stall information not available, not recording it: %m");
+                                pressure_missing = true;
+                                break;
+                        }
                 }
         }
 
-        while ((ent = readdir(proc)) != NULL) {
-                char filename[PATH_MAX];
-                int pid;
-                struct ps_struct *ps;
+        probe_switch(PROBE_PROCESSES);
 
-                if ((ent->d_name[0] < '0') || (ent->d_name[0] > '9'))
-                        continue;
+        r = proc_list(procfd, proc, ".", &pids, &allocated_pids, &n_pids);
+        if (r < 0)
+                return log_error_errno(r, "Failed to list processes: %m");
 
-                pid = atoi(ent->d_name);
+        for (i = 0; i < n_pids; i++) {
+                char filename[PATH_MAX];
+                int pid = pids[i];
+                struct ps_struct *ps;
+                struct ps_running *run, *run_prev = NULL, **run_next;
 
-                if (pid >= MAXPIDS)
-                        continue;
+                /* the rest of a process that was skipped with continue is charged to its probe */
+                probe_switch(PROBE_PROCESSES);
 
-                ps = ps_first;
-                while (ps->next_running) {
-                        ps = ps->next_running;
-                        if (ps->pid == pid)
-                                break;
+                run_next = &running;
+                while (*run_next && (*run_next)->pid != pid) {
+                        run_prev = *run_next;
+                        run_next = &(*run_next)->next;
                 }
 
                 /* end of our LL? then append a new record */
-                if (ps->pid != pid) {
-                        _cleanup_fclose_ FILE *st = NULL;
+                if (!*run_next) {
                         char t[32];
                         struct ps_struct *parent;
+                        struct ps_struct **ps_next;
 
-                        /* find the insertion point for the last item */
-                        struct ps_struct **ps_next = &ps->next_ps;
+                        /* find the insertion point for the last item, which is after the last running one */
+                        ps_next = run_prev ? &run_prev->ps->next_ps : &ps_first->next_ps;
                         while (*ps_next) {
                                 ps_next = &(*ps_next)->next_ps;
                         }
 
                         assert(!*ps_next);
-                        assert(!ps->next_running);
-                        *ps_next = ps->next_running = new0(struct ps_struct, 1);
+                        *ps_next = new0(struct ps_struct, 1);
                         if (!*ps_next)
                                 return log_oom();
 
+                        *run_next = new0(struct ps_running, 1);
+                        if (!*run_next)
+                                return log_oom();
+
                         ps = *ps_next;
                         ps->pid = pid;
-                        ps->sched = -1;
-                        ps->schedstat = -1;
+                        ps->name = -1;
+                        ps->cgroup = -1;
+
+                        run = *run_next;
+                        run->pid = pid;
+                        run->ps = ps;
+                        run->sched = -1;
+                        run->schedstat = -1;
+                        run->io = -1;
+                        run->smaps = -1;
 
                         ps->sample = new0(struct ps_sched_struct, 1);
                         if (!ps->sample)
                                 return log_oom();
 
+                        /* the process, its sampler state and its first sample */
+                        overhead->allocations += 3;
+
                         ps->sample->sampledata = sampledata;
 
                         (*pscount)++;
 
                         /* mark our first sample */
                         ps->first = ps->last = ps->sample;
+                        ps->last_seen = sampledata->sampletime;
 
                         /* get name, start time; requires CONFIG_SCHED_DEBUG in kernel */
-                        if (ps->sched < 0) {
-                                sprintf(filename, "%d/sched", pid);
-                                ps->sched = openat(procfd, filename, O_RDONLY|O_CLOEXEC);
-                                if (ps->sched < 0)
-                                        goto no_sched;
-                        }
-
-                        s = pread(ps->sched, buf, sizeof(buf) - 1, 0);
+                        sprintf(filename, "%d/sched", pid);
+                        s = proc_read(procfd, filename, &run->sched, &buf);
                         if (s <= 0) {
-                                ps->sched = safe_close(ps->sched);
+                                run->sched = safe_close(run->sched);
                                 goto no_sched;
                         }
-                        buf[s] = '\0';
 
                         if (!sscanf(buf, "%s %*s %*s", key))
                                 goto no_sched;
 
-                        strscpy(ps->name, sizeof(ps->name), key);
+                        ps_set_name(ps, key);
 
                         /* discard line 2 */
                         m = bufgetline(buf);
@@ -325,27 +852,19 @@ schedstat_next:
 
 no_sched:
                         /* cmdline */
-                        if (arg_show_cmdline)
-                                pid_cmdline_strscpy(procfd, ps->name, sizeof(ps->name), pid);
+                        if (arg_show_cmdline && pid_cmdline_strscpy(procfd, cmdline, sizeof(cmdline), pid) >= 0)
+                                ps_set_name(ps, cmdline);
 
-                        if (arg_show_cgroup)
+                        if (arg_show_cgroup || arg_service_view == SERVICE_VIEW_EXPANDED)
                                 /* if this fails, that's OK */
-                                cg_pid_get_path(SYSTEMD_CGROUP_CONTROLLER,
-                                                ps->pid, &ps->cgroup);
+                                (void) pid_cgroup(procfd, pid, &ps->cgroup);
 
                         /* ppid */
                         sprintf(filename, "%d/stat", pid);
-                        fd = openat(procfd, filename, O_RDONLY|O_CLOEXEC);
-                        if (fd < 0)
+                        if (proc_read(procfd, filename, NULL, &buf) < 0)
                                 continue;
 
-                        st = fdopen(fd, "re");
-                        if (!st) {
-                                close(fd);
-                                continue;
-                        }
-
-                        if (!fscanf(st, "%*s %*s %*s %i", &p))
+                        if (sscanf(buf, "%*s %*s %*s %i", &p) != 1)
                                 continue;
 
                         ps->ppid = p;
@@ -386,26 +905,28 @@ no_sched:
                                         *children = ps;
                                 }
                         }
+                } else {
+                        /* found pid, append data in ps */
+                        run = *run_next;
+                        ps = run->ps;
+                        ps->last_seen = sampledata->sampletime;
+
+                        /* the governor has us sample each process less often, staggered by pid */
+                        if ((sample + pid) % rates->processes != 0) {
+                                run->still_running = true;
+                                continue;
+                        }
                 }
-                /* else -> found pid, append data in ps */
 
                 /* below here is all continuous logging parts - we get here on every
                  * iteration */
 
                 /* rt, wt */
-                if (ps->schedstat < 0) {
-                        sprintf(filename, "%d/schedstat", pid);
-                        ps->schedstat = openat(procfd, filename, O_RDONLY|O_CLOEXEC);
-                        if (ps->schedstat < 0)
-                                continue;
-                }
-
-                s = pread(ps->schedstat, buf, sizeof(buf) - 1, 0);
+                sprintf(filename, "%d/schedstat", pid);
+                s = proc_read(procfd, filename, &run->schedstat, &buf);
                 if (s <= 0)
                         continue;
 
-                buf[s] = '\0';
-
                 if (!sscanf(buf, "%s %s %*s", rt, wt))
                         continue;
 
@@ -413,6 +934,8 @@ no_sched:
                 if (!ps->sample->next)
                         return log_oom();
 
+                overhead->allocations++;
+
                 ps->sample->next->prev = ps->sample;
                 ps->sample = ps->sample->next;
                 ps->last = ps->sample;
@@ -420,10 +943,6 @@ no_sched:
                 ps->sample->waittime = atoll(wt);
                 ps->sample->sampledata = sampledata;
                 ps->sample->ps_new = ps;
-                if (ps_prev)
-                        ps_prev->cross = ps->sample;
-
-                ps_prev = ps->sample;
                 ps->total = (ps->last->runtime - ps->first->runtime)
                             / 1000000000.0;
 
@@ -433,41 +952,31 @@ no_sched:
                  */
 
                 /* Browse directory "/proc/[pid]/task" to know the thread ids of process [pid] */
+                probe_switch(PROBE_THREADS);
                 snprintf(filename, sizeof(filename), PID_FMT "/task", pid);
-                taskfd = openat(procfd, filename, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
-                if (taskfd >= 0) {
-                        _cleanup_closedir_ DIR *taskdir = NULL;
-
-                        taskdir = fdopendir(taskfd);
-                        if (!taskdir) {
-                                safe_close(taskfd);
-                                return -errno;
-                        }
-                        FOREACH_DIRENT(ent, taskdir, break) {
-                                int tid = -1;
-                                _cleanup_close_ int tid_schedstat = -1;
+                /* when the governor skips them, the threads count with what they had last time */
+                if ((!run->threads_seen || (sample + pid) % rates->expensive == 0) &&
+                    proc_list(procfd, NULL, filename, &tids, &allocated_tids, &n_tids) >= 0) {
+                        size_t j;
+
+                        run->threads_seen = true;
+                        run->threads_runtime = 0;
+                        run->threads_waittime = 0;
+
+                        for (j = 0; j < n_tids; j++) {
+                                int tid = tids[j];
                                 long long delta_rt;
                                 long long delta_wt;
 
-                                if ((ent->d_name[0] < '0') || (ent->d_name[0] > '9'))
-                                        continue;
-
                                 /* Skip main thread as it was already accounted */
-                                r = safe_atoi(ent->d_name, &tid);
-                                if (r < 0 || tid == pid)
+                                if (tid == pid)
                                         continue;
 
                                 /* Parse "/proc/[pid]/task/[tid]/schedstat" */
-                                snprintf(filename, sizeof(filename), PID_FMT "/schedstat", tid);
-                                tid_schedstat = openat(taskfd, filename, O_RDONLY|O_CLOEXEC);
-
-                                if (tid_schedstat == -1)
-                                        continue;
-
-                                s = pread(tid_schedstat, buf, sizeof(buf) - 1, 0);
+                                snprintf(filename, sizeof(filename), PID_FMT "/task/" PID_FMT "/schedstat", pid, tid);
+                                s = proc_read(procfd, filename, NULL, &buf);
                                 if (s <= 0)
                                         continue;
-                                buf[s] = '\0';
 
                                 if (!sscanf(buf, "%s %s %*s", rt, wt))
                                         continue;
@@ -475,38 +984,40 @@ no_sched:
                                 r = safe_atolli(rt, &delta_rt);
                                 if (r < 0)
                                     continue;
-                                r = safe_atolli(rt, &delta_wt);
+                                r = safe_atolli(wt, &delta_wt);
                                 if (r < 0)
                                     continue;
-                                ps->sample->runtime  += delta_rt;
-                                ps->sample->waittime += delta_wt;
+                                run->threads_runtime += delta_rt;
+                                run->threads_waittime += delta_wt;
                         }
                 }
 
+                ps->sample->runtime += run->threads_runtime;
+                ps->sample->waittime += run->threads_waittime;
+
                 if (!arg_pss)
                         goto catch_rename;
 
+                /* keep the last PSS while the governor skips it, the first sample is always taken */
+                if (ps->sample->prev != ps->first && (sample + pid) % rates->expensive != 0) {
+                        ps->sample->pss = ps->sample->prev->pss;
+                        goto catch_rename;
+                }
+
                 /* Pss */
-                if (!ps->smaps) {
-                        /* smaps_rollup was introduced in kernel 4.14 */
-                        sprintf(filename, "%d/smaps_rollup", pid);
-                        fd = openat(procfd, filename, O_RDONLY|O_CLOEXEC);
-                        if (fd < 0) {
-                                sprintf(filename, "%d/smaps", pid);
-                                /* If we can't open smaps_rollup, try with smaps */
-                                fd = openat(procfd, filename, O_RDONLY|O_CLOEXEC);
-                        }
-                        if (fd < 0)
-                                goto catch_rename;
-                        ps->smaps = fdopen(fd, "re");
-                        if (!ps->smaps) {
-                                close(fd);
-                                goto catch_rename;
-                        }
-                        setvbuf(ps->smaps, smaps_buf, _IOFBF, sizeof(smaps_buf));
-                } else {
-                        rewind(ps->smaps);
+                probe_switch(PROBE_PSS);
+
+                /* smaps_rollup was introduced in kernel 4.14 */
+                sprintf(filename, run->no_rollup ? "%d/smaps" : "%d/smaps_rollup", pid);
+                s = proc_read(procfd, filename, &run->smaps, &buf);
+                if (s < 0 && !run->no_rollup) {
+                        /* If we can't open smaps_rollup, try with smaps */
+                        run->no_rollup = true;
+                        sprintf(filename, "%d/smaps", pid);
+                        s = proc_read(procfd, filename, &run->smaps, &buf);
                 }
+                if (s < 0)
+                        goto catch_rename;
 
                 /* Sum all 'Pss:' lines (this is needed when we are not
                  * reading smaps_rollup).
@@ -514,10 +1025,10 @@ no_sched:
                  * present.
                  */
                 ps->sample->pss = 0;
-                while (fgets(buf, sizeof(buf), ps->smaps) != NULL) {
-                        if(strncmp(buf, "Pss:", 4) == 0) {
+                for (m = buf; m; m = bufgetline(m)) {
+                        if (startswith(m, "Pss:")) {
                                 /* read the Pss line */
-                                ps->sample->pss += atoi(buf + 4);
+                                ps->sample->pss += atoi(m + 4);
                         }
                 }
 
@@ -525,39 +1036,46 @@ no_sched:
                         ps->pss_max = ps->sample->pss;
 
 catch_rename:
+                /* per process IO, on a sub-rate and staggered by pid */
+                if (arg_io && (!run->io_seen || (sample + pid) % arg_io_interval == 0)) {
+                        probe_switch(PROBE_IO);
+                        sample_io(procfd, run);
+                }
+
                 /* catch process rename, try to randomize time */
-                mod = (arg_hz < 4.0) ? 4.0 : (arg_hz / 4.0);
+                mod = ((arg_hz < 4.0) ? 4.0 : (arg_hz / 4.0)) * rates->expensive;
                 if (((sample - ps->pid) + pid) % (int)(mod) == 0) {
+                        probe_switch(PROBE_RENAME);
+
+                        /* systemd moves its children into their unit after forking them */
+                        if (arg_show_cgroup || arg_service_view == SERVICE_VIEW_EXPANDED)
+                                (void) update_cgroup(procfd, ps, sampledata->sampletime);
 
                         /* re-fetch name */
                         /* get name, start time */
-                        if (ps->sched < 0) {
-                                sprintf(filename, "%d/sched", pid);
-                                ps->sched = openat(procfd, filename, O_RDONLY|O_CLOEXEC);
-                                if (ps->sched < 0)
-                                        goto no_sched2;
-                        }
-
-                        s = pread(ps->sched, buf, sizeof(buf) - 1, 0);
+                        sprintf(filename, "%d/sched", pid);
+                        s = proc_read(procfd, filename, &run->sched, &buf);
+                        if (s == -ENOENT || s == -EACCES)
+                                goto no_sched2;
                         if (s <= 0)
                                 continue;
 
-                        buf[s] = '\0';
-
                         if (!sscanf(buf, "%s %*s %*s", key))
                                 continue;
 
-                        strscpy(ps->name, sizeof(ps->name), key);
+                        ps_set_name(ps, key);
 
 no_sched2:
                         /* cmdline */
-                        if (arg_show_cmdline)
-                                pid_cmdline_strscpy(procfd, ps->name, sizeof(ps->name), pid);
+                        if (arg_show_cmdline && pid_cmdline_strscpy(procfd, cmdline, sizeof(cmdline), pid) >= 0)
+                                ps_set_name(ps, cmdline);
                 }
-                ps->still_running = true;
+                run->still_running = true;
         }
 
-        garbage_collect_dead_processes(ps_first);
+        probe_switch(PROBE_PROCESSES);
+        garbage_collect_dead_processes();
+        probe_switch(_PROBE_INVALID);
 
         return 0;
 }
@@ -25,6 +25,11 @@
 #include <dirent.h>
 
 #include "bootchart.h"
+#include "capture.h"
+#include "macro.h"
+
+const char *pressure_resource_to_string(PressureResource r) _const_;
+const char *sample_probe_to_string(SampleProbe p) _const_;
 
 double gettime_ns(void);
 void log_uptime(void);
@@ -34,3 +39,10 @@ int log_sample(DIR *proc,
                struct list_sample_data **ptr,
                int *pscount,
                int *cpus);
+/* closes the files kept open for the running processes */
+void log_sample_done(void);
+/*
+ * Records every file log_sample() reads into c, or when c is a replay,
+ * reads them from it; proc is NULL then. NULL reads /proc again.
+ */
+void log_sample_capture(struct capture *c);
@@ -0,0 +1,93 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "macro.h"
+#include "strtab.h"
+
+int strtab_intern(struct strtab *t, const char *s) {
+        void *v;
+        char *c;
+        int r;
+
+        assert(t);
+        assert(s);
+
+        v = hashmap_get(t->index, s);
+        if (v)
+                return PTR_TO_INT(v) - 1;
+
+        r = hashmap_ensure_allocated(&t->index, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        if (!GREEDY_REALLOC(t->strings, t->allocated_strings, t->n_strings + 1))
+                return -ENOMEM;
+
+        c = strdup(s);
+        if (!c)
+                return -ENOMEM;
+
+        r = hashmap_put(t->index, c, INT_TO_PTR(t->n_strings + 1));
+        if (r < 0) {
+                free(c);
+                return r;
+        }
+
+        t->strings[t->n_strings] = c;
+
+        return (int) t->n_strings++;
+}
+
+int strtab_find(const struct strtab *t, const char *s) {
+        void *v;
+
+        assert(t);
+        assert(s);
+
+        v = hashmap_get(t->index, s);
+        if (!v)
+                return -ENOENT;
+
+        return PTR_TO_INT(v) - 1;
+}
+
+const char *strtab_get(const struct strtab *t, int i) {
+        assert(t);
+
+        if (i < 0 || (size_t) i >= t->n_strings)
+                return NULL;
+
+        return t->strings[i];
+}
+
+void strtab_done(struct strtab *t) {
+        size_t i;
+
+        assert(t);
+
+        for (i = 0; i < t->n_strings; i++)
+                free(t->strings[i]);
+
+        t->strings = mfree(t->strings);
+        t->n_strings = t->allocated_strings = 0;
+        t->index = hashmap_free(t->index);
+}
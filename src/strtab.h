@@ -0,0 +1,44 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stddef.h>
+
+#include "hashmap.h"
+
+/*
+ * Deduplicated strings, referred to by index. Strings are never
+ * removed, so an index stays valid for the lifetime of the table.
+ */
+struct strtab {
+        char **strings;
+        size_t n_strings;
+        size_t allocated_strings;
+        /* string -> index + 1 */
+        Hashmap *index;
+};
+
+#define STRTAB_INIT {}
+
+/* the index of s, adding a copy if it isn't known yet, or -errno */
+int strtab_intern(struct strtab *t, const char *s);
+/* the index of s, or -ENOENT if it isn't known */
+int strtab_find(const struct strtab *t, const char *s);
+/* NULL for negative indices */
+const char *strtab_get(const struct strtab *t, int i);
+void strtab_done(struct strtab *t);
@@ -21,23 +21,35 @@
  ***/
 
 #include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/utsname.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "alloc-util.h"
-#include "architecture.h"
 #include "bootchart.h"
+#include "cpu-topology.h"
+#include "disk.h"
 #include "fd-util.h"
-#include "fileio.h"
+#include "efi.h"
+#include "governor.h"
+#include "idle.h"
+#include "kmsg.h"
 #include "list.h"
 #include "log.h"
 #include "macro.h"
+#include "path-util.h"
 #include "stdio-util.h"
+#include "store.h"
+#include "string-util.h"
 #include "svg.h"
+#include "time-util.h"
 #include "utf8.h"
 
 #define time_to_graph(t) ((t) * arg_scale_x)
@@ -46,6 +58,12 @@
 #define to_color(n) (192.0 - ((n) * 192.0))
 #define to_ms(n) (1000.0 * n)
 
+/* color steps of the per-CPU heatmap, level 0 isn't drawn */
+#define HEATMAP_LEVELS 8
+
+/* per process IO strips are half their full height at this rate, in kB/s */
+#define IO_RATE_HALF (10.0 * 1024.0)
+
 static const char * const colorwheel[12] = {
         "rgb(255,32,32)",  // red
         "rgb(32,192,192)", // cyan
@@ -61,19 +79,31 @@ static const char * const colorwheel[12] = {
         "rgb(32,192,32)"   // yellow-green
 };
 
-static double idletime = -1.0;
-static int pfiltered = 0;
-static int pcount = 0;
-static int kcount = 0;
-static double psize = 0;
-static double ksize = 0;
-static double esize = 0;
-static struct list_sample_data *sampledata;
-static struct list_sample_data *prev_sampledata;
-
-static void svg_header(FILE *of, struct list_sample_data *head, double graph_start, int n_cpus) {
+/* rows and heights of the tracks of one chart, worked out by svg_do() before drawing */
+struct svg_layout {
+        double idletime;
+        int pfiltered;
+        int pcount;
+        int kcount;
+        int kecount;
+        int dcount;
+        int scount;
+        double psize;
+        double ksize;
+        double kesize;
+        double bsize;
+        double esize;
+        double hsize;
+        double dsize;
+        double prsize;
+        double ovsize;
+        double ssize;
+};
+
+static void svg_header(FILE *of, struct list_sample_data *head, const struct svg_layout *layout, double graph_start, int n_cpus) {
         double w;
         double h;
+        struct list_sample_data *sampledata;
         struct list_sample_data *sampledata_last;
 
         assert(head);
@@ -90,7 +120,9 @@ static void svg_header(FILE *of, struct list_sample_data *head, double graph_sta
         /* height is variable based on pss, psize, ksize */
         h = 400.0 + (arg_scale_y * 30.0) /* base graphs and title */
             + (arg_pss ? (100.0 * arg_scale_y) + (arg_scale_y * 7.0) : 0.0) /* pss estimate */
-            + psize + ksize + esize + ((n_cpus+1) * 15 * arg_scale_y);
+            + layout->psize + layout->ksize + layout->kesize + layout->esize + layout->hsize
+            + layout->bsize + layout->dsize + layout->prsize + layout->ovsize + layout->ssize
+            + ((n_cpus+1) * 15 * arg_scale_y);
 
         fprintf(of, "<?xml version=\"1.0\" standalone=\"no\"?>\n");
         fprintf(of, "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" ");
@@ -121,7 +153,10 @@ static void svg_header(FILE *of, struct list_sample_data *head, double graph_sta
         fprintf(of, "<!-- ScaleY=%f -->\n", arg_scale_y);
         fprintf(of, "<!-- ControlGroup=%d -->\n", arg_show_cgroup);
         fprintf(of, "<!-- PerCPU=%d -->\n", arg_percpu);
-        fprintf(of, "<!-- Cmdline=%d -->\n\n", arg_show_cmdline);
+        fprintf(of, "<!-- Cmdline=%d -->\n", arg_show_cmdline);
+        fprintf(of, "<!-- Compress=%d -->\n", arg_compress);
+        fprintf(of, "<!-- PerCPUHeatmap=%d -->\n", arg_cpu_heatmap);
+        fprintf(of, "<!-- PerCPUGroup=%s -->\n\n", cpu_group_to_string(arg_cpu_group));
 
         /* style sheet */
         fprintf(of, "<defs>\n  <style type=\"text/css\">\n    <![CDATA[\n");
@@ -135,6 +170,18 @@ static void svg_header(FILE *of, struct list_sample_data *head, double graph_sta
         fprintf(of, "      rect.ps    { fill: rgb(192,192,192); stroke: rgb(128,128,128); fill-opacity: 0.7; }\n");
         fprintf(of, "      rect.krnl  { fill: rgb(240,240,0); stroke: rgb(128,128,128); fill-opacity: 0.7; }\n");
         fprintf(of, "      rect.box   { fill: rgb(240,240,240); stroke: rgb(192,192,192); }\n");
+        if (layout->bsize > 0) {
+                fprintf(of, "      rect.bfw   { fill: rgb(160,160,160); stroke: rgb(128,128,128); fill-opacity: 0.7; }\n");
+                fprintf(of, "      rect.bld   { fill: rgb(240,176,0); stroke: rgb(128,128,128); fill-opacity: 0.7; }\n");
+                fprintf(of, "      rect.bkrn  { fill: rgb(240,240,0); stroke: rgb(128,128,128); fill-opacity: 0.7; }\n");
+                fprintf(of, "      rect.busr  { fill: rgb(64,64,240); stroke: rgb(128,128,128); fill-opacity: 0.7; }\n");
+        }
+        if (layout->kecount) {
+                fprintf(of, "      rect.kmod  { fill: rgb(240,176,0); stroke: rgb(128,128,128); fill-opacity: 0.7; }\n");
+                fprintf(of, "      rect.kprb  { fill: rgb(128,192,128); stroke: rgb(128,128,128); fill-opacity: 0.7; }\n");
+                fprintf(of, "      line.kfw   { stroke: rgb(64,64,240); stroke-width: 3; }\n");
+                fprintf(of, "      line.kfwf  { stroke: rgb(240,0,0); stroke-width: 3; }\n");
+        }
         fprintf(of, "      rect.clrw  { stroke-width: 0; fill-opacity: 0.7;}\n");
         fprintf(of, "      line       { stroke: rgb(64,64,64); stroke-width: 1; }\n");
         fprintf(of, "//    line.sec1  { }\n");
@@ -143,6 +190,35 @@ static void svg_header(FILE *of, struct list_sample_data *head, double graph_sta
         fprintf(of, "      line.dot   { stroke-dasharray: 2 4; }\n");
         fprintf(of, "      line.idle  { stroke: rgb(64,64,64); stroke-dasharray: 10 6; stroke-opacity: 0.7; }\n");
 
+        if (arg_pressure || layout->scount) {
+                fprintf(of, "      rect.psome { fill: rgb(240,128,128); stroke-width: 0; fill-opacity: 0.7; }\n");
+                fprintf(of, "      rect.pfull { fill: rgb(192,0,0); stroke-width: 0; fill-opacity: 0.7; }\n");
+        }
+        if (layout->ovsize > 0) {
+                fprintf(of, "      line.gov   { stroke: rgb(192,0,0); stroke-width: 1; stroke-dasharray: 4 2; }\n");
+                fprintf(of, "      rect.ovwall { fill: rgb(192,192,192); stroke-width: 0; fill-opacity: 0.7; }\n");
+                fprintf(of, "      rect.ovcpu { fill: rgb(64,64,240); stroke-width: 0; fill-opacity: 0.7; }\n");
+        }
+        if (layout->dcount) {
+                fprintf(of, "      rect.dutil { fill: rgb(240,176,0); stroke-width: 0; fill-opacity: 0.7; }\n");
+                fprintf(of, "      line.dlat  { stroke: rgb(192,64,64); stroke-width: 2; }\n");
+        }
+        if (arg_io) {
+                fprintf(of, "      rect.pior  { fill: rgb(64,160,64); stroke-width: 0; fill-opacity: 0.8; }\n");
+                fprintf(of, "      rect.piow  { fill: rgb(192,64,64); stroke-width: 0; fill-opacity: 0.8; }\n");
+        }
+
+        if (arg_cpu_heatmap) {
+                int l;
+
+                for (l = 1; l <= HEATMAP_LEVELS; l++) {
+                        fprintf(of, "      rect.hu%-2d { fill: rgb(64,64,240); stroke-width: 0; fill-opacity: %.3f; }\n",
+                                l, (double) l / HEATMAP_LEVELS);
+                        fprintf(of, "      rect.hw%-2d { fill: rgb(240,240,0); stroke-width: 0; fill-opacity: %.3f; }\n",
+                                l, (double) l / HEATMAP_LEVELS);
+                }
+        }
+
         fprintf(of, "      .run       { font-size: 8; font-style: italic; }\n");
         fprintf(of, "      text       { font-family: Verdana, Helvetica; font-size: 10; }\n");
         fprintf(of, "      text.sec   { font-size: 8; }\n");
@@ -153,44 +229,165 @@ static void svg_header(FILE *of, struct list_sample_data *head, double graph_sta
         fprintf(of, "    ]]>\n   </style>\n</defs>\n\n");
 }
 
-static int svg_title(FILE *of, const char *build, int pscount, double log_start, int overrun) {
-        _cleanup_free_ char *cmdline = NULL;
+static int compare_uint32(const void *a, const void *b) {
+        const uint32_t *x = a, *y = b;
+
+        return *x < *y ? -1 : *x > *y;
+}
+
+/* how punctual the n measured samples were, and what was done to keep them so */
+static int svg_sampler_summary(FILE *of, const struct list_sample_data *head, int n) {
+        _cleanup_free_ uint32_t *latency = NULL;
+        const struct list_sample_data *sampledata;
+        int n_latency = 0;
+        int steps = 0;
+        int level = 0;
+
+        latency = new(uint32_t, n);
+        if (!latency)
+                return -ENOMEM;
+
+        /* link_next is the sample before, the first one has nothing to be late for */
+        for (sampledata = head; sampledata; sampledata = sampledata->link_prev) {
+                if (!sampledata->link_next || sampledata->overhead.wall == 0)
+                        continue;
+
+                latency[n_latency++] = sampledata->overhead.latency;
+
+                if (sampledata->overhead.governor > sampledata->link_next->overhead.governor)
+                        steps++;
+                level = MAX(level, sampledata->overhead.governor);
+        }
+
+        if (n_latency == 0)
+                return 0;
+
+        qsort(latency, n_latency, sizeof(uint32_t), compare_uint32);
+
+        fprintf(of, "<text class=\"sec\" x=\"20\" y=\"185\">Samples started late by %.03fms median, %.03fms p99, %.03fms max",
+                (double) latency[n_latency / 2] / NSEC_PER_MSEC,
+                (double) latency[(n_latency - 1) * 99 / 100] / NSEC_PER_MSEC,
+                (double) latency[n_latency - 1] / NSEC_PER_MSEC);
+
+        if (arg_realtime > 0)
+                fprintf(of, ", SCHED_FIFO priority %d", arg_realtime);
+        if (arg_cpu >= 0)
+                fprintf(of, ", on CPU %d", arg_cpu);
+        if (arg_lock_memory)
+                fprintf(of, ", memory locked");
+
+        if (arg_max_overhead > 0.0) {
+                fprintf(of, "; governed to %g%% CPU: ", arg_max_overhead);
+                if (steps == 0)
+                        fprintf(of, "never sampled less");
+                else
+                        fprintf(of, "sampled less %d times, at most %s", steps, governor_level_to_string(level));
+        }
+
+        fprintf(of, "</text>\n");
+
+        return 0;
+}
+
+/* what sampling cost, averaged over the samples that measured it */
+static int svg_overhead_summary(FILE *of, const struct list_sample_data *head, double interval) {
+        const struct list_sample_data *sampledata;
+        struct sample_overhead total = {};
+        uint64_t probe[_PROBE_MAX] = {};
+        uint64_t probes = 0;
+        uint64_t wall_max = 0;
+        const char *sep = "; time in";
+        SampleProbe p;
+        int n = 0;
+
+        for (sampledata = head; sampledata; sampledata = sampledata->link_prev) {
+                const struct sample_overhead *o = &sampledata->overhead;
+
+                /* a replay doesn't know what sampling cost */
+                if (o->wall == 0)
+                        continue;
+
+                total.wall += o->wall;
+                total.cpu += o->cpu;
+                total.opens += o->opens;
+                total.reads += o->reads;
+                total.syscalls += o->syscalls;
+                total.allocations += o->allocations;
+                total.bytes += o->bytes;
+                wall_max = MAX(wall_max, o->wall);
+
+                for (p = 0; p < _PROBE_MAX; p++) {
+                        probe[p] += o->probe[p];
+                        probes += o->probe[p];
+                }
+
+                n++;
+        }
+
+        fprintf(of, "<text class=\"sec\" x=\"20\" y=\"170\">Bootchart overhead: ");
+
+        if (n == 0) {
+                fprintf(of, "Not measured</text>\n");
+                return 0;
+        }
+
+        fprintf(of, "%.02f%% CPU, per sample %.03fms CPU and %.03fms wall clock (max %.03fms), "
+                "%.0f syscalls (%.0f opens, %.0f reads), %.01fkB read, %.0f allocations",
+                interval > 0.0 ? 100.0 * total.cpu / (n * interval) : 0.0,
+                (double) total.cpu / n / NSEC_PER_MSEC,
+                (double) total.wall / n / NSEC_PER_MSEC,
+                (double) wall_max / NSEC_PER_MSEC,
+                (double) total.syscalls / n,
+                (double) total.opens / n,
+                (double) total.reads / n,
+                (double) total.bytes / n / 1024.0,
+                (double) total.allocations / n);
+
+        for (p = 0; probes > 0 && p < _PROBE_MAX; p++)
+                if (probe[p] > 0) {
+                        fprintf(of, "%s %s %.0f%%", sep, sample_probe_to_string(p), 100.0 * probe[p] / probes);
+                        sep = ",";
+                }
+
+        fprintf(of, "</text>\n");
+
+        return svg_sampler_summary(of, head, n);
+}
+
+static int svg_title(FILE *of,
+                     const struct system_info *system,
+                     const struct list_sample_data *head,
+                     const struct list_sample_data *last,
+                     const struct disks *disks,
+                     const struct svg_layout *layout,
+                     int pscount,
+                     double log_start,
+                     double interval,
+                     int overrun) {
         _cleanup_free_ char *model = NULL;
-        _cleanup_free_ char *buf = NULL;
         char date[256] = "Unknown";
-        const char *cpu;
-        char *c;
         time_t t;
-        int r;
-        struct utsname uts;
+        int i, r;
 
-        r = read_one_line_file("/proc/cmdline", &cmdline);
-        if (r < 0) {
-                log_error_errno(r, "Unable to read cmdline: %m");
-                return r;
-        }
+        /* every disk that has been used since boot, loop devices aside */
+        for (i = 0; last && i < last->n_disks; i++) {
+                const struct disk *disk;
+                char *m;
 
-        /* extract root fs so we can find disk model name in sysfs */
-        /* FIXME: this works only in the simple case */
-        c = strstr(cmdline, "root=/dev/");
-        if (c) {
-                char rootbdev[4];
-                char filename[32];
+                if (!last->disks[i].valid || last->disks[i].rd_sectors + last->disks[i].wr_sectors == 0)
+                        continue;
 
-                strncpy(rootbdev, &c[10], sizeof(rootbdev) - 1);
-                rootbdev[3] = '\0';
-                xsprintf(filename, "/sys/block/%s/device/model", rootbdev);
+                disk = disks_get_slot(disks, i);
+                if (!disk || startswith(disk->name, "loop"))
+                        continue;
 
-                r = read_one_line_file(filename, &model);
-                if (r < 0)
-                        log_info("Error reading disk model for %s: %m\n", rootbdev);
-        }
+                m = strjoin(strempty(model), model ? ", " : "", disk->name,
+                            disk->label ? " (" : "", strempty(disk->label), disk->label ? ")" : "", NULL);
+                if (!m)
+                        return log_oom();
 
-        /* various utsname parameters */
-        r = uname(&uts);
-        if (r < 0) {
-                log_error("Error getting uname info\n");
-                return -errno;
+                free(model);
+                model = m;
         }
 
         /* date */
@@ -198,43 +395,36 @@ static int svg_title(FILE *of, const char *build, int pscount, double log_start,
         r = strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S %z", localtime(&t));
         assert_se(r > 0);
 
-        /* CPU type */
-        r = get_proc_field("/proc/cpuinfo", PROC_CPUINFO_MODEL, "\n", &buf);
-        if (r < 0)
-                cpu = "Unknown";
-        else
-                cpu = buf;
-
         fprintf(of, "<text class=\"t1\" x=\"0\" y=\"30\">Bootchart for %s - %s</text>\n",
-                uts.nodename, date);
-        fprintf(of, "<text class=\"t2\" x=\"20\" y=\"50\">System: %s %s %s %s</text>\n",
-                uts.sysname, uts.release, uts.version, uts.machine);
-        fprintf(of, "<text class=\"t2\" x=\"20\" y=\"65\">CPU: %s</text>\n", cpu);
+                strna(system->hostname), date);
+        fprintf(of, "<text class=\"t2\" x=\"20\" y=\"50\">System: %s</text>\n", strna(system->kernel));
+        fprintf(of, "<text class=\"t2\" x=\"20\" y=\"65\">CPU: %s</text>\n", system->cpu ?: "Unknown");
         if (model)
-                fprintf(of, "<text class=\"t2\" x=\"20\" y=\"80\">Disk: %s</text>\n", model);
-        fprintf(of, "<text class=\"t2\" x=\"20\" y=\"95\">Boot options: %s</text>\n", cmdline);
-        fprintf(of, "<text class=\"t2\" x=\"20\" y=\"110\">Build: %s</text>\n", build);
+                fprintf(of, "<text class=\"t2\" x=\"20\" y=\"80\">Disk: <![CDATA[%s]]></text>\n", model);
+        fprintf(of, "<text class=\"t2\" x=\"20\" y=\"95\">Boot options: %s</text>\n", strna(system->cmdline));
+        fprintf(of, "<text class=\"t2\" x=\"20\" y=\"110\">Build: %s</text>\n", strna(system->build));
         fprintf(of, "<text class=\"t2\" x=\"20\" y=\"125\">Log start time: %.03fs</text>\n", log_start);
         fprintf(of, "<text class=\"t2\" x=\"20\" y=\"140\">Idle time: ");
 
-        if (idletime >= 0.0 && idletime <= 1.0)
-                fprintf(of, "%.01fms", to_ms(idletime));
-        else if (idletime >= 0.0)
-                fprintf(of, "%.03fs", idletime);
+        if (layout->idletime >= 0.0 && layout->idletime <= 1.0)
+                fprintf(of, "%.01fms", to_ms(layout->idletime));
+        else if (layout->idletime >= 0.0)
+                fprintf(of, "%.03fs", layout->idletime);
         else
                 fprintf(of, "Not detected");
 
         fprintf(of, "</text>\n");
         fprintf(of, "<text class=\"sec\" x=\"20\" y=\"155\">Graph data: %.03f samples/sec, recorded %i total, dropped %i samples, %i processes, %i filtered</text>\n",
-                arg_hz, arg_samples_len, overrun, pscount, pfiltered);
+                arg_hz, arg_samples_len, overrun, pscount, layout->pfiltered);
 
-        return 0;
+        return svg_overhead_summary(of, head, interval);
 }
 
 static void svg_graph_box(FILE *of, struct list_sample_data *head, int height, double graph_start) {
         double d = 0.0;
         int i = 0;
         double finalsample = 0.0;
+        struct list_sample_data *sampledata;
         struct list_sample_data *sampledata_last;
 
         sampledata_last = head;
@@ -297,12 +487,31 @@ static char* xml_comment_encode(const char* name) {
         return enc_name;
 }
 
+/*
+ * The sample of a process that stands for sampledata: the last one taken
+ * at or before it, as the governor may skip a process in some samples, or
+ * NULL if the process wasn't running then. ps->sample is the cursor, so
+ * sampledata must be passed oldest first after it was reset to ps->first.
+ */
+static struct ps_sched_struct *ps_sample_at(struct ps_struct *ps, const struct list_sample_data *sampledata) {
+        while (ps->sample->next && ps->sample->next->sampledata->sampletime <= sampledata->sampletime)
+                ps->sample = ps->sample->next;
+
+        /* the first sample only marks where the process was found */
+        if (ps->sample == ps->first || ps->last_seen < sampledata->sampletime)
+                return NULL;
+
+        return ps->sample;
+}
+
 static void svg_pss_graph(FILE *of,
                           struct list_sample_data *head,
                           struct ps_struct *ps_first,
                           double graph_start) {
         struct ps_struct *ps;
         int i;
+        struct list_sample_data *sampledata;
+        struct list_sample_data *prev_sampledata;
         struct list_sample_data *sampledata_last;
 
         sampledata_last = head;
@@ -331,40 +540,20 @@ static void svg_pss_graph(FILE *of,
         fprintf(of, "\n");
 
         /* now plot the graph itself */
-        i = 1;
+        for (ps = ps_first->next_ps; ps; ps = ps->next_ps)
+                ps->sample = ps->first;
+
         prev_sampledata = head;
         LIST_FOREACH_BEFORE(link, sampledata, head) {
-                int bottom;
-                int top;
-                struct ps_sched_struct *cross_place;
-
-                bottom = 0;
-                top = 0;
+                struct ps_sched_struct *sample;
+                int bottom = 0;
+                int top = 0;
 
                 /* put all the small pss blocks into the bottom */
-                ps = ps_first;
-                while (ps->next_ps) {
-                        ps = ps->next_ps;
-                        if (!ps)
-                                continue;
-                        ps->sample = ps->first;
-                        while (ps->sample->next) {
-                                ps->sample = ps->sample->next;
-                                if (ps->sample->sampledata == sampledata)
-                                        break;
-                        }
-                        if (ps->sample->sampledata == sampledata) {
-                                if (ps->sample->pss <= (100 * arg_scale_y))
-                                        top += ps->sample->pss;
-                                break;
-                        }
-                }
-                while (ps->sample->cross) {
-                        cross_place = ps->sample->cross;
-                        ps = ps->sample->cross->ps_new;
-                        ps->sample = cross_place;
-                        if (ps->sample->pss <= (100 * arg_scale_y))
-                                top += ps->sample->pss;
+                for (ps = ps_first->next_ps; ps; ps = ps->next_ps) {
+                        sample = ps_sample_at(ps, sampledata);
+                        if (sample && sample->pss <= (100 * arg_scale_y))
+                                top += sample->pss;
                 }
 
                 fprintf(of, "    <rect class=\"clrw\" style=\"fill: %s\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
@@ -376,133 +565,57 @@ static void svg_pss_graph(FILE *of,
                 bottom = top;
 
                 /* now plot the ones that are of significant size */
-                ps = ps_first;
-                while (ps->next_ps) {
-                        ps = ps->next_ps;
-                        if (!ps)
-                                continue;
-                        ps->sample = ps->first;
-                        while (ps->sample->next) {
-                                ps->sample = ps->sample->next;
-                                if (ps->sample->sampledata == sampledata)
-                                        break;
-                        }
-                        /* don't draw anything smaller than 2mb */
-                        if (ps->sample->sampledata != sampledata)
+                for (ps = ps_first->next_ps; ps; ps = ps->next_ps) {
+                        sample = ps_sample_at(ps, sampledata);
+                        if (!sample || sample->pss <= (100 * arg_scale_y))
                                 continue;
-                        if (ps->sample->pss > (100 * arg_scale_y)) {
-                                top = bottom + ps->sample->pss;
-                                fprintf(of, "    <rect class=\"clrw\" style=\"fill: %s\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
-                                        colorwheel[ps->pid % 12],
-                                        time_to_graph(prev_sampledata->sampletime - graph_start),
-                                        kb_to_graph(1000000.0 - top),
-                                        time_to_graph(sampledata->sampletime - prev_sampledata->sampletime),
-                                        kb_to_graph(top - bottom));
-                                bottom = top;
-                        }
-                        break;
-                }
 
-                while ((cross_place = ps->sample->cross)) {
-                        ps = ps->sample->cross->ps_new;
-                        ps->sample = cross_place;
-                        if (ps->sample->pss > (100 * arg_scale_y)) {
-                                top = bottom + ps->sample->pss;
-                                fprintf(of, "    <rect class=\"clrw\" style=\"fill: %s\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
-                                        colorwheel[ps->pid % 12],
-                                        time_to_graph(prev_sampledata->sampletime - graph_start),
-                                        kb_to_graph(1000000.0 - top),
-                                        time_to_graph(sampledata->sampletime - prev_sampledata->sampletime),
-                                        kb_to_graph(top - bottom));
-                                bottom = top;
-                        }
+                        top = bottom + sample->pss;
+                        fprintf(of, "    <rect class=\"clrw\" style=\"fill: %s\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                                colorwheel[ps->pid % 12],
+                                time_to_graph(prev_sampledata->sampletime - graph_start),
+                                kb_to_graph(1000000.0 - top),
+                                time_to_graph(sampledata->sampletime - prev_sampledata->sampletime),
+                                kb_to_graph(top - bottom));
+                        bottom = top;
                 }
 
                 prev_sampledata = sampledata;
-                i++;
         }
 
         /* overlay all the text labels */
+        for (ps = ps_first->next_ps; ps; ps = ps->next_ps)
+                ps->sample = ps->first;
+
         i = 1;
         LIST_FOREACH_BEFORE(link, sampledata, head) {
+                struct ps_sched_struct *sample;
                 int bottom;
                 int top = 0;
-                struct ps_sched_struct *prev_sample;
-                struct ps_sched_struct *cross_place;
 
                 /* put all the small pss blocks into the bottom */
-                ps = ps_first->next_ps;
-                while (ps->next_ps) {
-                        ps = ps->next_ps;
-                        if (!ps)
-                                continue;
-
-                        ps->sample = ps->first;
-                        while (ps->sample->next) {
-                                ps->sample = ps->sample->next;
-                                if (ps->sample->sampledata == sampledata)
-                                        break;
-                        }
-
-                        if (ps->sample->sampledata == sampledata) {
-                                if (ps->sample->pss <= (100 * arg_scale_y))
-                                        top += ps->sample->pss;
-
-                                break;
-                        }
-                }
-
-                while ((cross_place = ps->sample->cross)) {
-                        ps = ps->sample->cross->ps_new;
-                        ps->sample = cross_place;
-                        if (ps->sample->pss <= (100 * arg_scale_y))
-                                top += ps->sample->pss;
+                for (ps = ps_first->next_ps; ps; ps = ps->next_ps) {
+                        sample = ps_sample_at(ps, sampledata);
+                        if (sample && sample->pss <= (100 * arg_scale_y))
+                                top += sample->pss;
                 }
                 bottom = top;
 
-                /* now plot the ones that are of significant size */
-                ps = ps_first;
-                while (ps->next_ps) {
-                        prev_sample = ps->sample;
-                        ps = ps->next_ps;
-                        if (!ps)
+                /* label the ones of significant size where they become so */
+                for (ps = ps_first->next_ps; ps; ps = ps->next_ps) {
+                        sample = ps_sample_at(ps, sampledata);
+                        if (!sample || sample->pss <= (100 * arg_scale_y))
                                 continue;
-                        ps->sample = ps->first;
-                        while (ps->sample->next) {
-                                prev_sample = ps->sample;
-                                ps->sample = ps->sample->next;
-                                if (ps->sample->sampledata == sampledata)
-                                        break;
-                        }
-                        /* don't draw anything smaller than 2mb */
-                        if (ps->sample->sampledata == sampledata) {
-                                if (ps->sample->pss > (100 * arg_scale_y)) {
-                                        top = bottom + ps->sample->pss;
-                                        /* draw a label with the process / PID */
-                                        if ((i == 1) || (prev_sample->pss <= (100 * arg_scale_y)))
-                                                fprintf(of, "  <text x=\"%.03f\" y=\"%.03f\"><![CDATA[%s]]> [%i]</text>\n",
-                                                        time_to_graph(sampledata->sampletime - graph_start),
-                                                        kb_to_graph(1000000.0 - bottom - ((top -  bottom) / 2)),
-                                                        ps->name, ps->pid);
-                                        bottom = top;
-                                }
-                                break;
-                        }
-                }
-                while ((cross_place = ps->sample->cross)) {
-                        ps = ps->sample->cross->ps_new;
-                        ps->sample = cross_place;
-                        prev_sample = ps->sample->prev;
-                        if (ps->sample->pss > (100 * arg_scale_y)) {
-                                top = bottom + ps->sample->pss;
-                                /* draw a label with the process / PID */
-                                if ((i == 1) || (prev_sample->pss <= (100 * arg_scale_y)))
-                                        fprintf(of, "  <text x=\"%.03f\" y=\"%.03f\"><![CDATA[%s]]> [%i]</text>\n",
-                                                time_to_graph(sampledata->sampletime - graph_start),
-                                                kb_to_graph(1000000.0 - bottom - ((top -  bottom) / 2)),
-                                                ps->name, ps->pid);
-                                bottom = top;
-                        }
+
+                        top = bottom + sample->pss;
+                        /* draw a label with the process / PID */
+                        if (sample->sampledata == sampledata &&
+                            (i == 1 || sample->prev == ps->first || sample->prev->pss <= (100 * arg_scale_y)))
+                                fprintf(of, "  <text x=\"%.03f\" y=\"%.03f\"><![CDATA[%s]]> [%i]</text>\n",
+                                        time_to_graph(sampledata->sampletime - graph_start),
+                                        kb_to_graph(1000000.0 - bottom - ((top -  bottom) / 2)),
+                                        ps_name(ps), ps->pid);
+                        bottom = top;
                 }
 
                 i++;
@@ -517,7 +630,7 @@ static void svg_pss_graph(FILE *of,
                 if (!ps)
                         continue;
 
-                enc_name = xml_comment_encode(ps->name);
+                enc_name = xml_comment_encode(ps_name(ps));
                 if (!enc_name)
                         continue;
 
@@ -545,6 +658,8 @@ static void svg_io_bi_bar(FILE *of,
         int max_here = 0;
         int i;
         int k;
+        struct list_sample_data *sampledata;
+        struct list_sample_data *prev_sampledata;
         struct list_sample_data *start_sampledata;
         struct list_sample_data *stop_sampledata;
 
@@ -652,6 +767,8 @@ static void svg_io_bo_bar(FILE *of,
         int max_here = 0;
         int i;
         int k;
+        struct list_sample_data *sampledata;
+        struct list_sample_data *prev_sampledata;
         struct list_sample_data *start_sampledata;
         struct list_sample_data *stop_sampledata;
 
@@ -750,7 +867,241 @@ static void svg_io_bo_bar(FILE *of,
         }
 }
 
+static void svg_pressure_bar(FILE *of, struct list_sample_data *head, PressureResource res, double graph_start) {
+        static const char * const title[_PRESSURE_RESOURCE_MAX] = {
+                [PRESSURE_CPU] = "CPU",
+                [PRESSURE_IO] = "IO",
+                [PRESSURE_MEMORY] = "Memory",
+        };
+        struct list_sample_data *sampledata;
+        struct list_sample_data *prev_sampledata;
+
+        fprintf(of, "<!-- %s pressure stall box -->\n", pressure_resource_to_string(res));
+        fprintf(of, "<text class=\"t2\" x=\"5\" y=\"-15\">%s pressure - some and full stall</text>\n", title[res]);
+
+        /* surrounding box */
+        svg_graph_box(of, head, 5, graph_start);
+
+        /* the share of each interval in which some, or all, tasks were stalled */
+        prev_sampledata = head;
+        LIST_FOREACH_BEFORE(link, sampledata, head) {
+                const struct pressure_stat_struct *s = &sampledata->pressure[res];
+                const struct pressure_stat_struct *p = &prev_sampledata->pressure[res];
+                double dt, psome = 0.0, pfull = 0.0;
+
+                dt = (sampledata->sampletime - prev_sampledata->sampletime) * 1000000.0;
+
+                if (dt > 0.0 && s->some >= p->some && s->full >= p->full) {
+                        psome = MIN((s->some - p->some) / dt, 1.0);
+                        pfull = MIN((s->full - p->full) / dt, 1.0);
+                }
+
+                if (psome > 0.001)
+                        fprintf(of, "<rect class=\"psome\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                                time_to_graph(prev_sampledata->sampletime - graph_start),
+                                ((arg_scale_y * 5) - (psome * (arg_scale_y * 5))),
+                                time_to_graph(sampledata->sampletime - prev_sampledata->sampletime),
+                                psome * (arg_scale_y * 5));
+
+                if (pfull > 0.001)
+                        fprintf(of, "<rect class=\"pfull\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                                time_to_graph(prev_sampledata->sampletime - graph_start),
+                                ((arg_scale_y * 5) - (pfull * (arg_scale_y * 5))),
+                                time_to_graph(sampledata->sampletime - prev_sampledata->sampletime),
+                                pfull * (arg_scale_y * 5));
+
+                prev_sampledata = sampledata;
+        }
+}
+
+static const struct disk_sample *disk_sample_get(const struct list_sample_data *sampledata, int slot) {
+        if (slot >= sampledata->n_disks || !sampledata->disks[slot].valid)
+                return NULL;
+
+        return &sampledata->disks[slot];
+}
+
+/* counters only move forward, unless the device went away in between */
+static bool disk_samples_ok(const struct disk_sample *p, const struct disk_sample *s) {
+        return p && s &&
+               s->rd_sectors >= p->rd_sectors && s->wr_sectors >= p->wr_sectors &&
+               s->ios >= p->ios && s->ticks >= p->ticks &&
+               s->io_ticks >= p->io_ticks && s->queue_ticks >= p->queue_ticks;
+}
+
+/* true if the disk transferred anything while we were recording */
+static bool disk_active(struct list_sample_data *head, int slot) {
+        const struct disk_sample *first, *last = NULL;
+        struct list_sample_data *sampledata;
+
+        first = disk_sample_get(head, slot);
+        LIST_FOREACH_BEFORE(link, sampledata, head) {
+                const struct disk_sample *s;
+
+                s = disk_sample_get(sampledata, slot);
+                if (!s)
+                        continue;
+                if (!first)
+                        first = s;
+                last = s;
+        }
+
+        return first && last &&
+               (last->rd_sectors != first->rd_sectors || last->wr_sectors != first->wr_sectors);
+}
+
+static void svg_disk_io(FILE *of,
+                        struct list_sample_data *head,
+                        const struct disk *disk,
+                        double graph_start) {
+
+        struct list_sample_data *sampledata;
+        struct list_sample_data *prev_sampledata;
+        double max = 0.0;
+
+        fprintf(of, "<!-- Disk throughput graph - %s -->\n", disk->name);
+
+        /* surrounding box */
+        svg_graph_box(of, head, 5, graph_start);
+
+        /* find the max throughput first, in sectors per second */
+        prev_sampledata = head;
+        LIST_FOREACH_BEFORE(link, sampledata, head) {
+                const struct disk_sample *s, *p;
+                double dt;
+
+                s = disk_sample_get(sampledata, disk->slot);
+                p = disk_sample_get(prev_sampledata, disk->slot);
+                dt = sampledata->sampletime - prev_sampledata->sampletime;
+                prev_sampledata = sampledata;
+
+                if (!disk_samples_ok(p, s) || dt <= 0.0)
+                        continue;
+
+                max = MAX(max, (s->rd_sectors - p->rd_sectors + s->wr_sectors - p->wr_sectors) / dt);
+        }
+
+        fprintf(of, "<text class=\"t2\" x=\"5\" y=\"-15\">Disk <![CDATA[%s%s%s%s]]> - read and write, max %.01fMB/s</text>\n",
+                disk->name,
+                disk->label ? " (" : "",
+                strempty(disk->label),
+                disk->label ? ")" : "",
+                max * 512.0 / (1024.0 * 1024.0));
+
+        /* plot read with write stacked on top */
+        prev_sampledata = head;
+        LIST_FOREACH_BEFORE(link, sampledata, head) {
+                const struct disk_sample *s, *p;
+                double dt, pr, pw;
+
+                s = disk_sample_get(sampledata, disk->slot);
+                p = disk_sample_get(prev_sampledata, disk->slot);
+                dt = sampledata->sampletime - prev_sampledata->sampletime;
+
+                if (!disk_samples_ok(p, s) || dt <= 0.0 || max <= 0.0) {
+                        prev_sampledata = sampledata;
+                        continue;
+                }
+
+                pr = (s->rd_sectors - p->rd_sectors) / dt / max;
+                pw = (s->wr_sectors - p->wr_sectors) / dt / max;
+
+                if (pr > 0.001)
+                        fprintf(of, "<rect class=\"bi\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                                time_to_graph(prev_sampledata->sampletime - graph_start),
+                                (arg_scale_y * 5) - (pr * (arg_scale_y * 5)),
+                                time_to_graph(dt),
+                                pr * (arg_scale_y * 5));
+
+                if (pw > 0.001)
+                        fprintf(of, "<rect class=\"bo\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                                time_to_graph(prev_sampledata->sampletime - graph_start),
+                                (arg_scale_y * 5) - ((pr + pw) * (arg_scale_y * 5)),
+                                time_to_graph(dt),
+                                pw * (arg_scale_y * 5));
+
+                prev_sampledata = sampledata;
+        }
+}
+
+static void svg_disk_latency(FILE *of,
+                             struct list_sample_data *head,
+                             const struct disk *disk,
+                             double graph_start) {
+
+        struct list_sample_data *sampledata;
+        struct list_sample_data *prev_sampledata;
+        double max_latency = 0.0;
+        double max_depth = 0.0;
+
+        fprintf(of, "<!-- Disk latency graph - %s -->\n", disk->name);
+
+        /* surrounding box */
+        svg_graph_box(of, head, 5, graph_start);
+
+        /* average latency of the requests completed in each interval */
+        prev_sampledata = head;
+        LIST_FOREACH_BEFORE(link, sampledata, head) {
+                const struct disk_sample *s, *p;
+                double dt;
+
+                s = disk_sample_get(sampledata, disk->slot);
+                p = disk_sample_get(prev_sampledata, disk->slot);
+                dt = sampledata->sampletime - prev_sampledata->sampletime;
+                prev_sampledata = sampledata;
+
+                if (!disk_samples_ok(p, s) || dt <= 0.0)
+                        continue;
+
+                if (s->ios > p->ios)
+                        max_latency = MAX(max_latency, (double) (s->ticks - p->ticks) / (s->ios - p->ios));
+                max_depth = MAX(max_depth, (s->queue_ticks - p->queue_ticks) / (dt * 1000.0));
+        }
+
+        fprintf(of, "<text class=\"t2\" x=\"5\" y=\"-15\">Disk <![CDATA[%s]]> - utilization and latency, max %.01fms, max queue depth %.01f</text>\n",
+                disk->name, max_latency, max_depth);
+
+        prev_sampledata = head;
+        LIST_FOREACH_BEFORE(link, sampledata, head) {
+                const struct disk_sample *s, *p;
+                double dt, util;
+
+                s = disk_sample_get(sampledata, disk->slot);
+                p = disk_sample_get(prev_sampledata, disk->slot);
+                dt = sampledata->sampletime - prev_sampledata->sampletime;
+
+                if (!disk_samples_ok(p, s) || dt <= 0.0) {
+                        prev_sampledata = sampledata;
+                        continue;
+                }
+
+                /* io_ticks is in ms */
+                util = MIN((s->io_ticks - p->io_ticks) / (dt * 1000.0), 1.0);
+                if (util > 0.001)
+                        fprintf(of, "<rect class=\"dutil\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                                time_to_graph(prev_sampledata->sampletime - graph_start),
+                                (arg_scale_y * 5) - (util * (arg_scale_y * 5)),
+                                time_to_graph(dt),
+                                util * (arg_scale_y * 5));
+
+                if (s->ios > p->ios && max_latency > 0.0) {
+                        double lat;
+
+                        lat = (double) (s->ticks - p->ticks) / (s->ios - p->ios) / max_latency;
+                        fprintf(of, "<line class=\"dlat\" x1=\"%.03f\" y1=\"%.03f\" x2=\"%.03f\" y2=\"%.03f\" />\n",
+                                time_to_graph(prev_sampledata->sampletime - graph_start),
+                                (arg_scale_y * 5) - (lat * (arg_scale_y * 5)),
+                                time_to_graph(sampledata->sampletime - graph_start),
+                                (arg_scale_y * 5) - (lat * (arg_scale_y * 5)));
+                }
+
+                prev_sampledata = sampledata;
+        }
+}
+
 static void svg_cpu_bar(FILE *of, struct list_sample_data *head, int n_cpus, int cpu_num, double graph_start) {
+        struct list_sample_data *sampledata;
+        struct list_sample_data *prev_sampledata;
 
         fprintf(of, "<!-- CPU utilization graph -->\n");
 
@@ -800,6 +1151,8 @@ static void svg_cpu_bar(FILE *of, struct list_sample_data *head, int n_cpus, int
 }
 
 static void svg_wait_bar(FILE *of, struct list_sample_data *head, int n_cpus, int cpu_num, double graph_start) {
+        struct list_sample_data *sampledata;
+        struct list_sample_data *prev_sampledata;
 
         fprintf(of, "<!-- Wait time aggregation box -->\n");
 
@@ -848,56 +1201,248 @@ static void svg_wait_bar(FILE *of, struct list_sample_data *head, int n_cpus, in
         }
 }
 
-static void svg_entropy_bar(FILE *of, struct list_sample_data *head, double graph_start) {
+static void svg_cpu_heatmap(FILE *of,
+                            struct list_sample_data *head,
+                            int n_cpus,
+                            const int *cpu_row,
+                            int n_rows,
+                            int height,
+                            bool wait,
+                            double graph_start) {
+        _cleanup_free_ int *row_cpus = NULL, *level = NULL;
+        _cleanup_free_ double *delta = NULL, *run_start = NULL;
+        struct list_sample_data *sampledata;
+        struct list_sample_data *prev_sampledata;
+        const char *class = wait ? "hw" : "hu";
+        double row_h, end;
+        int c, r, label_every;
+
+        row_cpus = new0(int, n_rows);
+        level = new0(int, n_rows);
+        delta = new0(double, n_rows);
+        run_start = new0(double, n_rows);
+        if (!row_cpus || !level || !delta || !run_start)
+                return;
 
-        fprintf(of, "<!-- entropy pool graph -->\n");
+        for (c = 0; c < n_cpus; c++)
+                row_cpus[cpu_row[c]]++;
+
+        row_h = (double) height / n_rows;
+
+        fprintf(of, "<!-- CPU %s heatmap -->\n", wait ? "wait" : "utilization");
+        fprintf(of, "<text class=\"t2\" x=\"5\" y=\"-15\">CPU[%s] %s</text>\n",
+                cpu_group_to_string(arg_cpu_group), wait ? "wait" : "utilization");
 
-        fprintf(of, "<text class=\"t2\" x=\"5\" y=\"-15\">Entropy pool size</text>\n");
         /* surrounding box */
-        svg_graph_box(of, head, 5, graph_start);
+        svg_graph_box(of, head, height, graph_start);
 
-        /* bars for each sample, scale 0-4096 */
+        /*
+         * One thin row per CPU (or group of CPUs), the load is mapped to
+         * the opacity of the fill. Consecutive samples with the same
+         * level are merged into a single rect to keep the output small.
+         */
+        end = 0.0;
         prev_sampledata = head;
         LIST_FOREACH_BEFORE(link, sampledata, head) {
-                fprintf(of, "<rect class=\"cpu\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
-                        time_to_graph(prev_sampledata->sampletime - graph_start),
-                        ((arg_scale_y * 5) - ((sampledata->entropy_avail / 4096.) * (arg_scale_y * 5))),
-                        time_to_graph(sampledata->sampletime - prev_sampledata->sampletime),
-                        (sampledata->entropy_avail / 4096.) * (arg_scale_y * 5));
-                prev_sampledata = sampledata;
-        }
-}
+                double dt;
 
-static struct ps_struct *get_next_ps(struct ps_struct *ps, struct ps_struct *ps_first) {
-        /*
-         * walk the list of processes and return the next one to be
-         * painted
-         */
-        if (ps == ps_first)
-                return ps->next_ps;
+                dt = sampledata->sampletime - prev_sampledata->sampletime;
 
-        /* go deep */
-        if (ps->children)
-                return ps->children;
+                for (r = 0; r < n_rows; r++)
+                        delta[r] = 0.0;
 
-        /* find siblings */
-        if (ps->next)
-                return ps->next;
+                for (c = 0; c < n_cpus; c++) {
+                        if (wait)
+                                delta[cpu_row[c]] += sampledata->waittime[c] - prev_sampledata->waittime[c];
+                        else
+                                delta[cpu_row[c]] += sampledata->runtime[c] - prev_sampledata->runtime[c];
+                }
 
-        /* go back for parent siblings */
-        for (;;) {
-                if (ps->parent && ps->parent->next)
-                        return ps->parent->next;
+                for (r = 0; r < n_rows; r++) {
+                        double load = 0.0;
+                        int l;
 
-                ps = ps->parent;
-                if (!ps)
-                        return ps;
+                        if (dt > 0.0)
+                                load = (delta[r] / 1000000000.0) / (dt * row_cpus[r]);
+
+                        l = CLAMP((int) (load * HEATMAP_LEVELS + 0.5), 0, HEATMAP_LEVELS);
+                        if (l == level[r])
+                                continue;
+
+                        if (level[r] > 0)
+                                fprintf(of, "<rect class=\"%s%d\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                                        class, level[r],
+                                        time_to_graph(run_start[r] - graph_start),
+                                        ps_to_graph(r * row_h),
+                                        time_to_graph(prev_sampledata->sampletime - run_start[r]),
+                                        ps_to_graph(row_h));
+
+                        level[r] = l;
+                        run_start[r] = prev_sampledata->sampletime;
+                }
+
+                end = sampledata->sampletime;
+                prev_sampledata = sampledata;
         }
 
-        return NULL;
+        for (r = 0; r < n_rows; r++)
+                if (level[r] > 0)
+                        fprintf(of, "<rect class=\"%s%d\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                                class, level[r],
+                                time_to_graph(run_start[r] - graph_start),
+                                ps_to_graph(r * row_h),
+                                time_to_graph(end - run_start[r]),
+                                ps_to_graph(row_h));
+
+        /* label as many rows as fit at the right hand side */
+        label_every = MAX((int) (10.0 / ps_to_graph(row_h)) + 1, 1);
+        for (r = 0; r < n_rows; r += label_every)
+                fprintf(of, "  <text class=\"sec\" x=\"%.03f\" y=\"%.03f\">%s%d</text>\n",
+                        time_to_graph(end - graph_start) + 5,
+                        ps_to_graph((r + 0.5) * row_h) + 3,
+                        cpu_group_to_string(arg_cpu_group), r);
 }
 
-static bool ps_filter(struct ps_struct *ps) {
+static void svg_overhead_bar(FILE *of, struct list_sample_data *head, double graph_start) {
+        struct list_sample_data *sampledata;
+        struct list_sample_data *prev_sampledata;
+        double max = 0.0;
+
+        /* a sample costs a small share of its interval, scale to the largest one */
+        prev_sampledata = head;
+        LIST_FOREACH_BEFORE(link, sampledata, head) {
+                double dt;
+
+                dt = (sampledata->sampletime - prev_sampledata->sampletime) * NSEC_PER_SEC;
+                if (dt > 0.0)
+                        max = MAX(max, prev_sampledata->overhead.wall / dt);
+
+                prev_sampledata = sampledata;
+        }
+
+        /* the budget of the governor is a share of CPU time */
+        max = MAX(max, arg_max_overhead / 100.0);
+
+        fprintf(of, "<!-- bootchart overhead graph -->\n");
+        fprintf(of, "<text class=\"t2\" x=\"5\" y=\"-15\">Bootchart overhead - wall clock and CPU time taking each sample, up to %.01f%% of the interval</text>\n",
+                max * 100.0);
+
+        /* surrounding box */
+        svg_graph_box(of, head, 5, graph_start);
+
+        if (max <= 0.0)
+                return;
+
+        /* a sample is taken at the start of its interval */
+        prev_sampledata = head;
+        LIST_FOREACH_BEFORE(link, sampledata, head) {
+                const struct sample_overhead *o = &prev_sampledata->overhead;
+                double dt, wall, cpu;
+
+                dt = (sampledata->sampletime - prev_sampledata->sampletime) * NSEC_PER_SEC;
+                if (dt <= 0.0 || o->wall == 0)
+                        goto next;
+
+                wall = MIN(o->wall / dt / max, 1.0);
+                cpu = MIN(o->cpu / dt / max, 1.0);
+
+                fprintf(of, "<rect class=\"ovwall\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                        time_to_graph(prev_sampledata->sampletime - graph_start),
+                        ((arg_scale_y * 5) - (wall * (arg_scale_y * 5))),
+                        time_to_graph(sampledata->sampletime - prev_sampledata->sampletime),
+                        wall * (arg_scale_y * 5));
+
+                if (cpu > 0.001)
+                        fprintf(of, "<rect class=\"ovcpu\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                                time_to_graph(prev_sampledata->sampletime - graph_start),
+                                ((arg_scale_y * 5) - (cpu * (arg_scale_y * 5))),
+                                time_to_graph(sampledata->sampletime - prev_sampledata->sampletime),
+                                cpu * (arg_scale_y * 5));
+next:
+                prev_sampledata = sampledata;
+        }
+
+        if (arg_max_overhead <= 0.0)
+                return;
+
+        fprintf(of, "<line class=\"gov\" x1=\"%.03f\" y1=\"%.03f\" x2=\"%.03f\" y2=\"%.03f\"><title>MaxOverheadPercent=%g%%</title></line>\n",
+                time_to_graph(0.0),
+                (arg_scale_y * 5) - (arg_max_overhead / 100.0 / max * (arg_scale_y * 5)),
+                time_to_graph(prev_sampledata->sampletime - graph_start),
+                (arg_scale_y * 5) - (arg_max_overhead / 100.0 / max * (arg_scale_y * 5)),
+                arg_max_overhead);
+
+        /* mark where the governor changed what is sampled, with the new level */
+        prev_sampledata = head;
+        LIST_FOREACH_BEFORE(link, sampledata, head) {
+                int level = sampledata->overhead.governor;
+
+                if (level != prev_sampledata->overhead.governor) {
+                        fprintf(of, "<line class=\"gov\" x1=\"%.03f\" y1=\"0\" x2=\"%.03f\" y2=\"%.03f\"><title>%s</title></line>\n",
+                                time_to_graph(sampledata->sampletime - graph_start),
+                                time_to_graph(sampledata->sampletime - graph_start),
+                                arg_scale_y * 5,
+                                governor_level_to_string(level));
+                        fprintf(of, "<text class=\"sec\" x=\"%.03f\" y=\"-2\">%d</text>\n",
+                                time_to_graph(sampledata->sampletime - graph_start) + 2, level);
+                }
+
+                prev_sampledata = sampledata;
+        }
+}
+
+static void svg_entropy_bar(FILE *of, struct list_sample_data *head, double graph_start) {
+        struct list_sample_data *sampledata;
+        struct list_sample_data *prev_sampledata;
+
+        fprintf(of, "<!-- entropy pool graph -->\n");
+
+        fprintf(of, "<text class=\"t2\" x=\"5\" y=\"-15\">Entropy pool size</text>\n");
+        /* surrounding box */
+        svg_graph_box(of, head, 5, graph_start);
+
+        /* bars for each sample, scale 0-4096 */
+        prev_sampledata = head;
+        LIST_FOREACH_BEFORE(link, sampledata, head) {
+                fprintf(of, "<rect class=\"cpu\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                        time_to_graph(prev_sampledata->sampletime - graph_start),
+                        ((arg_scale_y * 5) - ((sampledata->entropy_avail / 4096.) * (arg_scale_y * 5))),
+                        time_to_graph(sampledata->sampletime - prev_sampledata->sampletime),
+                        (sampledata->entropy_avail / 4096.) * (arg_scale_y * 5));
+                prev_sampledata = sampledata;
+        }
+}
+
+struct ps_struct *get_next_ps(struct ps_struct *ps, struct ps_struct *ps_first) {
+        /*
+         * walk the list of processes and return the next one to be
+         * painted
+         */
+        if (ps == ps_first)
+                return ps->next_ps;
+
+        /* go deep */
+        if (ps->children)
+                return ps->children;
+
+        /* find siblings */
+        if (ps->next)
+                return ps->next;
+
+        /* go back for parent siblings */
+        for (;;) {
+                if (ps->parent && ps->parent->next)
+                        return ps->parent->next;
+
+                ps = ps->parent;
+                if (!ps)
+                        return ps;
+        }
+
+        return NULL;
+}
+
+bool ps_filter(struct ps_struct *ps) {
         if (!arg_filter)
                 return false;
 
@@ -916,78 +1461,86 @@ static bool ps_filter(struct ps_struct *ps) {
         return 0;
 }
 
-static void svg_do_initcall(FILE *of, struct list_sample_data *head, int count_only, double graph_start) {
-        _cleanup_pclose_ FILE *f = NULL;
-        double t;
-        char func[256];
-        int ret;
-        int usecs;
-
-        /* can't plot initcall when disabled or in relative mode */
-        if (!arg_initcall || arg_relative) {
-                kcount = 0;
+static void svg_boot_phases(FILE *of,
+                            const struct boot_times *boot,
+                            struct ps_struct *ps_first,
+                            double graph_start,
+                            double ready) {
+
+        static const char * const class[_BOOT_PHASE_MAX] = {
+                [BOOT_PHASE_FIRMWARE] = "bfw",
+                [BOOT_PHASE_LOADER] = "bld",
+                [BOOT_PHASE_KERNEL] = "bkrn",
+                [BOOT_PHASE_USERSPACE] = "busr",
+        };
+        double start[_BOOT_PHASE_MAX], end[_BOOT_PHASE_MAX];
+        double shift;
+        BootPhase p;
+
+        if (!boot_times_phases(boot, ps_first, graph_start, ready, start, end))
                 return;
-        }
 
-        if (!count_only) {
-                fprintf(of, "<!-- initcall -->\n");
-                fprintf(of, "<text class=\"t2\" x=\"5\" y=\"-15\">Kernel init threads</text>\n");
-                /* surrounding box */
-                svg_graph_box(of, head, kcount, graph_start);
-        }
+        /* the chart can't go left of the kernel start, so this bar is shifted right */
+        shift = -start[BOOT_PHASE_FIRMWARE];
 
-        kcount = 0;
+        fprintf(of, "<!-- boot phases, shifted by %.03f seconds -->\n", shift);
+        fprintf(of, "<text class=\"t2\" x=\"5\" y=\"-15\">Boot phases (kernel start at %.01fs)</text>\n", shift);
+        fprintf(of, "<rect class=\"box\" x=\"0\" y=\"0\" width=\"%.03f\" height=\"%.03f\" />\n",
+                time_to_graph(shift + end[BOOT_PHASE_USERSPACE]), ps_to_graph(1));
 
-        /*
-         * Initcall graphing - parses dmesg buffer and displays kernel threads
-         * This somewhat uses the same methods and scaling to show processes
-         * but looks a lot simpler. It's overlaid entirely onto the PS graph
-         * when appropriate.
-         */
+        for (p = 0; p < _BOOT_PHASE_MAX; p++) {
+                double d = end[p] - start[p];
 
-        f = popen("dmesg", "r");
-        if (!f)
-                return;
+                fprintf(of, "<!-- phase=\"%s\" start=\"%.3f\" end=\"%.3f\" -->\n",
+                        boot_phase_to_string(p), start[p], end[p]);
 
-        while (!feof(f)) {
-                int c;
-                int z = 0;
-                char l[256];
-                char *p;
-
-                if (fgets(l, sizeof(l) - 1, f) == NULL)
+                if (d <= 0.0)
                         continue;
 
-                if (l[0] == '<' && l[1] && l[2] == '>')
-                        p = l + 3;
-                else
-                        p = l;
-
+                fprintf(of, "  <rect class=\"%s\" x=\"%.03f\" y=\"0\" width=\"%.03f\" height=\"%.03f\" />\n",
+                        class[p],
+                        time_to_graph(shift + start[p]),
+                        time_to_graph(d),
+                        ps_to_graph(1));
+                fprintf(of, "  <text x=\"%.03f\" y=\"%.03f\">%s <tspan class=\"run\">%.03fs</tspan></text>\n",
+                        time_to_graph(shift + start[p]) + 5,
+                        ps_to_graph(1) + 15,
+                        boot_phase_to_string(p),
+                        d);
+        }
 
-                c = sscanf(p, "[%lf] initcall %s %*s %d %*s %d %*s",
-                           &t, func, &ret, &usecs);
-                if (c != 4) {
-                        /* also parse initcalls done by module loading */
-                        c = sscanf(p, "[%lf] initcall %s %*s %*s %d %*s %d %*s",
-                                   &t, func, &ret, &usecs);
-                        if (c != 4)
-                                continue;
-                }
+        /* where the rest of the chart starts */
+        fprintf(of, "<line class=\"dot\" x1=\"%.03f\" y1=\"%.03f\" x2=\"%.03f\" y2=\"%.03f\" />\n",
+                time_to_graph(shift), -arg_scale_y, time_to_graph(shift), ps_to_graph(2));
+}
 
-                /* chop the +0xXX/0xXX stuff */
-                while(func[z] != '+')
-                        z++;
-                func[z] = 0;
+static void svg_do_initcall(FILE *of,
+                            struct list_sample_data *head,
+                            const struct initcall *initcalls,
+                            size_t n_initcalls,
+                            int kcount,
+                            double graph_start) {
+        size_t i;
+        int row = 0;
+
+        fprintf(of, "<!-- initcall -->\n");
+        fprintf(of, "<text class=\"t2\" x=\"5\" y=\"-15\">Kernel init threads</text>\n");
+        /* surrounding box */
+        svg_graph_box(of, head, kcount, graph_start);
 
-                if (count_only) {
-                        /* filter out irrelevant stuff */
-                        if (usecs >= 1000)
-                                kcount++;
-                        continue;
-                }
+        /*
+         * Initcall graphing - displays kernel threads from the kernel log.
+         * This somewhat uses the same methods and scaling to show processes
+         * but looks a lot simpler. It's overlaid entirely onto the PS graph
+         * when appropriate.
+         */
+        for (i = 0; i < n_initcalls; i++) {
+                const struct initcall *ic = &initcalls[i];
+                double t = ic->time;
+                int usecs = ic->usecs;
 
                 fprintf(of, "<!-- thread=\"%s\" time=\"%.3f\" elapsed=\"%d\" result=\"%d\" -->\n",
-                        func, t, usecs, ret);
+                        ic->func, t, usecs, ic->ret);
 
                 if (usecs < 1000)
                         continue;
@@ -995,7 +1548,7 @@ static void svg_do_initcall(FILE *of, struct list_sample_data *head, int count_o
                 /* rect */
                 fprintf(of, "  <rect class=\"krnl\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
                         time_to_graph(t - (usecs / 1000000.0)),
-                        ps_to_graph(kcount),
+                        ps_to_graph(row),
                         time_to_graph(usecs / 1000000.0),
                         ps_to_graph(1));
 
@@ -1003,32 +1556,154 @@ static void svg_do_initcall(FILE *of, struct list_sample_data *head, int count_o
                 if (usecs > 1000000.0)
                         fprintf(of, "  <text x=\"%.03f\" y=\"%.03f\">%s <tspan class=\"run\">%.03fs</tspan></text>\n",
                                 time_to_graph(t - (usecs / 1000000.0)) + 5,
-                                ps_to_graph(kcount) + 15,
-                                func,
+                                ps_to_graph(row) + 15,
+                                ic->func,
                                 usecs / 1000000.0);
                 else
                         fprintf(of, "  <text x=\"%.03f\" y=\"%.03f\">%s <tspan class=\"run\">%.01fms</tspan></text>\n",
                                 time_to_graph(t - (usecs / 1000000.0)) + 5,
-                                ps_to_graph(kcount) + 15,
-                                func,
+                                ps_to_graph(row) + 15,
+                                ic->func,
                                 usecs / 1000.0);
 
-                kcount++;
+                row++;
+        }
+}
+
+static bool kernel_module_filter(const struct kernel_module *m) {
+        if (!arg_filter)
+                return false;
+
+        /* firmware requests are always interesting, short module loads and probes are not */
+        return !m->firmware && m->end - m->start < 0.001;
+}
+
+static void svg_kernel_events(FILE *of,
+                              struct list_sample_data *head,
+                              const struct kmsg *kmsg,
+                              int kecount,
+                              double graph_start) {
+        size_t i, j;
+        int row = 0;
+
+        fprintf(of, "<!-- kernel modules and firmware -->\n");
+        fprintf(of, "<text class=\"t2\" x=\"5\" y=\"-15\">Kernel modules and firmware</text>\n");
+        /* surrounding box */
+        svg_graph_box(of, head, kecount, graph_start);
+
+        /* one lane per module or driver, in the order they first showed up */
+        for (i = 0; i < kmsg->n_modules; i++) {
+                const struct kernel_module *m = &kmsg->modules[i];
+                _cleanup_free_ char *enc_name = NULL;
+
+                /* names come from the kernel log, and may hold anything */
+                enc_name = xml_comment_encode(m->name);
+                if (enc_name)
+                        fprintf(of, "<!-- module=\"%s\" start=\"%.3f\" end=\"%.3f\" -->\n",
+                                enc_name, m->start, m->end);
+
+                if (kernel_module_filter(m))
+                        continue;
+
+                for (j = 0; j < m->n_events; j++) {
+                        const struct kernel_event *ev = &m->events[j];
+                        _cleanup_free_ char *enc_event = NULL;
+
+                        enc_event = xml_comment_encode(ev->name);
+                        if (enc_event)
+                                fprintf(of, "<!-- event=\"%s\" name=\"%s\" start=\"%.3f\" end=\"%.3f\" result=\"%d\" -->\n",
+                                        kernel_event_type_to_string(ev->type), enc_event, ev->start, ev->end, ev->ret);
+
+                        if (ev->type == KERNEL_EVENT_FIRMWARE)
+                                fprintf(of, "  <line class=\"%s\" x1=\"%.03f\" y1=\"%.03f\" x2=\"%.03f\" y2=\"%.03f\" />\n",
+                                        ev->ret < 0 ? "kfwf" : "kfw",
+                                        time_to_graph(ev->start),
+                                        ps_to_graph(row),
+                                        time_to_graph(ev->start),
+                                        ps_to_graph(row + 1));
+                        else
+                                fprintf(of, "  <rect class=\"%s\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                                        ev->type == KERNEL_EVENT_MODULE ? "kmod" : "kprb",
+                                        time_to_graph(ev->start),
+                                        ps_to_graph(row),
+                                        time_to_graph(ev->end - ev->start),
+                                        ps_to_graph(1));
+                }
+
+                /* label */
+                if (m->end - m->start > 1.0)
+                        fprintf(of, "  <text x=\"%.03f\" y=\"%.03f\"><![CDATA[%s]]> <tspan class=\"run\">%.03fs</tspan></text>\n",
+                                time_to_graph(m->end) + 5,
+                                ps_to_graph(row) + 15,
+                                m->name,
+                                m->end - m->start);
+                else
+                        fprintf(of, "  <text x=\"%.03f\" y=\"%.03f\"><![CDATA[%s]]> <tspan class=\"run\">%.01fms</tspan></text>\n",
+                                time_to_graph(m->end) + 5,
+                                ps_to_graph(row) + 15,
+                                m->name,
+                                (m->end - m->start) * 1000.0);
+
+                row++;
+        }
+}
+
+static double io_to_row(uint32_t kb, double dt) {
+        double rate;
+
+        if (kb == 0 || dt <= 0.0)
+                return 0.0;
+
+        /* the top quarter of a row is reads, the bottom quarter writes,
+         * saturating so that both slow and fast disks stay readable */
+        rate = kb / dt;
+
+        return 0.25 * rate / (rate + IO_RATE_HALF);
+}
+
+static void svg_ps_io(FILE *of, struct ps_struct *ps, int j, double graph_start) {
+        struct ps_sched_struct *sample;
+        struct ps_sched_struct *prev;
+
+        /* IO deltas span all samples since the previous IO sample */
+        prev = ps->first;
+        for (sample = ps->first->next; sample; sample = sample->next) {
+                double dt, r, w;
+
+                if (!sample->io)
+                        continue;
+
+                dt = sample->sampledata->sampletime - prev->sampledata->sampletime;
+                r = io_to_row(sample->io_read, dt);
+                w = io_to_row(sample->io_write, dt);
+
+                if (r > 0.0)
+                        fprintf(of, "    <rect class=\"pior\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                                time_to_graph(prev->sampledata->sampletime - graph_start),
+                                ps_to_graph(j),
+                                time_to_graph(dt),
+                                ps_to_graph(r));
+                if (w > 0.0)
+                        fprintf(of, "    <rect class=\"piow\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                                time_to_graph(prev->sampledata->sampletime - graph_start),
+                                ps_to_graph(j + 1.0 - w),
+                                time_to_graph(dt),
+                                ps_to_graph(w));
+
+                prev = sample;
         }
 }
 
 static void svg_ps_bars(FILE *of,
                         struct list_sample_data *head,
-                        int n_samples,
-                        int n_cpus,
                         struct ps_struct *ps_first,
-                        double graph_start,
-                        double interval) {
+                        int pcount,
+                        double idletime,
+                        double graph_start) {
 
         struct ps_struct *ps;
-        int i = 0;
+        struct ps_sched_struct *sample;
         int j = 0;
-        int pid;
         double w = 0.0;
 
         fprintf(of, "<!-- Process graph -->\n");
@@ -1045,10 +1720,10 @@ static void svg_ps_bars(FILE *of,
                 double starttime;
                 int t;
 
-                if (!utf8_is_printable(ps->name, strlen(ps->name)))
-                        escaped = utf8_escape_non_printable(ps->name);
+                if (!utf8_is_printable(ps_name(ps), strlen(ps_name(ps))))
+                        escaped = utf8_escape_non_printable(ps_name(ps));
 
-                enc_name = xml_comment_encode(escaped ? escaped : ps->name);
+                enc_name = xml_comment_encode(escaped ? escaped : ps_name(ps));
                 if (!enc_name)
                         continue;
 
@@ -1087,22 +1762,22 @@ static void svg_ps_bars(FILE *of,
                         ps_to_graph(1));
 
                 /* paint cpu load over these */
-                ps->sample = ps->first;
+                sample = ps->first;
                 t = 1;
-                while (ps->sample->next) {
+                while (sample->next) {
                         double rt, prt;
                         double wt, wrt;
                         struct ps_sched_struct *prev;
 
-                        prev = ps->sample;
-                        ps->sample = ps->sample->next;
+                        prev = sample;
+                        sample = sample->next;
 
                         /* calculate over interval */
-                        rt = ps->sample->runtime - prev->runtime;
-                        wt = ps->sample->waittime - prev->waittime;
+                        rt = sample->runtime - prev->runtime;
+                        wt = sample->waittime - prev->waittime;
 
-                        prt = (rt / 1000000000) / (ps->sample->sampledata->sampletime - prev->sampledata->sampletime);
-                        wrt = (wt / 1000000000) / (ps->sample->sampledata->sampletime - prev->sampledata->sampletime);
+                        prt = (rt / 1000000000) / (sample->sampledata->sampletime - prev->sampledata->sampletime);
+                        wrt = (wt / 1000000000) / (sample->sampledata->sampletime - prev->sampledata->sampletime);
 
                         /* this can happen if timekeeping isn't accurate enough */
                         if (prt > 1.0)
@@ -1116,18 +1791,21 @@ static void svg_ps_bars(FILE *of,
                         fprintf(of, "    <rect class=\"wait\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
                                 time_to_graph(prev->sampledata->sampletime - graph_start),
                                 ps_to_graph(j),
-                                time_to_graph(ps->sample->sampledata->sampletime - prev->sampledata->sampletime),
+                                time_to_graph(sample->sampledata->sampletime - prev->sampledata->sampletime),
                                 ps_to_graph(wrt));
 
                         /* draw cpu over wait - TODO figure out how/why run + wait > interval */
                         fprintf(of, "    <rect class=\"cpu\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
                                 time_to_graph(prev->sampledata->sampletime - graph_start),
                                 ps_to_graph(j + (1.0 - prt)),
-                                time_to_graph(ps->sample->sampledata->sampletime - prev->sampledata->sampletime),
+                                time_to_graph(sample->sampledata->sampletime - prev->sampledata->sampletime),
                                 ps_to_graph(prt));
                         t++;
                 }
 
+                if (arg_io)
+                        svg_ps_io(of, ps, j, graph_start);
+
                 /* determine where to display the process name */
                 if ((endtime - starttime) < 1.5)
                         /* too small to fit label inside the box */
@@ -1140,18 +1818,18 @@ static void svg_ps_bars(FILE *of,
                         fprintf(of, "  <text x=\"%.03f\" y=\"%.03f\"><![CDATA[%s]]> [%i]<tspan class=\"run\">%.03fs</tspan> %s</text>\n",
                                 time_to_graph(w - graph_start) + 5.0,
                                 ps_to_graph(j) + 14.0,
-                                escaped ? escaped : ps->name,
+                                escaped ? escaped : ps_name(ps),
                                 ps->pid,
                                 (ps->last->runtime - ps->first->runtime) / 1000000000.0,
-                                arg_show_cgroup ? ps->cgroup : "");
+                                arg_show_cgroup ? strempty(ps_cgroup(ps)) : "");
                 else
                         fprintf(of, "  <text x=\"%.03f\" y=\"%.03f\"><![CDATA[%s]]> [%i]<tspan class=\"run\">%.01fms</tspan> %s</text>\n",
                                 time_to_graph(w - graph_start) + 5.0,
                                 ps_to_graph(j) + 14.0,
-                                escaped ? escaped : ps->name,
+                                escaped ? escaped : ps_name(ps),
                                 ps->pid,
                                 (ps->last->runtime - ps->first->runtime) / 1000000.0,
-                                arg_show_cgroup ? ps->cgroup : "");
+                                arg_show_cgroup ? strempty(ps_cgroup(ps)) : "");
 
                 /* paint lines to the parent process */
                 if (ps->parent) {
@@ -1176,72 +1854,218 @@ static void svg_ps_bars(FILE *of,
                 fprintf(of, "\n");
         }
 
-        /* last pass - determine when idle */
-        pid = getpid();
-        /* make sure we start counting from the point where we actually have
-         * data: assume that bootchart's first sample is when data started
-         */
+        /* last pass - mark when idle */
+        if (idletime >= 0.0) {
+                fprintf(of, "\n<!-- idle detected at %.03f seconds -->\n", idletime);
+                fprintf(of, "<line class=\"idle\" x1=\"%.03f\" y1=\"%.03f\" x2=\"%.03f\" y2=\"%.03f\" />\n",
+                        time_to_graph(idletime),
+                        -arg_scale_y,
+                        time_to_graph(idletime),
+                        ps_to_graph(pcount) + arg_scale_y);
+                if (idletime > 1.0)
+                        fprintf(of, "<text class=\"idle\" x=\"%.03f\" y=\"%.03f\">%.01fs</text>\n",
+                                time_to_graph(idletime) + 5.0,
+                                ps_to_graph(pcount) + arg_scale_y,
+                                idletime);
+                else
+                        fprintf(of, "<text class=\"idle\" x=\"%.03f\" y=\"%.03f\">%.01fms</text>\n",
+                                time_to_graph(idletime) + 5.0,
+                                ps_to_graph(pcount) + arg_scale_y,
+                                to_ms(idletime));
+        }
+}
 
-        ps = ps_first;
-        while (ps->next_ps) {
-                ps = ps->next_ps;
-                if (ps->pid == pid)
-                        break;
+/* a unit, or with an expanded view one of the processes of the unit before it */
+struct svg_service_row {
+        int service;
+        struct ps_struct *ps;
+};
+
+static const struct service_sample *service_sample_get(const struct list_sample_data *sampledata, int i) {
+        if (i >= sampledata->n_services || !sampledata->services[i].valid)
+                return NULL;
+
+        return &sampledata->services[i];
+}
+
+/* true if the unit did enough while we were recording to be drawn */
+static bool service_active(struct list_sample_data *head, int i) {
+        const struct service_sample *first, *last = NULL;
+        struct list_sample_data *sampledata;
+
+        first = service_sample_get(head, i);
+        LIST_FOREACH_BEFORE(link, sampledata, head) {
+                const struct service_sample *s;
+
+                s = service_sample_get(sampledata, i);
+                if (!s)
+                        continue;
+                if (!first)
+                        first = s;
+                last = s;
         }
-        if (!ps)
-                ps = ps_first;
 
-        /* need to know last node first */
-        ps->sample = ps->first;
-        if (ps->sample->next)
-                i = ps->sample->next->sampledata->counter;
+        if (!first || !last)
+                return false;
+        if (!arg_filter)
+                return true;
 
-        while (ps->sample->next && i<(n_samples-(arg_hz/2))) {
-                double crt;
-                double brt;
-                int c;
-                int ii;
-                struct ps_sched_struct *sample_hz;
+        /* same threshold as for processes */
+        return last->usage_usec >= first->usage_usec + 1000 ||
+               last->rbytes != first->rbytes ||
+               last->wbytes != first->wbytes;
+}
 
-                ps->sample = ps->sample->next;
-                sample_hz = ps->sample;
-                for (ii = 0; (ii < (int)arg_hz/2) && sample_hz->next; ii++)
-                        sample_hz = sample_hz->next;
-
-                /* subtract bootchart cpu utilization from total */
-                crt = 0.0;
-                for (c = 0; c < n_cpus; c++)
-                        crt += sample_hz->sampledata->runtime[c] - ps->sample->sampledata->runtime[c];
-
-                brt = sample_hz->runtime - ps->sample->runtime;
-                /*
-                 * our definition of "idle":
-                 *
-                 * if for (hz / 2) we've used less CPU than (interval / 2) ...
-                 * defaults to 4.0%, which experimentally, is where atom idles
-                 */
-                if ((crt - brt) < (interval / 2.0)) {
-                        idletime = ps->sample->sampledata->sampletime - graph_start;
-                        fprintf(of, "\n<!-- idle detected at %.03f seconds -->\n", idletime);
-                        fprintf(of, "<line class=\"idle\" x1=\"%.03f\" y1=\"%.03f\" x2=\"%.03f\" y2=\"%.03f\" />\n",
-                                time_to_graph(idletime),
-                                -arg_scale_y,
-                                time_to_graph(idletime),
-                                ps_to_graph(pcount) + arg_scale_y);
-                        if (idletime > 1.0)
-                                fprintf(of, "<text class=\"idle\" x=\"%.03f\" y=\"%.03f\">%.01fs</text>\n",
-                                        time_to_graph(idletime) + 5.0,
-                                        ps_to_graph(pcount) + arg_scale_y,
-                                        idletime);
-                        else
-                                fprintf(of, "<text class=\"idle\" x=\"%.03f\" y=\"%.03f\">%.01fms</text>\n",
-                                        time_to_graph(idletime) + 5.0,
-                                        ps_to_graph(pcount) + arg_scale_y,
-                                        to_ms(idletime));
-                        break;
+static void svg_service_row(FILE *of,
+                            struct list_sample_data *head,
+                            const struct service *u,
+                            int i,
+                            int j,
+                            double graph_start) {
+
+        struct list_sample_data *sampledata;
+        struct list_sample_data *prev_sampledata = NULL;
+        const struct service_sample *first = NULL, *last = NULL;
+        double starttime = 0.0, endtime = 0.0;
+        uint64_t memory = 0;
+
+        /* the unit may come and go, draw a box from when it was first to last seen */
+        sampledata = head;
+        for (;;) {
+                const struct service_sample *s;
+
+                s = service_sample_get(sampledata, i);
+                if (s) {
+                        if (!first) {
+                                first = s;
+                                starttime = sampledata->sampletime;
+                        }
+                        last = s;
+                        endtime = sampledata->sampletime;
+                        memory = MAX(memory, s->memory);
                 }
 
-                i++;
+                if (!sampledata->link_prev)
+                        break;
+                sampledata = sampledata->link_prev;
+        }
+
+        if (!first)
+                return;
+
+        fprintf(of, "  <rect class=\"ps\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                time_to_graph(starttime - graph_start),
+                ps_to_graph(j),
+                time_to_graph(endtime - starttime),
+                ps_to_graph(1));
+
+        LIST_FOREACH_BEFORE(link, sampledata, head) {
+                const struct service_sample *s, *p;
+                double dt, prt, stall = 0.0;
+                PressureResource res;
+
+                p = prev_sampledata ? service_sample_get(prev_sampledata, i) : service_sample_get(head, i);
+                s = service_sample_get(sampledata, i);
+                dt = sampledata->sampletime - (prev_sampledata ? prev_sampledata : head)->sampletime;
+                prev_sampledata = sampledata;
+
+                if (!p || !s || dt <= 0.0 || s->usage_usec < p->usage_usec)
+                        continue;
+
+                /* one CPU fully busy fills the row, like for processes */
+                prt = MIN((s->usage_usec - p->usage_usec) / 1000000.0 / dt, 1.0);
+                if (prt >= 0.1)
+                        fprintf(of, "    <rect class=\"cpu\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                                time_to_graph(sampledata->sampletime - dt - graph_start),
+                                ps_to_graph(j + (1.0 - prt)),
+                                time_to_graph(dt),
+                                ps_to_graph(prt));
+
+                /* the worst stall of the unit along the top of the row */
+                for (res = 0; arg_pressure && res < _PRESSURE_RESOURCE_MAX; res++)
+                        if (s->pressure[res] >= p->pressure[res])
+                                stall = MAX(stall, (s->pressure[res] - p->pressure[res]) / 1000000.0 / dt);
+
+                if (stall > 0.001)
+                        fprintf(of, "    <rect class=\"psome\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                                time_to_graph(sampledata->sampletime - dt - graph_start),
+                                ps_to_graph(j),
+                                time_to_graph(dt),
+                                ps_to_graph(0.25 * MIN(stall, 1.0)));
+        }
+
+        fprintf(of, "  <text x=\"%.03f\" y=\"%.03f\"><![CDATA[%s]]><tspan class=\"run\">%.01fms cpu, %.01fM read, %.01fM written, %.01fM memory</tspan></text>\n",
+                time_to_graph(starttime - graph_start) + 5.0,
+                ps_to_graph(j) + 14.0,
+                u->name,
+                (last->usage_usec - MIN(first->usage_usec, last->usage_usec)) / 1000.0,
+                (last->rbytes - MIN(first->rbytes, last->rbytes)) / (1024.0 * 1024.0),
+                (last->wbytes - MIN(first->wbytes, last->wbytes)) / (1024.0 * 1024.0),
+                memory / (1024.0 * 1024.0));
+}
+
+static void svg_service_ps_row(FILE *of, struct ps_struct *ps, int j, double graph_start) {
+        _cleanup_free_ char *escaped = NULL;
+        struct ps_sched_struct *sample;
+        double starttime;
+
+        if (!utf8_is_printable(ps_name(ps), strlen(ps_name(ps))))
+                escaped = utf8_escape_non_printable(ps_name(ps));
+
+        starttime = ps->first->sampledata->sampletime;
+
+        fprintf(of, "  <rect class=\"ps\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                time_to_graph(starttime - graph_start),
+                ps_to_graph(j),
+                time_to_graph(ps->last->sampledata->sampletime - starttime),
+                ps_to_graph(1));
+
+        for (sample = ps->first; sample->next; sample = sample->next) {
+                double dt, prt;
+
+                dt = sample->next->sampledata->sampletime - sample->sampledata->sampletime;
+                if (dt <= 0.0)
+                        continue;
+
+                prt = MIN((sample->next->runtime - sample->runtime) / 1000000000.0 / dt, 1.0);
+                if (prt < 0.1)
+                        continue;
+
+                fprintf(of, "    <rect class=\"cpu\" x=\"%.03f\" y=\"%.03f\" width=\"%.03f\" height=\"%.03f\" />\n",
+                        time_to_graph(sample->sampledata->sampletime - graph_start),
+                        ps_to_graph(j + (1.0 - prt)),
+                        time_to_graph(dt),
+                        ps_to_graph(prt));
+        }
+
+        /* indented, to set them apart from the units */
+        fprintf(of, "  <text x=\"%.03f\" y=\"%.03f\">  <![CDATA[%s]]> [%i]<tspan class=\"run\">%.01fms</tspan></text>\n",
+                time_to_graph(starttime - graph_start) + 15.0,
+                ps_to_graph(j) + 14.0,
+                escaped ? escaped : ps_name(ps),
+                ps->pid,
+                to_ms(ps->total));
+}
+
+static void svg_services(FILE *of,
+                         struct list_sample_data *head,
+                         const struct services *services,
+                         const struct svg_service_row *rows,
+                         int scount,
+                         double graph_start) {
+        int j;
+
+        fprintf(of, "<!-- Service graph -->\n");
+        fprintf(of, "<text class=\"t2\" x=\"5\" y=\"-15\">Services</text>\n");
+
+        /* surrounding box */
+        svg_graph_box(of, head, scount, graph_start);
+
+        for (j = 0; j < scount; j++) {
+                if (rows[j].ps)
+                        svg_service_ps_row(of, rows[j].ps, j, graph_start);
+                else
+                        svg_service_row(of, head, &services->services[rows[j].service], rows[j].service, j, graph_start);
         }
 }
 
@@ -1273,7 +2097,7 @@ static void svg_top_ten_cpu(FILE *of, struct ps_struct *ps_first) {
                 fprintf(of, "<text class=\"t3\" x=\"20\" y=\"%d\">%3.01fms - <![CDATA[%s]]> [%d]</text>\n",
                         20 + (n * 13),
                         to_ms(top[n]->total),
-                        top[n]->name,
+                        ps_name(top[n]),
                         top[n]->pid);
 }
 
@@ -1306,108 +2130,557 @@ static void svg_top_ten_pss(FILE *of, struct ps_struct *ps_first) {
                 fprintf(of, "<text class=\"t3\" x=\"20\" y=\"%d\">%dK - <![CDATA[%s]]> [%d]</text>\n",
                         20 + (n * 13),
                         top[n]->pss_max,
-                        top[n]->name,
+                        ps_name(top[n]),
+                        top[n]->pid);
+}
+
+static void svg_top_ten_io(FILE *of, struct ps_struct *ps_first) {
+        struct ps_struct *top[10];
+        struct ps_struct emptyps = {};
+        struct ps_struct *ps;
+        int n, m;
+
+        for (n = 0; n < (int) ELEMENTSOF(top); n++)
+                top[n] = &emptyps;
+
+        /* walk all ps's and setup ptrs */
+        ps = ps_first;
+        while ((ps = get_next_ps(ps, ps_first))) {
+                for (n = 0; n < 10; n++) {
+                        if (ps->io_read + ps->io_write <= top[n]->io_read + top[n]->io_write)
+                                continue;
+
+                        /* cascade insert */
+                        for (m = 9; m > n; m--)
+                                top[m] = top[m-1];
+                        top[n] = ps;
+                        break;
+                }
+        }
+
+        fprintf(of, "<text class=\"t2\" x=\"20\" y=\"0\">Top IO consumers (read/write):</text>\n");
+        for (n = 0; n < 10; n++)
+                fprintf(of, "<text class=\"t3\" x=\"20\" y=\"%d\">%" PRIu64 "K/%" PRIu64 "K - <![CDATA[%s]]> [%d]</text>\n",
+                        20 + (n * 13),
+                        top[n]->io_read,
+                        top[n]->io_write,
+                        ps_name(top[n]),
                         top[n]->pid);
 }
 
+struct svg_render {
+        const struct system_info *system;
+        struct list_sample_data *head;
+        struct ps_struct *ps_first;
+        int n_samples;
+        int pscount;
+        int n_cpus;
+        double graph_start;
+        double log_start;
+        double interval;
+        int overrun;
+        const int *cpu_row;
+        int n_rows;
+        int heatmap_height;
+        const struct kmsg *kmsg;
+        const struct boot_times *boot;
+        const struct disks *disks;
+        const struct services *services;
+        const struct svg_service_row *service_rows;
+        struct svg_layout layout;
+        /* newest sample, the disk slots shown */
+        const struct list_sample_data *last;
+        const int *disk_slot;
+};
+
+typedef int (*svg_draw_t)(FILE *of, const struct svg_render *d, int arg);
+
+/*
+ * Each <g> group of the chart is rendered into its own memory stream
+ * by a pool of threads and written out in order afterwards. Drawing
+ * only reads the sample data, so the result is the same as drawing
+ * the groups one after the other.
+ */
+struct svg_section {
+        const char *name;
+        svg_draw_t draw;
+        int arg;
+        char transform[64];
+        char *buf;
+        size_t size;
+        usec_t usec;
+        int r;
+};
+
+struct svg_queue {
+        const struct svg_render *render;
+        struct svg_section *sections;
+        int n_sections;
+        int next;
+};
+
+static int svg_draw_io_bi(FILE *of, const struct svg_render *d, int arg) {
+        svg_io_bi_bar(of, d->head, d->n_samples, d->graph_start, d->interval);
+        return 0;
+}
+
+static int svg_draw_io_bo(FILE *of, const struct svg_render *d, int arg) {
+        svg_io_bo_bar(of, d->head, d->n_samples, d->graph_start, d->interval);
+        return 0;
+}
+
+static int svg_draw_pressure(FILE *of, const struct svg_render *d, int arg) {
+        svg_pressure_bar(of, d->head, arg, d->graph_start);
+        return 0;
+}
+
+static int svg_draw_overhead(FILE *of, const struct svg_render *d, int arg) {
+        svg_overhead_bar(of, d->head, d->graph_start);
+        return 0;
+}
+
+static int svg_draw_disk_io(FILE *of, const struct svg_render *d, int arg) {
+        svg_disk_io(of, d->head, disks_get_slot(d->disks, d->disk_slot[arg]), d->graph_start);
+        return 0;
+}
+
+static int svg_draw_disk_latency(FILE *of, const struct svg_render *d, int arg) {
+        svg_disk_latency(of, d->head, disks_get_slot(d->disks, d->disk_slot[arg]), d->graph_start);
+        return 0;
+}
+
+static int svg_draw_cpu(FILE *of, const struct svg_render *d, int arg) {
+        svg_cpu_bar(of, d->head, d->n_cpus, arg, d->graph_start);
+        return 0;
+}
+
+static int svg_draw_wait(FILE *of, const struct svg_render *d, int arg) {
+        svg_wait_bar(of, d->head, d->n_cpus, arg, d->graph_start);
+        return 0;
+}
+
+static int svg_draw_heatmap(FILE *of, const struct svg_render *d, int arg) {
+        svg_cpu_heatmap(of, d->head, d->n_cpus, d->cpu_row, d->n_rows, d->heatmap_height, arg, d->graph_start);
+        return 0;
+}
+
+static int svg_draw_initcall(FILE *of, const struct svg_render *d, int arg) {
+        svg_do_initcall(of, d->head, d->kmsg->initcalls, d->kmsg->n_initcalls, d->layout.kcount, d->graph_start);
+        return 0;
+}
+
+static int svg_draw_boot_phases(FILE *of, const struct svg_render *d, int arg) {
+        struct list_sample_data *last = d->head;
+
+        while (last->link_prev)
+                last = last->link_prev;
+
+        /* userspace is done when the system went idle, or when we stopped looking */
+        svg_boot_phases(of, d->boot, d->ps_first, d->graph_start,
+                        d->layout.idletime >= 0.0 ? d->layout.idletime : last->sampletime - d->graph_start);
+        return 0;
+}
+
+static int svg_draw_kernel_events(FILE *of, const struct svg_render *d, int arg) {
+        svg_kernel_events(of, d->head, d->kmsg, d->layout.kecount, d->graph_start);
+        return 0;
+}
+
+static int svg_draw_ps(FILE *of, const struct svg_render *d, int arg) {
+        svg_ps_bars(of, d->head, d->ps_first, d->layout.pcount, d->layout.idletime, d->graph_start);
+        return 0;
+}
+
+static int svg_draw_services(FILE *of, const struct svg_render *d, int arg) {
+        svg_services(of, d->head, d->services, d->service_rows, d->layout.scount, d->graph_start);
+        return 0;
+}
+
+static int svg_draw_title(FILE *of, const struct svg_render *d, int arg) {
+        return svg_title(of, d->system, d->head, d->last, d->disks, &d->layout, d->pscount, d->log_start, d->interval, d->overrun);
+}
+
+static int svg_draw_top_ten_cpu(FILE *of, const struct svg_render *d, int arg) {
+        svg_top_ten_cpu(of, d->ps_first);
+        return 0;
+}
+
+static int svg_draw_entropy(FILE *of, const struct svg_render *d, int arg) {
+        svg_entropy_bar(of, d->head, d->graph_start);
+        return 0;
+}
+
+static int svg_draw_pss(FILE *of, const struct svg_render *d, int arg) {
+        svg_pss_graph(of, d->head, d->ps_first, d->graph_start);
+        return 0;
+}
+
+static int svg_draw_top_ten_pss(FILE *of, const struct svg_render *d, int arg) {
+        svg_top_ten_pss(of, d->ps_first);
+        return 0;
+}
+
+static int svg_draw_top_ten_io(FILE *of, const struct svg_render *d, int arg) {
+        svg_top_ten_io(of, d->ps_first);
+        return 0;
+}
+
+_printf_(6, 7)
+static void svg_section_add_full(struct svg_section *sections,
+                                 int *n_sections,
+                                 const char *name,
+                                 svg_draw_t draw,
+                                 int arg,
+                                 const char *format, ...) {
+        struct svg_section *s = &sections[(*n_sections)++];
+        va_list ap;
+
+        s->name = name;
+        s->draw = draw;
+        s->arg = arg;
+
+        va_start(ap, format);
+        vsnprintf(s->transform, sizeof(s->transform), format, ap);
+        va_end(ap);
+}
+
+/* the section is named after its draw function, less the svg_draw_ prefix */
+#define svg_section_add(sections, n_sections, draw, arg, ...) \
+        svg_section_add_full(sections, n_sections, #draw + strlen("svg_draw_"), draw, arg, __VA_ARGS__)
+
+static void svg_section_render(struct svg_section *s, const struct svg_render *d) {
+        usec_t start;
+        FILE *f;
+        int r;
+
+        start = now(CLOCK_THREAD_CPUTIME_ID);
+
+        f = open_memstream(&s->buf, &s->size);
+        if (!f) {
+                s->r = -ENOMEM;
+                return;
+        }
+
+        fprintf(f, "<g transform=\"%s\">\n", s->transform);
+        s->r = s->draw(f, d, s->arg);
+        fprintf(f, "</g>\n\n");
+
+        r = fclose_nointr(f);
+        if (r < 0 && s->r >= 0)
+                s->r = r;
+
+        s->usec = now(CLOCK_THREAD_CPUTIME_ID) - start;
+}
+
+static void *svg_worker(void *userdata) {
+        struct svg_queue *q = userdata;
+
+        for (;;) {
+                int i;
+
+                i = __sync_fetch_and_add(&q->next, 1);
+                if (i >= q->n_sections)
+                        return NULL;
+
+                svg_section_render(&q->sections[i], q->render);
+        }
+}
+
+static int svg_render_threads(void) {
+        cpu_set_t set;
+
+        if (sched_getaffinity(0, sizeof(set), &set) < 0)
+                return 1;
+
+        return MAX(CPU_COUNT(&set), 1);
+}
+
+static void svg_render_sections(struct svg_queue *q) {
+        pthread_t *threads;
+        int n_threads, i, started = 0;
+
+        n_threads = MIN(svg_render_threads(), q->n_sections) - 1;
+        threads = n_threads > 0 ? new0(pthread_t, n_threads) : NULL;
+
+        for (i = 0; threads && i < n_threads; i++) {
+                if (pthread_create(&threads[i], NULL, svg_worker, q) != 0)
+                        break;
+                started++;
+        }
+
+        /* this thread helps out, and does all the work if no threads could be started */
+        svg_worker(q);
+
+        for (i = 0; i < started; i++)
+                pthread_join(threads[i], NULL);
+
+        free(threads);
+}
+
 int svg_do(FILE *of,
-           const char *build,
+           const struct system_info *system,
            struct list_sample_data *head,
            struct ps_struct *ps_first,
+           const struct kmsg *kmsg,
+           const struct disks *disks,
+           const struct services *services,
+           const struct boot_times *boot,
            int n_samples,
            int pscount,
            int n_cpus,
            double graph_start,
            double log_start,
            double interval,
-           int overrun) {
-
+           int overrun,
+           struct svg_stats *stats) {
+
+        _cleanup_free_ struct svg_section *sections = NULL;
+        _cleanup_free_ int *cpu_row = NULL;
+        _cleanup_free_ int *disk_slot = NULL;
+        _cleanup_free_ struct svg_service_row *service_rows = NULL;
+        struct svg_render render = {
+                .system = system,
+                .ps_first = ps_first,
+                .n_samples = n_samples,
+                .pscount = pscount,
+                .n_cpus = n_cpus,
+                .graph_start = graph_start,
+                .log_start = log_start,
+                .interval = interval,
+                .overrun = overrun,
+                .kmsg = kmsg,
+                .boot = boot,
+                .disks = disks,
+                .services = services,
+                .last = head,
+        };
+        struct svg_queue queue = {
+                .render = &render,
+        };
+        struct svg_layout *layout = &render.layout;
         struct ps_struct *ps;
         double offset = 7;
-        int r, c;
+        int n_sections = 0;
+        int r = 0, c;
 
-        sampledata = head;
-        LIST_FIND_TAIL(link, sampledata, head);
+        LIST_FIND_TAIL(link, head, head);
+        render.head = head;
         ps = ps_first;
 
-        /* count initcall thread count first */
-        svg_do_initcall(of, head, 1, graph_start);
-        ksize = kcount ? ps_to_graph(kcount) + (arg_scale_y * 2) : 0;
+        /* count initcall thread count first, can't plot them in relative mode */
+        if (arg_initcall && !arg_relative) {
+                size_t i;
+
+                for (i = 0; i < kmsg->n_initcalls; i++)
+                        /* filter out irrelevant stuff */
+                        if (kmsg->initcalls[i].usecs >= 1000)
+                                layout->kcount++;
+
+                for (i = 0; i < kmsg->n_modules; i++)
+                        if (!kernel_module_filter(&kmsg->modules[i]))
+                                layout->kecount++;
+        }
+        layout->ksize = layout->kcount ? ps_to_graph(layout->kcount) + (arg_scale_y * 2) : 0;
+        layout->kesize = layout->kecount ? ps_to_graph(layout->kecount) + (arg_scale_y * 7) : 0;
+
+        /* pre-boot times are relative to the kernel start, like the initcalls */
+        if (boot && !arg_relative)
+                layout->bsize = ps_to_graph(3);
 
         /* then count processes */
         while ((ps = get_next_ps(ps, ps_first))) {
                 if (!ps_filter(ps))
-                        pcount++;
+                        layout->pcount++;
                 else
-                        pfiltered++;
+                        layout->pfiltered++;
         }
-        psize = ps_to_graph(pcount) + (arg_scale_y * 2);
+        layout->psize = ps_to_graph(layout->pcount) + (arg_scale_y * 2);
 
-        esize = (arg_entropy ? arg_scale_y * 7 : 0);
+        layout->esize = (arg_entropy ? arg_scale_y * 7 : 0);
+        layout->prsize = (arg_pressure ? arg_scale_y * 7 * _PRESSURE_RESOURCE_MAX : 0);
+        /* the governor's changes are annotated on the overhead graph */
+        layout->ovsize = (arg_overhead || arg_max_overhead > 0.0 ? arg_scale_y * 7 : 0);
 
-        /* after this, we can draw the header with proper sizing */
-        svg_header(of, head, graph_start, arg_percpu ? n_cpus : 0);
-        fprintf(of, "<rect class=\"bg\" width=\"100%%\" height=\"100%%\" />\n\n");
+        if (arg_service_view != SERVICE_VIEW_NO && services->n_services > 0) {
+                size_t i;
+
+                /* at most every unit and every process once */
+                service_rows = new(struct svg_service_row, services->n_services + pscount);
+                if (!service_rows)
+                        return -ENOMEM;
+
+                for (i = 0; i < services->n_services; i++) {
+                        if (!service_active(head, i))
+                                continue;
+
+                        service_rows[layout->scount++] = (struct svg_service_row) { .service = i };
+
+                        if (arg_service_view != SERVICE_VIEW_EXPANDED)
+                                continue;
 
-        fprintf(of, "<g transform=\"translate(10,400)\">\n");
-        svg_io_bi_bar(of, head, n_samples, graph_start, interval);
-        fprintf(of, "</g>\n\n");
+                        ps = ps_first;
+                        while ((ps = get_next_ps(ps, ps_first)))
+                                if (!ps_filter(ps) && services_find(services, ps_cgroup(ps)) == (int) i)
+                                        service_rows[layout->scount++] = (struct svg_service_row) { .service = i, .ps = ps };
+                }
+
+                render.service_rows = service_rows;
+                if (layout->scount > 0)
+                        layout->ssize = ps_to_graph(layout->scount) + (arg_scale_y * 7);
+                ps = ps_first;
+        }
+
+        /* disks that saw no IO while recording don't get graphs */
+        if (arg_disks && disks->n_slots > 0) {
+                disk_slot = new(int, disks->n_slots);
+                if (!disk_slot)
+                        return -ENOMEM;
+
+                for (c = 0; c < disks->n_slots; c++)
+                        if (disk_active(head, c))
+                                disk_slot[layout->dcount++] = c;
+
+                render.disk_slot = disk_slot;
+                layout->dsize = ps_to_graph(14 * layout->dcount);
+        }
+
+        if (arg_cpu_heatmap && n_cpus > 0) {
+                cpu_row = new(int, n_cpus);
+                if (!cpu_row)
+                        return -ENOMEM;
+
+                r = cpu_topology_group(prefix_roota(arg_root, "/sys"), n_cpus, arg_cpu_group, cpu_row);
+                if (r < 0)
+                        return r;
+
+                render.cpu_row = cpu_row;
+                render.n_rows = r;
+                /* a quarter of a process bar per row */
+                render.heatmap_height = (render.n_rows + 3) / 4;
+                layout->hsize = ps_to_graph(2 * (render.heatmap_height + 2));
+        }
+
+        /* the title needs this before the process graph is drawn */
+        layout->idletime = idle_find(head, n_cpus, graph_start, arg_idle_window, arg_idle_threshold / 100.0);
 
-        fprintf(of, "<g transform=\"translate(10,%.03f)\">\n", 400.0 + (arg_scale_y * offset));
-        svg_io_bo_bar(of, head, n_samples, graph_start, interval);
-        fprintf(of, "</g>\n\n");
+        /* io bi/bo, disks, cpu/wait per cpu, pressure, overhead, heatmaps, boot phases, initcall, kernel events, services, ps, title, top ten, entropy, pss + top ten */
+        sections = new0(struct svg_section, 2 + 2 * layout->dcount + 2 * ((arg_percpu ? n_cpus : 0) + 1) + _PRESSURE_RESOURCE_MAX + 1 + 2 + 11);
+        if (!sections)
+                return -ENOMEM;
+
+        svg_section_add(sections, &n_sections, svg_draw_io_bi, 0, "translate(10,400)");
+        svg_section_add(sections, &n_sections, svg_draw_io_bo, 0, "translate(10,%.03f)", 400.0 + (arg_scale_y * offset));
+
+        for (c = 0; c < layout->dcount; c++) {
+                offset += 7;
+                svg_section_add(sections, &n_sections, svg_draw_disk_io, c, "translate(10,%.03f)", 400.0 + (arg_scale_y * offset));
+
+                offset += 7;
+                svg_section_add(sections, &n_sections, svg_draw_disk_latency, c, "translate(10,%.03f)", 400.0 + (arg_scale_y * offset));
+        }
 
         for (c = -1; c < (arg_percpu ? n_cpus : 0); c++) {
                 offset += 7;
-                fprintf(of, "<g transform=\"translate(10,%.03f)\">\n", 400.0 + (arg_scale_y * offset));
-                svg_cpu_bar(of, head, n_cpus, c, graph_start);
-                fprintf(of, "</g>\n\n");
+                svg_section_add(sections, &n_sections, svg_draw_cpu, c, "translate(10,%.03f)", 400.0 + (arg_scale_y * offset));
 
                 offset += 7;
-                fprintf(of, "<g transform=\"translate(10,%.03f)\">\n", 400.0 + (arg_scale_y * offset));
-                svg_wait_bar(of, head, n_cpus, c, graph_start);
-                fprintf(of, "</g>\n\n");
+                svg_section_add(sections, &n_sections, svg_draw_wait, c, "translate(10,%.03f)", 400.0 + (arg_scale_y * offset));
         }
 
-        if (kcount) {
+        for (c = 0; arg_pressure && c < _PRESSURE_RESOURCE_MAX; c++) {
                 offset += 7;
-                fprintf(of, "<g transform=\"translate(10,%.03f)\">\n", 400.0 + (arg_scale_y * offset));
-                svg_do_initcall(of, head, 0, graph_start);
-                fprintf(of, "</g>\n\n");
+                svg_section_add(sections, &n_sections, svg_draw_pressure, c, "translate(10,%.03f)", 400.0 + (arg_scale_y * offset));
         }
 
-        offset += 7;
-        fprintf(of, "<g transform=\"translate(10,%.03f)\">\n", 400.0 + (arg_scale_y * offset) + ksize);
-        svg_ps_bars(of, head, n_samples, n_cpus, ps_first, graph_start, interval);
-        fprintf(of, "</g>\n\n");
+        if (layout->ovsize > 0) {
+                offset += 7;
+                svg_section_add(sections, &n_sections, svg_draw_overhead, 0, "translate(10,%.03f)", 400.0 + (arg_scale_y * offset));
+        }
+
+        if (render.n_rows > 0) {
+                offset += 7;
+                svg_section_add(sections, &n_sections, svg_draw_heatmap, false, "translate(10,%.03f)", 400.0 + (arg_scale_y * offset));
 
-        fprintf(of, "<g transform=\"translate(10,  0)\">\n");
-        r = svg_title(of, build, pscount, log_start, overrun);
-        fprintf(of, "</g>\n\n");
+                offset += render.heatmap_height + 2;
+                svg_section_add(sections, &n_sections, svg_draw_heatmap, true, "translate(10,%.03f)", 400.0 + (arg_scale_y * offset));
 
-        if (r < 0)
-                return r;
+                /* the next track expects to follow a box of height 5 */
+                offset += render.heatmap_height - 5;
+        }
 
-        fprintf(of, "<g transform=\"translate(10,200)\">\n");
-        svg_top_ten_cpu(of, ps_first);
-        fprintf(of, "</g>\n\n");
+        if (layout->bsize > 0) {
+                offset += 7;
+                svg_section_add(sections, &n_sections, svg_draw_boot_phases, 0, "translate(10,%.03f)", 400.0 + (arg_scale_y * offset));
 
-        if (arg_entropy) {
-                fprintf(of, "<g transform=\"translate(10,%.03f)\">\n", 400.0 + (arg_scale_y * offset) + ksize + psize);
-                svg_entropy_bar(of, head, graph_start);
-                fprintf(of, "</g>\n\n");
+                /* the next track expects to follow a box of height 5 */
+                offset += 1 - 5;
         }
 
+        if (layout->kcount) {
+                offset += 7;
+                svg_section_add(sections, &n_sections, svg_draw_initcall, 0, "translate(10,%.03f)", 400.0 + (arg_scale_y * offset));
+        }
+
+        offset += 7;
+        if (layout->kecount)
+                svg_section_add(sections, &n_sections, svg_draw_kernel_events, 0, "translate(10,%.03f)", 400.0 + (arg_scale_y * offset) + layout->ksize);
+
+        if (layout->scount)
+                svg_section_add(sections, &n_sections, svg_draw_services, 0, "translate(10,%.03f)", 400.0 + (arg_scale_y * offset) + layout->ksize + layout->kesize);
+
+        svg_section_add(sections, &n_sections, svg_draw_ps, 0, "translate(10,%.03f)", 400.0 + (arg_scale_y * offset) + layout->ksize + layout->kesize + layout->ssize);
+
+        svg_section_add(sections, &n_sections, svg_draw_title, 0, "translate(10,  0)");
+
+        svg_section_add(sections, &n_sections, svg_draw_top_ten_cpu, 0, "translate(10,200)");
+
+        if (arg_entropy)
+                svg_section_add(sections, &n_sections, svg_draw_entropy, 0, "translate(10,%.03f)", 400.0 + (arg_scale_y * offset) + layout->ksize + layout->kesize + layout->ssize + layout->psize);
+
         if (arg_pss) {
-                fprintf(of, "<g transform=\"translate(10,%.03f)\">\n", 400.0 + (arg_scale_y * offset) + ksize + psize + esize);
-                svg_pss_graph(of, head, ps_first, graph_start);
-                fprintf(of, "</g>\n\n");
+                svg_section_add(sections, &n_sections, svg_draw_pss, 0, "translate(10,%.03f)", 400.0 + (arg_scale_y * offset) + layout->ksize + layout->kesize + layout->ssize + layout->psize + layout->esize);
+                svg_section_add(sections, &n_sections, svg_draw_top_ten_pss, 0, "translate(410,200)");
+        }
+
+        if (arg_io)
+                svg_section_add(sections, &n_sections, svg_draw_top_ten_io, 0, "translate(%d,200)", arg_pss ? 810 : 410);
 
-                fprintf(of, "<g transform=\"translate(410,200)\">\n");
-                svg_top_ten_pss(of, ps_first);
-                fprintf(of, "</g>\n\n");
+        queue.sections = sections;
+        queue.n_sections = n_sections;
+        svg_render_sections(&queue);
+
+        if (stats) {
+                stats->sections = new(struct svg_section_stats, n_sections);
+                stats->n_sections = stats->sections ? n_sections : 0;
+
+                for (c = 0; c < stats->n_sections; c++)
+                        stats->sections[c] = (struct svg_section_stats) {
+                                .name = sections[c].name,
+                                .arg = sections[c].arg,
+                                .usec = sections[c].usec,
+                                .size = sections[c].size,
+                        };
         }
 
+        /* after this, we can draw the header with proper sizing */
+        svg_header(of, head, layout, graph_start, arg_percpu ? n_cpus : 0);
+        fprintf(of, "<rect class=\"bg\" width=\"100%%\" height=\"100%%\" />\n\n");
+
+        for (c = 0; c < n_sections; c++) {
+                struct svg_section *s = &sections[c];
+
+                if (r >= 0) {
+                        if (s->buf)
+                                fwrite(s->buf, 1, s->size, of);
+                        r = s->r;
+                }
+
+                free(s->buf);
+        }
+
+        if (r < 0)
+                return r;
+
         /* fprintf footer */
         fprintf(of, "\n</svg>\n");
 
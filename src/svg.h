@@ -22,17 +22,50 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <bootchart.h>
 
+#include "disk.h"
+#include "efi.h"
+#include "kmsg.h"
+#include "system-info.h"
+#include "time-util.h"
+
+/* walks the process tree in the order processes are painted */
+struct ps_struct *get_next_ps(struct ps_struct *ps, struct ps_struct *ps_first);
+/* true if the process is not significant enough to be painted */
+bool ps_filter(struct ps_struct *ps);
+
+/* what drawing one <g> group of the chart cost */
+struct svg_section_stats {
+        /* the part of the chart, arg tells apart disks, CPUs and the like */
+        const char *name;
+        int arg;
+        /* CPU time of the thread that drew it */
+        usec_t usec;
+        size_t size;
+};
+
+struct svg_stats {
+        struct svg_section_stats *sections;
+        int n_sections;
+};
+
+/* stats may be NULL, otherwise its sections need to be freed by the caller */
 int svg_do(FILE *of,
-           const char *build,
+           const struct system_info *system,
            struct list_sample_data *head,
            struct ps_struct *ps_first,
+           const struct kmsg *kmsg,
+           const struct disks *disks,
+           const struct services *services,
+           const struct boot_times *boot,
            int n_samples,
            int pscount,
            int n_cpus,
            double graph_start,
            double log_start,
            double interval,
-           int overrun);
+           int overrun,
+           struct svg_stats *stats);
@@ -0,0 +1,76 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+
+#include "alloc-util.h"
+#include "architecture.h"
+#include "fileio.h"
+#include "log.h"
+#include "path-util.h"
+#include "string-util.h"
+#include "system-info.h"
+
+void system_info_read(struct system_info *s, const char *root) {
+        struct utsname uts;
+        int r;
+
+        assert(s);
+
+        if (!s->build &&
+            parse_env_file("/etc/os-release", NEWLINE, "PRETTY_NAME", &s->build, NULL) == -ENOENT)
+                (void) parse_env_file("/usr/lib/os-release", NEWLINE, "PRETTY_NAME", &s->build, NULL);
+
+        if (!s->cmdline) {
+                r = read_one_line_file(prefix_roota(root, "/proc/cmdline"), &s->cmdline);
+                if (r < 0)
+                        log_debug_errno(r, "Unable to read cmdline, ignoring: %m");
+        }
+
+        if (!s->cpu) {
+                r = get_proc_field(prefix_roota(root, "/proc/cpuinfo"), PROC_CPUINFO_MODEL, "\n", &s->cpu);
+                if (r < 0)
+                        log_debug_errno(r, "Unable to read the CPU model, ignoring: %m");
+        }
+
+        if (s->hostname && s->kernel)
+                return;
+
+        if (uname(&uts) < 0) {
+                log_debug_errno(errno, "Error getting uname info, ignoring: %m");
+                return;
+        }
+
+        if (!s->hostname)
+                s->hostname = strdup(uts.nodename);
+        if (!s->kernel)
+                (void) asprintf(&s->kernel, "%s %s %s %s", uts.sysname, uts.release, uts.version, uts.machine);
+}
+
+void system_info_done(struct system_info *s) {
+        assert(s);
+
+        s->build = mfree(s->build);
+        s->cmdline = mfree(s->cmdline);
+        s->hostname = mfree(s->hostname);
+        s->kernel = mfree(s->kernel);
+        s->cpu = mfree(s->cpu);
+}
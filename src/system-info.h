@@ -0,0 +1,41 @@
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+
+/*
+ * What the title and the report say about the system that was
+ * sampled. A recording keeps it, so a replay describes the system
+ * that booted rather than the one it runs on. Any of it may be NULL
+ * when it couldn't be read.
+ */
+struct system_info {
+        /* PRETTY_NAME of os-release */
+        char *build;
+        char *cmdline;
+        char *hostname;
+        /* system name, release, version and machine, as uname(2) has them */
+        char *kernel;
+        char *cpu;
+};
+
+#define SYSTEM_INFO_INIT {}
+
+/* reads what is still missing, below root for what comes from /proc */
+void system_info_read(struct system_info *s, const char *root);
+void system_info_done(struct system_info *s);
@@ -0,0 +1,184 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+/*
+ * Checks idle_find() and idle_recent() on made up samples. Samples are
+ * taken at 8 Hz so that every sampletime, and the default window of
+ * half a second, are exact in a double.
+ */
+
+#include <stdlib.h>
+
+#include "alloc-util.h"
+#include "bootchart.h"
+#include "idle.h"
+#include "list.h"
+#include "macro.h"
+#include "time-util.h"
+#include "util.h"
+
+#define HZ 8.0
+#define GRAPH_START 100.0
+#define N_CPUS 2
+#define WINDOW 0.5
+#define THRESHOLD 0.04
+
+/*
+ * n samples, the CPUs run load[i] CPUs worth of work between sample i
+ * and the next, self[i] of which is what sample i cost. Returns the
+ * newest sample, like the sampler keeps them.
+ */
+static struct list_sample_data *samples_new(int n, const double *load, const double *self) {
+        struct list_sample_data *head = NULL, *prev = NULL;
+        int i, c;
+
+        for (i = 0; i < n; i++) {
+                struct list_sample_data *s;
+
+                s = new0(struct list_sample_data, 1);
+                assert_se(s);
+
+                s->sampletime = GRAPH_START + i / HZ;
+                for (c = 0; c < N_CPUS; c++)
+                        s->runtime[c] = prev ? prev->runtime[c] + load[i - 1] / N_CPUS * NSEC_PER_SEC / HZ : 0.0;
+                s->overhead.cpu = self ? self[i] * NSEC_PER_SEC / HZ : 0;
+
+                LIST_PREPEND(link, head, s);
+                prev = s;
+        }
+
+        return head;
+}
+
+static void samples_free(struct list_sample_data *head) {
+        while (head) {
+                struct list_sample_data *s = head;
+
+                head = head->link_next;
+                free(s);
+        }
+}
+
+static double find(struct list_sample_data *head) {
+        struct list_sample_data *first;
+
+        LIST_FIND_TAIL(link, head, first);
+        return idle_find(first, N_CPUS, GRAPH_START, WINDOW, THRESHOLD);
+}
+
+static void fill(double *v, int from, int to, double value) {
+        int i;
+
+        for (i = from; i < to; i++)
+                v[i] = value;
+}
+
+static void test_busy_then_idle(void) {
+        struct list_sample_data *head;
+        double load[16];
+
+        /* a CPU busy for the first second, then next to nothing */
+        fill(load, 0, 8, 1.0);
+        fill(load, 8, 16, 0.01);
+
+        head = samples_new(16, load, NULL);
+        assert_se(find(head) == 1.0);
+        /* the newest window, from 1.375s on, was idle */
+        assert_se(idle_recent(head, N_CPUS, WINDOW, THRESHOLD));
+        /* the window that ends at 1.375s still holds the last busy interval */
+        assert_se(!idle_recent(head->link_next->link_next->link_next->link_next, N_CPUS, WINDOW, THRESHOLD));
+        samples_free(head);
+
+        /* a window needs to be full, a recording that ends within it never went idle */
+        head = samples_new(13, load, NULL);
+        assert_se(find(head) == 1.0);
+        samples_free(head);
+
+        head = samples_new(12, load, NULL);
+        assert_se(find(head) < 0.0);
+        samples_free(head);
+}
+
+static void test_self(void) {
+        struct list_sample_data *head;
+        double load[16], self[16];
+
+        /* after a second, all that runs is bootchart itself at a tenth of a CPU */
+        fill(load, 0, 8, 1.0);
+        fill(load, 8, 16, 0.1);
+        fill(self, 0, 16, 0.0);
+        fill(self, 8, 16, 0.1);
+
+        head = samples_new(16, load, self);
+        assert_se(find(head) == 1.0);
+        assert_se(idle_recent(head, N_CPUS, WINDOW, THRESHOLD));
+        samples_free(head);
+
+        /* without knowing what the samples cost, as in a replay, that is busy */
+        head = samples_new(16, load, NULL);
+        assert_se(find(head) < 0.0);
+        assert_se(!idle_recent(head, N_CPUS, WINDOW, THRESHOLD));
+        samples_free(head);
+}
+
+static void test_no_schedstat(void) {
+        struct list_sample_data *head;
+        double load[16];
+
+        /* without schedstat the CPUs never run anything, which isn't idle */
+        fill(load, 0, 16, 0.0);
+
+        head = samples_new(16, load, NULL);
+        assert_se(find(head) < 0.0);
+        assert_se(!idle_recent(head, N_CPUS, WINDOW, THRESHOLD));
+        samples_free(head);
+}
+
+static void test_window_edges(void) {
+        struct list_sample_data *head;
+        double load[16];
+
+        fill(load, 0, 16, 0.01);
+
+        /* a window of exactly the recording */
+        head = samples_new(5, load, NULL);
+        assert_se(find(head) == 0.0);
+        assert_se(idle_recent(head, N_CPUS, WINDOW, THRESHOLD));
+        samples_free(head);
+
+        /* one sample short of a window */
+        head = samples_new(4, load, NULL);
+        assert_se(find(head) < 0.0);
+        assert_se(!idle_recent(head, N_CPUS, WINDOW, THRESHOLD));
+        assert_se(idle_find(NULL, N_CPUS, GRAPH_START, WINDOW, THRESHOLD) < 0.0);
+        samples_free(head);
+
+        /* no window, no idle */
+        head = samples_new(16, load, NULL);
+        assert_se(!idle_recent(head, N_CPUS, 0.0, THRESHOLD));
+        assert_se(idle_find(head, N_CPUS, GRAPH_START, 0.0, THRESHOLD) < 0.0);
+        samples_free(head);
+}
+
+int main(int argc, char *argv[]) {
+        test_busy_then_idle();
+        test_self();
+        test_no_schedstat();
+        test_window_edges();
+
+        return EXIT_SUCCESS;
+}
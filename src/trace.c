@@ -0,0 +1,327 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+ ***/
+
+/*
+ * Trace event JSON, as understood by chrome://tracing and Perfetto.
+ *
+ * Every painted process becomes a track with one slice spanning its
+ * lifetime and "cpu" counter events for each sample. Tracks are sorted
+ * in the same tree order as the SVG, and a flow arrow links each
+ * process to its parent. System wide counters, the kernel initcalls and
+ * the module, probe and firmware events go to a separate "system"
+ * track. Events are written out as they are generated, nothing but the
+ * per sample PSS totals is kept in memory.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "bootchart.h"
+#include "hashmap.h"
+#include "kmsg.h"
+#include "json.h"
+#include "list.h"
+#include "macro.h"
+#include "set.h"
+#include "stdio-util.h"
+#include "svg.h"
+#include "trace.h"
+
+/* trace pid of the system track */
+#define TRACE_SYSTEM 0
+
+struct trace {
+        FILE *of;
+        double graph_start;
+        bool first;
+};
+
+static double trace_ts(const struct trace *t, double sampletime) {
+        /* microseconds */
+        return (sampletime - t->graph_start) * 1000000.0;
+}
+
+static void trace_event(struct trace *t, const char *ph, const char *name, int pid, int tid) {
+        fputs(t->first ? "\n" : ",\n", t->of);
+        t->first = false;
+
+        fprintf(t->of, "{\"ph\":\"%s\",\"pid\":%i,\"tid\":%i,\"name\":", ph, pid, tid);
+        json_write_string(t->of, name);
+}
+
+static void trace_metadata(struct trace *t, const char *name, int pid, int tid, const char *key, const char *value) {
+        trace_event(t, "M", name, pid, tid);
+        fprintf(t->of, ",\"args\":{\"%s\":", key);
+        json_write_string(t->of, value);
+        fputs("}}", t->of);
+}
+
+static void trace_sort_index(struct trace *t, int pid, int index) {
+        trace_event(t, "M", "process_sort_index", pid, pid);
+        fprintf(t->of, ",\"args\":{\"sort_index\":%i}}", index);
+}
+
+static void trace_system(struct trace *t,
+                         struct list_sample_data *head,
+                         struct ps_struct *ps_first,
+                         int n_cpus) {
+
+        _cleanup_free_ double *pss = NULL;
+        struct list_sample_data *sampledata, *prev_sampledata;
+        int max_counter = 0;
+
+        trace_metadata(t, "process_name", TRACE_SYSTEM, TRACE_SYSTEM, "name", "system");
+        trace_sort_index(t, TRACE_SYSTEM, -1);
+
+        /* PSS is only recorded per process, sum it up per sample first */
+        if (arg_pss) {
+                struct ps_struct *ps;
+
+                for (sampledata = head; sampledata; sampledata = sampledata->link_prev)
+                        max_counter = MAX(max_counter, sampledata->counter);
+
+                pss = new0(double, max_counter + 1);
+
+                for (ps = ps_first->next_ps; pss && ps; ps = ps->next_ps) {
+                        struct ps_sched_struct *sample;
+
+                        for (sample = ps->first; sample; sample = sample->next)
+                                pss[sample->sampledata->counter] += sample->pss;
+                }
+        }
+
+        prev_sampledata = head;
+        LIST_FOREACH_BEFORE(link, sampledata, head) {
+                double dt, trt = 0.0, twt = 0.0;
+                int c;
+
+                dt = sampledata->sampletime - prev_sampledata->sampletime;
+                if (dt <= 0.0)
+                        continue;
+
+                for (c = 0; c < n_cpus; c++) {
+                        trt += sampledata->runtime[c] - prev_sampledata->runtime[c];
+                        twt += sampledata->waittime[c] - prev_sampledata->waittime[c];
+                }
+
+                /* utilization of all CPUs together, in percent */
+                trace_event(t, "C", "cpu", TRACE_SYSTEM, TRACE_SYSTEM);
+                fprintf(t->of, ",\"ts\":%.3f,\"args\":{\"utilization\":%.2f,\"wait\":%.2f}}",
+                        trace_ts(t, prev_sampledata->sampletime),
+                        n_cpus > 0 ? trt / 10000000.0 / dt / n_cpus : 0.0,
+                        n_cpus > 0 ? twt / 10000000.0 / dt / n_cpus : 0.0);
+
+                /* pgpgin/pgpgout count kilobytes */
+                trace_event(t, "C", "io", TRACE_SYSTEM, TRACE_SYSTEM);
+                fprintf(t->of, ",\"ts\":%.3f,\"args\":{\"read_kbps\":%.1f,\"write_kbps\":%.1f}}",
+                        trace_ts(t, prev_sampledata->sampletime),
+                        (sampledata->blockstat.bi - prev_sampledata->blockstat.bi) / dt,
+                        (sampledata->blockstat.bo - prev_sampledata->blockstat.bo) / dt);
+
+                if (arg_entropy) {
+                        trace_event(t, "C", "entropy", TRACE_SYSTEM, TRACE_SYSTEM);
+                        fprintf(t->of, ",\"ts\":%.3f,\"args\":{\"entropy_avail\":%i}}",
+                                trace_ts(t, sampledata->sampletime),
+                                sampledata->entropy_avail);
+                }
+
+                if (pss) {
+                        trace_event(t, "C", "pss", TRACE_SYSTEM, TRACE_SYSTEM);
+                        fprintf(t->of, ",\"ts\":%.3f,\"args\":{\"MB\":%.3f}}",
+                                trace_ts(t, sampledata->sampletime),
+                                pss[sampledata->counter] / 1024.0);
+                }
+
+                prev_sampledata = sampledata;
+        }
+}
+
+static void trace_initcalls(struct trace *t, const struct kmsg *kmsg) {
+        size_t i;
+
+        /* initcalls are timestamped since boot, which relative mode doesn't know about */
+        if (!arg_initcall || arg_relative)
+                return;
+
+        if (kmsg->n_initcalls > 0)
+                trace_metadata(t, "thread_name", TRACE_SYSTEM, 1, "name", "initcalls");
+
+        for (i = 0; i < kmsg->n_initcalls; i++) {
+                const struct initcall *ic = &kmsg->initcalls[i];
+
+                trace_event(t, "X", ic->func, TRACE_SYSTEM, 1);
+                fprintf(t->of, ",\"cat\":\"initcall\",\"ts\":%.3f,\"dur\":%i,\"args\":{\"ret\":%i,\"module\":",
+                        ic->time * 1000000.0 - ic->usecs,
+                        ic->usecs,
+                        ic->ret);
+                json_write_string(t->of, ic->module);
+                fputs("}}", t->of);
+        }
+}
+
+static void trace_kernel_events(struct trace *t, const struct kmsg *kmsg) {
+        size_t i, j;
+
+        if (!arg_initcall || arg_relative)
+                return;
+
+        /* one thread per module or driver, after the initcalls */
+        for (i = 0; i < kmsg->n_modules; i++) {
+                const struct kernel_module *m = &kmsg->modules[i];
+                int tid = 2 + i;
+
+                trace_metadata(t, "thread_name", TRACE_SYSTEM, tid, "name", m->name);
+
+                for (j = 0; j < m->n_events; j++) {
+                        const struct kernel_event *ev = &m->events[j];
+
+                        if (ev->type == KERNEL_EVENT_FIRMWARE) {
+                                trace_event(t, "i", ev->name, TRACE_SYSTEM, tid);
+                                fprintf(t->of, ",\"cat\":\"firmware\",\"s\":\"t\",\"ts\":%.3f,\"args\":{\"ret\":%i}}",
+                                        ev->start * 1000000.0, ev->ret);
+                        } else {
+                                trace_event(t, "X", ev->name, TRACE_SYSTEM, tid);
+                                fprintf(t->of, ",\"cat\":\"%s\",\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"ret\":%i}}",
+                                        kernel_event_type_to_string(ev->type),
+                                        ev->start * 1000000.0,
+                                        (ev->end - ev->start) * 1000000.0,
+                                        ev->ret);
+                        }
+                }
+        }
+}
+
+static void trace_process(struct trace *t, struct ps_struct *ps, int pid, int parent_pid, int index) {
+        struct ps_sched_struct *sample;
+        double starttime, endtime;
+        char label[32];
+
+        starttime = ps->first->sampledata->sampletime;
+        endtime = ps->last->sampledata->sampletime;
+
+        trace_metadata(t, "process_name", pid, pid, "name", ps_name(ps));
+        trace_sort_index(t, pid, index);
+
+        xsprintf(label, "pid %i, ppid %i", ps->pid, ps->ppid);
+        trace_metadata(t, "process_labels", pid, pid, "labels", label);
+
+        trace_event(t, "X", ps_name(ps), pid, pid);
+        fprintf(t->of, ",\"cat\":\"process\",\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"pid\":%i,\"ppid\":%i,\"cgroup\":",
+                trace_ts(t, starttime),
+                (endtime - starttime) * 1000000.0,
+                ps->pid, ps->ppid);
+        json_write_string(t->of, ps_cgroup(ps));
+        fprintf(t->of, ",\"runtime_ms\":%.3f}}", (ps->last->runtime - ps->first->runtime) / 1000000.0);
+
+        /* fork arrow from the parent */
+        if (parent_pid >= 0) {
+                trace_event(t, "s", "fork", parent_pid, parent_pid);
+                fprintf(t->of, ",\"cat\":\"process\",\"id\":%i,\"ts\":%.3f}", index, trace_ts(t, starttime));
+                trace_event(t, "f", "fork", pid, pid);
+                fprintf(t->of, ",\"cat\":\"process\",\"id\":%i,\"bp\":\"e\",\"ts\":%.3f}", index, trace_ts(t, starttime));
+        }
+
+        for (sample = ps->first; sample->next; sample = sample->next) {
+                double dt;
+
+                dt = sample->next->sampledata->sampletime - sample->sampledata->sampletime;
+                if (dt <= 0.0)
+                        continue;
+
+                /* percent of one CPU */
+                trace_event(t, "C", "cpu", pid, pid);
+                fprintf(t->of, ",\"ts\":%.3f,\"args\":{\"cpu\":%.2f,\"wait\":%.2f}}",
+                        trace_ts(t, sample->sampledata->sampletime),
+                        (sample->next->runtime - sample->runtime) / 10000000.0 / dt,
+                        (sample->next->waittime - sample->waittime) / 10000000.0 / dt);
+        }
+
+        /* the track drops back to zero once the process is gone */
+        trace_event(t, "C", "cpu", pid, pid);
+        fprintf(t->of, ",\"ts\":%.3f,\"args\":{\"cpu\":0,\"wait\":0}}", trace_ts(t, endtime));
+}
+
+int trace_do(FILE *of,
+             const char *build,
+             struct list_sample_data *head,
+             struct ps_struct *ps_first,
+             const struct kmsg *kmsg,
+             int n_cpus,
+             double graph_start) {
+
+        _cleanup_set_free_ Set *pids = NULL;
+        _cleanup_hashmap_free_ Hashmap *tracks = NULL;
+        struct trace t = {
+                .of = of,
+                .graph_start = graph_start,
+                .first = true,
+        };
+        struct ps_struct *ps;
+        int index = 0, next_pid = MAXPIDS;
+
+        LIST_FIND_TAIL(link, head, head);
+
+        pids = set_new(NULL);
+        tracks = hashmap_new(NULL);
+        if (!pids || !tracks)
+                return -ENOMEM;
+
+        fputs("{\"displayTimeUnit\":\"ms\",\"otherData\":{\"build\":", of);
+        json_write_string(of, build);
+        fprintf(of, ",\"version\":\"%s\",\"hz\":%g,\"cpus\":%i},\n\"traceEvents\":[", VERSION, arg_hz, n_cpus);
+
+        trace_system(&t, head, ps_first, n_cpus);
+
+        trace_initcalls(&t, kmsg);
+        trace_kernel_events(&t, kmsg);
+
+        ps = ps_first;
+        while ((ps = get_next_ps(ps, ps_first))) {
+                struct ps_struct *p;
+                int pid, parent_pid = -1;
+
+                if (ps_filter(ps))
+                        continue;
+
+                /* the nearest ancestor that has a track, like the SVG does */
+                for (p = ps->parent; p; p = p->parent) {
+                        void *v;
+
+                        v = hashmap_get(tracks, p);
+                        if (v) {
+                                parent_pid = PTR_TO_INT(v);
+                                break;
+                        }
+                }
+
+                /* pids may have been reused during the recording, tracks must stay apart */
+                pid = ps->pid;
+                if (pid <= TRACE_SYSTEM || set_contains(pids, INT_TO_PTR(pid)))
+                        pid = next_pid++;
+
+                if (set_put(pids, INT_TO_PTR(pid)) < 0 ||
+                    hashmap_put(tracks, ps, INT_TO_PTR(pid)) < 0)
+                        return -ENOMEM;
+
+                trace_process(&t, ps, pid, parent_pid, index++);
+        }
+
+        fputs("\n]}\n", of);
+
+        return 0;
+}